@@ -115,18 +115,60 @@
  * @li @ref PREG_CAPTURE_SECTION "preg_capture" 
  * capture a parenthesized subexpression from a PCRE pattern
  *
+ * @li @ref PREG_CAPTURE_FIRST_SECTION "preg_capture_first"
+ * capture a subexpression from the first of several PCRE patterns that matches
+ *
+ * @li @ref PREG_CAPTURE_FIRST_INDEX_SECTION "preg_capture_first_index"
+ * find which of several PCRE patterns preg_capture_first captures from
+ *
  * @li @ref PREG_CHECK_SECTION "preg_check" 
  * check if a string is a valid perl-compatible regular expression
  *
+ * @li @ref PREG_EXPLAIN_SECTION "preg_explain"
+ * show the pattern that is compiled for a PCRE pattern
+ *
+ * @li @ref PREG_EXTRACT_KV_SECTION "preg_extract_kv"
+ * extract key=value pairs from a string as JSON
+ *
+ * @li @ref PREG_GROK_SECTION "preg_grok"
+ * return the fields of a grok expression match as JSON
+ *
+ * @li @ref PREG_GROK_DEFINE_SECTION "preg_grok_define"
+ * add a definition to the grok pattern library
+ *
+ * @li @ref PREG_JSON_ARRAY_ANY_SECTION "preg_json_array_any"
+ * test if any string in a JSON array matches a PCRE pattern
+ *
+ * @li @ref PREG_JSON_ARRAY_COUNT_SECTION "preg_json_array_count"
+ * count the strings in a JSON array that match a PCRE pattern
+ *
+ * @li @ref PREG_JSON_ARRAY_FIRST_SECTION "preg_json_array_first"
+ * get the first string in a JSON array that matches a PCRE pattern
+ *
+ * @li @ref PREG_MINHASH_SECTION "preg_minhash"
+ * compute a MinHash signature of the tokens matched by a PCRE pattern
+ *
+ * @li @ref PREG_MINHASH_SIMILARITY_SECTION "preg_minhash_similarity"
+ * estimate the similarity of two preg_minhash signatures
+ *
+ * @li @ref PREG_OVERLAPS_SECTION "preg_overlaps"
+ * test if two PCRE patterns can match the same string
+ *
  * @li @ref PREG_POSITION_SECTION "preg_position"
  * get position of the of a regular expression capture group in a string
 
  * @li @ref PREG_REPLACE_SECTION "preg_replace"
  * perform regular expression search & replace using PCRE.
  *
+ * @li @ref PREG_REPLACE_HASH_SECTION "preg_replace_hash"
+ * hash the result of a search & replace without building it
+ *
  * @li @ref PREG_RLIKE_SECTION "preg_rlike"
  * test if a string matches a perl-compatible regular expression
  *
+ * @li @ref PREG_SUBSUMES_SECTION "preg_subsumes"
+ * test if a PCRE pattern matches every string that another one does
+ *
  * @li @ref LIB_MYSQLUDF_PREG_INFO_SECTION "lib_mysqludf_preg_info"
  * get information about the installed lib_mysqludf_preg library
  *
@@ -136,10 +178,58 @@
  * @copydoc PREG_CAPTURE
  *
  * @n
+ * @section PREG_CAPTURE_FIRST_SECTION preg_capture_first
+ * @copydoc PREG_CAPTURE_FIRST
+ *
+ * @n
+ * @section PREG_CAPTURE_FIRST_INDEX_SECTION preg_capture_first_index
+ * @copydoc PREG_CAPTURE_FIRST_INDEX
+ *
+ * @n
  * @section PREG_CHECK_SECTION preg_check
  * @copydoc PREG_CHECK
  *
  * @n
+ * @section PREG_EXPLAIN_SECTION preg_explain
+ * @copydoc PREG_EXPLAIN
+ *
+ * @n
+ * @section PREG_EXTRACT_KV_SECTION preg_extract_kv
+ * @copydoc PREG_EXTRACT_KV
+ *
+ * @n
+ * @section PREG_GROK_SECTION preg_grok
+ * @copydoc PREG_GROK
+ *
+ * @n
+ * @section PREG_GROK_DEFINE_SECTION preg_grok_define
+ * @copydoc PREG_GROK_DEFINE
+ *
+ * @n
+ * @section PREG_JSON_ARRAY_ANY_SECTION preg_json_array_any
+ * @copydoc PREG_JSON_ARRAY_ANY
+ *
+ * @n
+ * @section PREG_JSON_ARRAY_COUNT_SECTION preg_json_array_count
+ * @copydoc PREG_JSON_ARRAY_COUNT
+ *
+ * @n
+ * @section PREG_JSON_ARRAY_FIRST_SECTION preg_json_array_first
+ * @copydoc PREG_JSON_ARRAY_FIRST
+ *
+ * @n
+ * @section PREG_MINHASH_SECTION preg_minhash
+ * @copydoc PREG_MINHASH
+ *
+ * @n
+ * @section PREG_MINHASH_SIMILARITY_SECTION preg_minhash_similarity
+ * @copydoc PREG_MINHASH_SIMILARITY
+ *
+ * @n
+ * @section PREG_OVERLAPS_SECTION preg_overlaps
+ * @copydoc PREG_OVERLAPS
+ *
+ * @n
  * @section PREG_POSITION_SECTION preg_position 
  * @copydoc PREG_POSITION
  *
@@ -148,10 +238,18 @@
  * @copydoc PREG_REPLACE
  *
  * @n
+ * @section PREG_REPLACE_HASH_SECTION preg_replace_hash
+ * @copydoc PREG_REPLACE_HASH
+ *
+ * @n
  * @section PREG_RLIKE_SECTION preg_rlike 
  * @copydoc PREG_RLIKE
  *
  * @n
+ * @section PREG_SUBSUMES_SECTION preg_subsumes
+ * @copydoc PREG_SUBSUMES
+ *
+ * @n
  * @section LIB_MYSQLUDF_PREG_INFO_SECTION lib_mysqludf_preg_info 
  * @copydoc LIB_MYSQLUDF_PREG_INFO
  *
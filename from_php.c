@@ -62,6 +62,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "ghfcns.h"
 #include "preg_utils.h"
+#include "preg_optimize.h"
+#include "preg_grok.h"
+#include "preg_engine.h"
 
 #undef HAVE_SETLOCALE   // R.A.W
 
@@ -77,84 +80,53 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 
- /** @fn pcre *compileRegex( char *regex,int regex_len,char *msg, int msglen ) 
-  * 
-  * @brief Compile a pcre regular expression
-  * 
-  *    @param regex - a STRING pcre regular expression to be compiled
-  *    @param regex_len - the length of the passed in regex
+ /** @fn char *parseRegex( char *regex , int *coptions , int *do_study ,
+  *                        int *do_optimize , 
+  *                        const struct preg_engine_s **engine ,
+  *                        char *msg , int msglen )
+  *
+  * @brief Split a delimited regular expression into its pattern and options
+  *
+  *    @param regex - a STRING pcre regular expression with delimiters
+  *    @param coptions - put the pcre_compile options from the modifiers here
+  *    @param do_study - set to 1 here if the S modifier was given
+  *    @param do_optimize - set to 1 here if the O modifier was given
+  *    @param engine - set to the engine forced by a modifier (such as L), 
+  * or NULL to let compileRegex choose
   *    @param msg - a buffer to store potential error an info messages
   *    @param msglen  - size of the message buffer
   *
   * @returns
-  *    a point to te compiled regular expression information - on success
-  *    NULL - on error - some errors will copy a more detailed info into msg
+  *    the pattern without delimiters and modifiers - on success.  It must
+  * be free'd by the caller.
+  *    NULL - on error - msg contains the reason
   *
   * @details
+  *    This is the delimiter and modifier parsing that compileRegex does
+  * before calling pcre_compile.  It is separate so that patterns can be
+  * examined without being compiled.  If the G modifier was given, the 
+  * grok references in the returned pattern are already expanded.
   *
   * @note
   *    This function requires a NULL terminated string as the regex parameter.
-  * This is a limitation to the original php function from which this was
-  * copied.
-  *    
   */
-
-//PHPAPI pcre_cache_entry* pcre_get_compiled_regex_cache(char *regex, int regex_len TSRMLS_DC)
-pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen ) 
+char *parseRegex( char *regex , int *coptions , int *do_study ,
+                  int *do_optimize , const struct preg_engine_s **engine ,
+                  char *msg , int msglen )
 {
-	pcre				*re = NULL;
-	pcre_extra			*extra;
-	int					 coptions = 0;
-	int					 soptions = 0;
-	const char			*error;
-	int					 erroffset;
 	char				 delimiter;
 	char				 start_delimiter;
 	char				 end_delimiter;
 	char				*p, *pp;
 	char				*pattern;
-	int					 do_study = 0;
-	//int					 poptions = 0;
-	unsigned const char *tables = NULL;
-    char buf[ 1024 ] ;
-
-#if HAVE_SETLOCALE
-	char				*locale = setlocale(LC_CTYPE, NULL);
-#endif
-
-    //R.A.W.
-	//pcre_cache_entry	*pce;
-	//pcre_cache_entry	 new_entry;
-    if( msglen )
-    {
-        *msg = '\0';
-    }
+	char				*expanded;
+	int					 do_grok = 0;
 
-	/* Try to lookup the cached regex entry, and if successful, just pass
-	   back the compiled pattern, otherwise go on and compile it. */
-	//regex_len = strlen(regex);
+	*coptions = 0;
+	*do_study = 0;
+	*do_optimize = 0;
+	*engine = NULL;
 
-//R.A.W.
-#if 0  
-
-	if (zend_hash_find(&PCRE_G(pcre_cache), regex, regex_len+1, (void **)&pce) == SUCCESS) {
-		/*
-		 * We use a quick pcre_info() check to see whether cache is corrupted, and if it
-		 * is, we flush it and compile the pattern from scratch.
-		 */
-		if (pcre_info(pce->re, NULL, NULL) == PCRE_ERROR_BADMAGIC) {
-			zend_hash_clean(&PCRE_G(pcre_cache));
-		} else {
-#if HAVE_SETLOCALE
-			if (!strcmp(pce->locale, locale)) {
-#endif
-				return pce;
-#if HAVE_SETLOCALE
-			}
-#endif
-		}
-	}
-#endif
 	p = regex;
 	
 	/* Parse through the leading whitespace, and display a warning if we
@@ -241,28 +213,34 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 	while (*pp != 0) {
 		switch (*pp++) {
 			/* Perl compatible options */
-			case 'i':	coptions |= PCRE_CASELESS;		break;
-			case 'm':	coptions |= PCRE_MULTILINE;		break;
-			case 's':	coptions |= PCRE_DOTALL;		break;
-			case 'x':	coptions |= PCRE_EXTENDED;		break;
+			case 'i':	*coptions |= PCRE_CASELESS;		break;
+			case 'm':	*coptions |= PCRE_MULTILINE;		break;
+			case 's':	*coptions |= PCRE_DOTALL;		break;
+			case 'x':	*coptions |= PCRE_EXTENDED;		break;
 			
 			/* PCRE specific options */
-			case 'A':	coptions |= PCRE_ANCHORED;		break;
-			case 'D':	coptions |= PCRE_DOLLAR_ENDONLY;break;
-			case 'S':	do_study  = 1;					break;
-			case 'U':	coptions |= PCRE_UNGREEDY;		break;
-			case 'X':	coptions |= PCRE_EXTRA;			break;
-			case 'u':	coptions |= PCRE_UTF8;			break;
+			case 'A':	*coptions |= PCRE_ANCHORED;		break;
+			case 'D':	*coptions |= PCRE_DOLLAR_ENDONLY;break;
+			case 'S':	*do_study  = 1;					break;
+			case 'U':	*coptions |= PCRE_UNGREEDY;		break;
+			case 'X':	*coptions |= PCRE_EXTRA;			break;
+			case 'u':	*coptions |= PCRE_UTF8;			break;
 
                 // R.A.W.
 			/* Custom preg options */
                 //case 'e':	poptions |= PREG_REPLACE_EVAL;	break;
+			case 'O':	*do_optimize = 1;				break;
+			case 'G':	do_grok = 1;					break;
 			
 			case ' ':
 			case '\n':
 				break;
 
 			default:
+                // R.A.W.
+                // The other letters force a matching engine (see preg_engine.c)
+				if ((*engine = pregEngineByModifier(pp[-1])) != NULL)
+					break;
 				//php_error_docref(NULL TSRMLS_CC,E_WARNING, "Unknown modifier '%c'", pp[-1]);
                 strncpy( msg,"Unknown modifier",msglen ) ;
 				free(pattern);
@@ -270,8 +248,105 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 		}
 	}
 
+    // R.A.W.
+    // Expand %{NAME:field} references if the G modifier was given.
+	if (do_grok) {
+		expanded = pregGrokExpand(pattern, *coptions, msg, msglen);
+		free(pattern);
+		pattern = expanded;
+	}
+
+	return pattern;
+}
+
+
+ /** @fn struct preg_re_s *compileRegex( char *regex,int regex_len,char *msg, int msglen ) 
+  * 
+  * @brief Compile a pcre regular expression
+  * 
+  *    @param regex - a STRING pcre regular expression to be compiled
+  *    @param regex_len - the length of the passed in regex
+  *    @param msg - a buffer to store potential error an info messages
+  *    @param msglen  - size of the message buffer
+  *
+  * @returns
+  *    a point to te compiled regular expression information - on success
+  *    NULL - on error - some errors will copy a more detailed info into msg
+  *
+  * @details
+  *    The pattern is compiled by the cheapest engine that can run it, 
+  * unless a modifier forces one (see preg_engine.c).
+  *
+  * @note
+  *    This function requires a NULL terminated string as the regex parameter.
+  * This is a limitation to the original php function from which this was
+  * copied.
+  *    
+  */
+
+//PHPAPI pcre_cache_entry* pcre_get_compiled_regex_cache(char *regex, int regex_len TSRMLS_DC)
+struct preg_re_s *compileRegex( char *regex , int regex_len , char *msg , int msglen ) 
+{
+	struct preg_re_s	*re = NULL;
+	pcre_extra			*extra;
+	int					 coptions = 0;
+	int					 soptions = 0;
+	const char			*error;
+	int					 erroffset;
+	char				*pattern;
+	int					 do_study = 0;
+	int					 do_optimize = 0;
+	char				*optimized;
+	const struct preg_engine_s *engine;
+	//int					 poptions = 0;
+	//unsigned const char *tables = NULL;
+    char buf[ 1024 ] ;
+
+#if HAVE_SETLOCALE
+	char				*locale = setlocale(LC_CTYPE, NULL);
+#endif
+
+    //R.A.W.
+	//pcre_cache_entry	*pce;
+	//pcre_cache_entry	 new_entry;
+    if( msglen )
+    {
+        *msg = '\0';
+    }
+
+	/* Try to lookup the cached regex entry, and if successful, just pass
+	   back the compiled pattern, otherwise go on and compile it. */
+	//regex_len = strlen(regex);
+
+//R.A.W.
+#if 0  
+
+	if (zend_hash_find(&PCRE_G(pcre_cache), regex, regex_len+1, (void **)&pce) == SUCCESS) {
+		/*
+		 * We use a quick pcre_info() check to see whether cache is corrupted, and if it
+		 * is, we flush it and compile the pattern from scratch.
+		 */
+		if (pcre_info(pce->re, NULL, NULL) == PCRE_ERROR_BADMAGIC) {
+			zend_hash_clean(&PCRE_G(pcre_cache));
+		} else {
+#if HAVE_SETLOCALE
+			if (!strcmp(pce->locale, locale)) {
+#endif
+				return pce;
+#if HAVE_SETLOCALE
+			}
+#endif
+		}
+	}
+#endif
+	pattern = parseRegex( regex , &coptions , &do_study , &do_optimize ,
+	                      &engine , msg , msglen );
+	if (pattern == NULL) {
+		return NULL;
+	}
+
     //R.A.W.
-    tables = NULL ;
+    //tables = NULL ;
 #if 0 
 #if HAVE_SETLOCALE
 	if (strcmp(locale, "C"))
@@ -279,12 +354,23 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 #endif
 #endif
 
+    // R.A.W.
+    // Compile the optimized pattern if the O modifier was given.  If that
+    // fails, the original is compiled so errors are about what was written.
+	re = NULL;
+	if (do_optimize && (optimized = pregOptimizePattern(pattern, coptions))) {
+		re = pregEngineCompile(optimized, coptions, engine, &error, &erroffset);
+		free(optimized);
+	}
+
 	/* Compile pattern and display a warning if compilation failed. */
-	re = pcre_compile(pattern,
-					  coptions,
-					  &error,
-					  &erroffset,
-					  tables);
+	if (re == NULL) {
+		re = pregEngineCompile(pattern,
+						  coptions,
+						  engine,
+						  &error,
+						  &erroffset);
+	}
 
 	if (re == NULL) {
 		//php_error_docref(NULL TSRMLS_CC,E_WARNING, "Compilation failed: %s at offset %d", error, erroffset);
@@ -303,8 +389,9 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 
 	/* If study option was specified, study the pattern and
 	   store the result in extra for passing to pcre_exec. */
-	if (do_study) {
-		extra = pcre_study(re, soptions, &error);
+    // R.A.W. - only pcre's patterns can be studied
+	if (do_study && pregEnginePcre(re)) {
+		extra = pcre_study(pregEnginePcre(re), soptions, &error);
 		if (extra) {
 			extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
 		}
@@ -390,130 +477,146 @@ static int preg_get_backref(char **str, int *backref)
 
 
 
+/*
+ * Where pregReplaceTo sends its output.  Once a write fails, failed is set
+ * and later writes do nothing.
+ */
+struct preg_sink_s {
+	void (*write)(struct preg_sink_s *sink, const char *s, int l);
+	int failed;
+};
+
+/*
+ * A sink that builds the result in a growing buffer (for pregReplace).
+ */
+struct preg_buf_sink_s {
+	struct preg_sink_s sink;
+	char *s;
+	int len;
+	int size;
+};
+
+/*
+ * A sink that only keeps a 64 bit FNV-1a hash of the result (for 
+ * pregReplaceHash).  FNV-1a works a byte at a time, so the hash doesn't
+ * depend on how the output is split into writes.
+ */
+struct preg_hash_sink_s {
+	struct preg_sink_s sink;
+	unsigned long long hash;
+};
+
+#define PREG_FNV64_BASIS 14695981039346656037ULL
+#define PREG_FNV64_PRIME 1099511628211ULL
+
+static void preg_buf_sink_write(struct preg_sink_s *sink, const char *s, int l)
+{
+	struct preg_buf_sink_s *buf = (struct preg_buf_sink_s *)sink;
+	char *new_buf;
+	int new_size;
+
+	if (sink->failed || l <= 0)
+		return;
+
+	if (buf->len + l + 1 > buf->size) {
+		new_size = 1 + buf->size + 2 * (buf->len + l);
+		new_buf = realloc(buf->s, new_size);
+		if (!new_buf) {
+			sink->failed = 1;
+			return;
+		}
+		buf->s = new_buf;
+		buf->size = new_size;
+	}
+
+	memcpy(buf->s + buf->len, s, l);
+	buf->len += l;
+	buf->s[buf->len] = '\0';
+}
+
+static void preg_hash_sink_write(struct preg_sink_s *sink, const char *s, int l)
+{
+	struct preg_hash_sink_s *h = (struct preg_hash_sink_s *)sink;
+	unsigned long long hash = h->hash;
+	const unsigned char *p = (const unsigned char *)s;
+	const unsigned char *end = p + l;
+
+	while (p < end) {
+		hash ^= *p++;
+		hash *= PREG_FNV64_PRIME;
+	}
+	h->hash = hash;
+}
+
 /* {{{ php_pcre_replace_impl() */
-//char *php_pcre_replace_impl(pcre_cache_entry *pce, char *subject, int subject_len, zval *replace_val, 
-char *pregReplace(pcre *re , pcre_extra *extra , 
-                     char *subject, int subject_len, char *replace, 
-                     int replace_len , 
-                     int is_callable_replace, int *result_len, int limit, 
-                     int *replace_count, char *msg , int msglen )
+/*
+ * The replace engine.  This started as php_pcre_replace_impl(), but the 
+ * output goes to a sink instead of a buffer, so that the same engine can
+ * build the result (pregReplace) or only hash it (pregReplaceHash).  The 
+ * pieces of the subject between matches, the literal runs of the 
+ * replacement and the back references are written as they are found.
+ *
+ * Returns 0 on success, or the pcre_exec error code (or 
+ * PCRE_ERROR_NOMEMORY) with a message in msg.
+ */
+static int pregReplaceTo(struct preg_re_s *re , pcre_extra *extra , 
+                         const char *subject, int subject_len, 
+                         const char *replace, int replace_len , int limit, 
+                         int *replace_count, struct preg_sink_s *sink, 
+                         char *msg , int msglen )
 {
-    // R.A.W.
-	//pcre_extra		*extra = pce->extra;/* Holds results of studying */
 	pcre_extra		 extra_data;		/* Used locally for exec options */
 	int				 exoptions = 0;		/* Execution options */
 	int				 count = 0;			/* Count of matched subpatterns */
 	int				*offsets;			/* Array of subpattern offsets */
 	int				 size_offsets;		/* Size of the offsets array */
-	int				 new_len;			/* Length of needed storage */
-	int				 alloc_len;			/* Actual allocated length */
-	//int				 eval_result_len=0;	/* Length of the eval'ed or
-    //function-returned string */
-	int				 match_len;			/* Length of the current match */
 	int				 backref;			/* Backreference number */
-	int				 eval;				/* If the replacement string should be eval'ed */
 	int				 start_offset;		/* Where the new search starts */
 	int				 g_notempty=0;		/* If the match should not be empty */
-	//int				 replace_len=0;		/* Length of replacement string */
-	char			*result,			/* Result of replacement */
-    //*replace=NULL,		/* Replacement string */  R.A.W.
-					*new_buf,			/* Temporary buffer for re-allocation */
-					*walkbuf,			/* Location of current replacement in the result */
-					*walk,				/* Used to walk the replacement string */
-					*match,				/* The current match */
-					*piece,				/* The current piece of subject */
-					*replace_end=NULL,	/* End of replacement string */
+	char			*walk,				/* Used to walk the replacement string */
+					*lit,				/* Start of the literal run being walked */
+					*ref,				/* Start of a backreference */
+					*replace_end,		/* End of replacement string */
 					 walk_last;			/* Last walked character */
-    //*eval_result,		/* Result of eval or custom function */
-	int				 rc;
+	const char		*match,				/* The current match */
+					*piece;				/* The current piece of subject */
+	int				 rc = 0;
 
 	if (extra == NULL) {
-        // R.A.W.
-        memset( &extra_data , 0 , sizeof( extra_data ) ) ;
+		memset( &extra_data , 0 , sizeof( extra_data ) ) ;
 		extra_data.flags = PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
 		extra = &extra_data;
 	}
 
-    // R.A.W.  -- from php.ini-reccommended
-    // These might be too big. Crashes can occur with this large recursion_limit
-    pregSetLimits(extra);
-	//extra->match_limit = PCRE_G(backtrack_limit);
-	//extra->match_limit_recursion = PCRE_G(recursion_limit);
-
+	// from php.ini-reccommended
+	// These might be too big. Crashes can occur with this large recursion_limit
+	pregSetLimits(extra);
 
-    // R.A.W.  - Eval'ing or callable replace. There might be something 
-    // similar to do for MySQL, but not for now.
-    //
-    eval = 0 ;
-    is_callable_replace = 0 ;
-	//eval = pce->preg_options & PREG_REPLACE_EVAL;
-
-	if (is_callable_replace) {
-		if (eval) {
-            //R.A.W.
-			//php_error_docref(NULL TSRMLS_CC, E_WARNING, "Modifier /e cannot be used with replacement callback");
-			return NULL;
-		}
-	} else {
-        // R.A.W.
-		//replace = Z_STRVAL_P(replace_val);
-		//replace_len = Z_STRLEN_P(replace_val);
-		replace_end = replace + replace_len;
-	}
+	replace_end = (char *)replace + replace_len;
 
 	/* Calculate the size of the offsets array, and allocate memory for it. */
-	//rc = pcre_fullinfo(pce->re, extra, PCRE_INFO_CAPTURECOUNT, &size_offsets);
-	rc = pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &size_offsets);
-	if (rc < 0) {
-		//php_error_docref(NULL TSRMLS_CC, E_WARNING, "Internal pcre_fullinfo() error %d", rc);
-        strncpy( msg , "Internal pcre_fullinfo() error" , msglen ) ;
-		return NULL;
+	size_offsets = pregEngineCaptureCount(re);
+	if (size_offsets < 0) {
+		strncpy( msg , "Internal pcre_fullinfo() error" , msglen ) ;
+		return PCRE_ERROR_INTERNAL;
 	}
 	size_offsets = (size_offsets + 1) * 3;
-	//offsets = (int *)safe_emalloc(size_offsets, sizeof(int), 0);
-    // R.A.W.
 	offsets = (int *)calloc(size_offsets, sizeof(int));
-    if( !offsets ) {
-        strncpy( msg , "Out of memory for offsets" , msglen ) ;
-		return NULL;
-    }
-                            
-	
-	//alloc_len = 2 * subject_len + 1;
-	alloc_len = 2 * subject_len + 1;
-	//result = safe_emalloc(alloc_len, sizeof(char), 0);
-    // R.A.W.
-	result = calloc(alloc_len, sizeof(char));
-    if( !result )
-    {
-        strncpy( msg , "Out of memory for result" , msglen ) ;
-        free( offsets ) ;
-		return NULL;
-    }
-    
+	if( !offsets ) {
+		strncpy( msg , "Out of memory for offsets" , msglen ) ;
+		return PCRE_ERROR_NOMEMORY;
+	}
 
 	/* Initialize */
-	match = NULL;
-	*result_len = 0;
 	start_offset = 0;
 	
-    // R.A.W.  - not sure what this does
-    //PCRE_G(error_code) = PHP_PCRE_NO_ERROR;
-	
-	while (1) {
+	while (!sink->failed) {
 		/* Execute the regular expression. */
-        /*
-          R.A.W.
-		count = pcre_exec(pce->re, extra, subject, subject_len, start_offset,
-						  exoptions|g_notempty, offsets, size_offsets);
-        */
-		count = pcre_exec(re, extra, subject, subject_len, start_offset,
+		count = pregEngineExec(re, extra, subject, subject_len, start_offset,
 						  exoptions|g_notempty, offsets, size_offsets);
 		
 		/* Check for too many substrings condition. */
 		if (count == 0) {
-            //R.A.W.
-			//php_error_docref(NULL TSRMLS_CC,E_NOTICE, "Matched, but too many substrings");
 			strncpy(msg , "Matched, but too many substrings",msglen);
 			count = size_offsets/3;
 		}
@@ -527,109 +630,36 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			/* Set the match location in subject */
 			match = subject + offsets[0];
 
-			new_len = *result_len + offsets[0] - start_offset; /* part before the match */
-
-            // R.A.W.  - No callable replace or eval (see above).  Don't let
-            // functions be linked in.
-#if 0           
-            
-			/* If evaluating, do it and add the return string's length */
-			if (eval) {
-				eval_result_len = preg_do_eval(replace, replace_len, subject,
-											   offsets, count, &eval_result TSRMLS_CC);
-				new_len += eval_result_len;
-			} else if (is_callable_replace) {
-				/* Use custom function to get replacement string and its length. */
-				eval_result_len = preg_do_repl_func(replace_val, subject, offsets,
-													count, &eval_result TSRMLS_CC);
-				new_len += eval_result_len;
-			} else 
-#endif
-
-            { /* do regular substitution */
-				walk = replace;
-				walk_last = 0;
-				while (walk < replace_end) {
-					if ('\\' == *walk || '$' == *walk) {
-						if (walk_last == '\\') {
-							walk++;
-							walk_last = 0;
-							continue;
-						}
-						if (preg_get_backref(&walk, &backref)) {
-							if (backref < count)
-								new_len += offsets[(backref<<1)+1] - offsets[backref<<1];
-							continue;
-						}
-					}
-					new_len++;
-					walk++;
-					walk_last = walk[-1];
-				}
-			}
-
-			if (new_len + 1 > alloc_len) {
-				alloc_len = 1 + alloc_len + 2 * new_len;
-
-                // R.A.W. 
-				//new_buf = emalloc(alloc_len);
-                new_buf = malloc( alloc_len ) ;
-                if( !new_buf )
-                {
-                    strncpy( msg , "Out of memory for new_buf " , msglen ) ;
-                    free( offsets ) ;
-                    free( result ) ;
-                    return NULL;
-                }
-                    
-				memcpy(new_buf, result, *result_len);
-				//efree(result);
-                free( result ) ;
-				result = new_buf;
-			}
 			/* copy the part of the string before the match */
-			memcpy(&result[*result_len], piece, match-piece);
-			*result_len += match-piece;
-
-			/* copy replacement and backrefs */
-			walkbuf = result + *result_len;
-			
-            // R.A.W.  Don't link in the eval stuff
-#if 0            
-			/* If evaluating or using custom function, copy result to the buffer
-			 * and clean up. */
-			if (eval || is_callable_replace) {
-				memcpy(walkbuf, eval_result, eval_result_len);
-				*result_len += eval_result_len;
-				STR_FREE(eval_result);
-			} else 
-#endif
-{ /* do regular backreference copying */
-				walk = replace;
-				walk_last = 0;
-				while (walk < replace_end) {
-					if ('\\' == *walk || '$' == *walk) {
-						if (walk_last == '\\') {
-							*(walkbuf-1) = *walk++;
-							walk_last = 0;
-							continue;
-						}
-						if (preg_get_backref(&walk, &backref)) {
-							if (backref < count) {
-								match_len = offsets[(backref<<1)+1] - offsets[backref<<1];
-								memcpy(walkbuf, subject + offsets[backref<<1], match_len);
-								walkbuf += match_len;
-							}
-							continue;
-						}
+			sink->write(sink, piece, match-piece);
+
+			/* copy replacement and backrefs.  Literal runs are written
+			   when a backreference or an escape ends them. */
+			walk = lit = (char *)replace;
+			walk_last = 0;
+			while (walk < replace_end) {
+				if ('\\' == *walk || '$' == *walk) {
+					if (walk_last == '\\') {
+						/* the escaped character replaces the backslash */
+						sink->write(sink, lit, walk-1-lit);
+						lit = walk++;
+						walk_last = 0;
+						continue;
+					}
+					ref = walk;
+					if (preg_get_backref(&walk, &backref)) {
+						sink->write(sink, lit, ref-lit);
+						if (backref < count)
+							sink->write(sink, subject + offsets[backref<<1],
+										offsets[(backref<<1)+1] - offsets[backref<<1]);
+						lit = walk;
+						continue;
 					}
-					*walkbuf++ = *walk++;
-					walk_last = walk[-1];
 				}
-				*walkbuf = '\0';
-				/* increment the result length by how much we've added to the string */
-				*result_len += walkbuf - (result + *result_len);
+				walk++;
+				walk_last = walk[-1];
 			}
+			sink->write(sink, lit, walk-lit);
 
 			if (limit != -1)
 				limit--;
@@ -642,42 +672,15 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			if (g_notempty != 0 && start_offset < subject_len) {
 				offsets[0] = start_offset;
 				offsets[1] = start_offset + 1;
-				memcpy(&result[*result_len], piece, 1);
-				(*result_len)++;
+				sink->write(sink, piece, 1);
 			} else {
-				new_len = *result_len + subject_len - start_offset;
-				if (new_len + 1 > alloc_len) {
-					alloc_len = new_len + 1; /* now we know exactly how long it is */
-					//new_buf = safe_emalloc(alloc_len, sizeof(char), 0);
-                    new_buf = calloc(alloc_len, sizeof(char));
-                    if( !new_buf )
-                    {
-                        strncpy( msg , "Out of memory for new_buf" , msglen ) ;
-                        free( offsets ) ;
-                        free( result ) ;
-                        return NULL;
-                    }
-                        
-					memcpy(new_buf, result, *result_len);
-					free(result);
-					//efree(result);
-					result = new_buf;
-				}
 				/* stick that last bit of string on our output */
-				memcpy(&result[*result_len], piece, subject_len - start_offset);
-				*result_len += subject_len - start_offset;
-				result[*result_len] = '\0';
+				sink->write(sink, piece, subject_len - start_offset);
 				break;
 			}
 		} else {
-			//pcre_handle_exec_error(count TSRMLS_CC);
-            // R.A.W.
-			//pcre_handle_exec_error(count);
 			snprintf(msg, msglen, "Exec failed with error %d (%s)", count, pregExecErrorString(count));
-			*result_len = count;
-			free( result ) ;
-			//efree(result);
-			result = NULL;
+			rc = count;
 			break;
 		}
 			
@@ -691,13 +694,96 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 		start_offset = offsets[1];
 	}
 	
-    free( offsets ) ;
-	//efree(offsets);
+	free( offsets ) ;
 
-	return result;
+	if (sink->failed) {
+		strncpy( msg , "Out of memory for result" , msglen ) ;
+		rc = PCRE_ERROR_NOMEMORY;
+	}
+
+	return rc;
 }
 /* }}} */
 
+/*
+ * Replaces the matches of re in subject.  Returns the result (which the 
+ * caller frees) and its length in result_len.  On error, returns NULL 
+ * with the pcre_exec error code in result_len.  is_callable_replace is 
+ * not supported and is ignored.
+ */
+char *pregReplace(struct preg_re_s *re , pcre_extra *extra , 
+                  const char *subject, int subject_len, const char *replace, 
+                  int replace_len , 
+                  int is_callable_replace, int *result_len, int limit, 
+                  int *replace_count, char *msg , int msglen )
+{
+	struct preg_buf_sink_s buf;
+	int rc;
+
+	buf.sink.write = preg_buf_sink_write;
+	buf.sink.failed = 0;
+	buf.len = 0;
+	buf.size = 2 * subject_len + 1;
+	buf.s = calloc(buf.size, sizeof(char));
+	if( !buf.s )
+	{
+		strncpy( msg , "Out of memory for result" , msglen ) ;
+		*result_len = PCRE_ERROR_NOMEMORY;
+		return NULL;
+	}
+
+	rc = pregReplaceTo(re, extra, subject, subject_len, replace, replace_len,
+					   limit, replace_count, &buf.sink, msg, msglen);
+	if (rc) {
+		free( buf.s ) ;
+		*result_len = rc;
+		return NULL;
+	}
+
+	*result_len = buf.len;
+	return buf.s;
+}
+
+/*
+ * Like pregReplace, but only computes a 64 bit hash of the result, which 
+ * is never built.  Returns 0 on success, or the pcre_exec error code.
+ */
+int pregReplaceHash(struct preg_re_s *re , pcre_extra *extra , 
+                    const char *subject, int subject_len, 
+                    const char *replace, int replace_len , int limit, 
+                    int *replace_count, unsigned long long *hash, 
+                    char *msg , int msglen )
+{
+	struct preg_hash_sink_s h;
+	int rc;
+
+	h.sink.write = preg_hash_sink_write;
+	h.sink.failed = 0;
+	h.hash = PREG_FNV64_BASIS;
+
+	rc = pregReplaceTo(re, extra, subject, subject_len, replace, replace_len,
+					   limit, replace_count, &h.sink, msg, msglen);
+	*hash = h.hash;
+
+	return rc;
+}
+
+
+/*
+ * The pregReplaceHash hash of a string, which is what pregReplaceHash 
+ * gives when nothing is replaced.
+ */
+unsigned long long pregHash(const char *s, int l)
+{
+	struct preg_hash_sink_s h;
+
+	h.sink.write = preg_hash_sink_write;
+	h.sink.failed = 0;
+	h.hash = PREG_FNV64_BASIS;
+	h.sink.write(&h.sink, s, l);
+
+	return h.hash;
+}
 
 
 
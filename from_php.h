@@ -7,10 +7,22 @@
  *
  */
 
-char *pregReplace(pcre *re , pcre_extra *extra , 
+char *pregReplace(struct preg_re_s *re , pcre_extra *extra , 
                   const char *subject, int subject_len, const char *replace, 
                   int replace_len , 
                   int is_callable_replace, int *result_len, int limit, 
                   int *replace_count, char *msg , int msglen );
 
-pcre *compileRegex( const char *regex , int regex_len , char *msg , int msglen ) ;
+int pregReplaceHash(struct preg_re_s *re , pcre_extra *extra , 
+                    const char *subject, int subject_len, 
+                    const char *replace, int replace_len , int limit, 
+                    int *replace_count, unsigned long long *hash, 
+                    char *msg , int msglen );
+
+unsigned long long pregHash(const char *s, int l);
+
+struct preg_re_s *compileRegex( const char *regex , int regex_len , char *msg , int msglen ) ;
+
+char *parseRegex( char *regex , int *coptions , int *do_study , 
+                  int *do_optimize , const struct preg_engine_s **engine ,
+                  char *msg , int msglen ) ;
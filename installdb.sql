@@ -2,9 +2,23 @@
 USE mysql;
 CREATE FUNCTION lib_mysqludf_preg_info RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_capture RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_capture_first RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_capture_first_index RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_check RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_explain RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_extract_kv RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_grok RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_grok_define RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_json_array_any RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_json_array_count RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_json_array_first RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_minhash RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_minhash_similarity RETURNS REAL SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_replace RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_replace_hash RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_overlaps RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_rlike RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_position RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_subsumes RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
 
 
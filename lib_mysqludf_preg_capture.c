@@ -215,11 +215,12 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
     int *ovector;               /* for offsets of captures */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
     int rc ;                    /* number of regex's matched by pattern  */
-    pcre *re ;                  /* the compiled pattern */
+    struct preg_re_s *re ;      /* the compiled pattern */
     const char *res2 ;          /* for pcre_get_substring to alloc */
     char *subject ;             /* args[1] */
 
     ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
 
     *is_null = 1 ;              /* default to NULL return */
     *error = 0 ;                /* default to no error */
@@ -238,7 +239,11 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
 
     // compile the regex if necessary
     if( ptr->constant_pattern )
-        re = ptr->re ;
+    {
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return NULL ;
+    }
     else
     {
         re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
@@ -248,6 +253,7 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
             *error = 1 ;
             return  NULL ;
         }
+        ptr->stats.compiles++ ;
     }
 
     // create vector to hold offsets for pcre
@@ -257,7 +263,7 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
         ghlogprintf( "PREG_CAPTURE: can't create offset vector :%s\n", msg );
         *error = 1 ;
         if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
+            pregEngineFree( re ) ;
         return NULL ;
     }
 
@@ -270,7 +276,8 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
 
     if( subject )
     {
-        ex_subject = pregSkipToOccurence( re , subject , args->lengths[1] , 
+        ex_subject = pregSkipToOccurence( ptr , re , subject , 
+                                          args->lengths[1] , 
                                           ovector , oveccount , occurence,&rc);
         groupnum = -1 ;
         if( rc > 0 )
@@ -290,7 +297,7 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
     free( ovector ) ;
 
     if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
+        pregEngineFree( re ) ;
 
     return result ;
 }
@@ -0,0 +1,746 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_capture_first.c
+ *
+ * @brief Implements the PREG_CAPTURE_FIRST and PREG_CAPTURE_FIRST_INDEX 
+ * mysql udfs
+ *
+ */
+
+
+/**
+ * @page PREG_CAPTURE_FIRST  PREG_CAPTURE_FIRST
+ *
+ * @brief capture a group from the first of several perl-compatible regular
+ * expressions that matches
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_capture_first RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_CAPTURE_FIRST( subject , group , pattern1 [, pattern2 ...] )
+ * 
+ * @par
+ *     @param subject - the data to perform the match & capture on
+ *
+ *     @param group - the capture group to return.  This can be a numeric 
+ * capture group or a named capture group, as for PREG_CAPTURE.  0 is the 
+ * whole match.
+ *
+ *     @param pattern1... - perl compatible regular expressions with 
+ * delimiters and optional modifiers.  They are tried in order.
+ *
+ *     @return - string - group from the first pattern that matches the 
+ * subject and sets the group
+ *     @return - NULL - if none does
+ *
+ * @details
+ *    preg_capture_first is the same as 
+ * COALESCE(PREG_CAPTURE(pattern1,subject,group), 
+ * PREG_CAPTURE(pattern2,subject,group), ...) in one function call.  The 
+ * constant patterns are compiled once for the query, and the capture is 
+ * returned where it is in the subject instead of being copied.  
+ *
+ * Before a pattern is tried, the bytes that it needs (the literal it 
+ * starts with and the last literal it requires, as found by pcre) are 
+ * looked up in a table of the bytes in the subject.  The table is made at 
+ * most once per row, and patterns that can't match are skipped without
+ * scanning the subject.  Patterns without the group are also skipped.
+ *
+ * Use PREG_CAPTURE_FIRST_INDEX with the same arguments to find out which
+ * pattern matched.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_CAPTURE_FIRST( 'id=42' , 1 , '/^(\\d+)$/' , '/id=(\\d+)/' );
+ *
+ * @b Yields: 42
+ *
+ * SELECT PREG_CAPTURE_FIRST( line , 'ts' , '/^(?<ts>\\d{4}-\\d\\d-\\d\\d)/' ,
+ *                           '/^\\[(?<ts>[^\\]]+)\\]/' ) FROM log ;
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation
+ */
+
+
+/**
+ * @page PREG_CAPTURE_FIRST_INDEX  PREG_CAPTURE_FIRST_INDEX
+ *
+ * @brief find which of several perl-compatible regular expressions 
+ * PREG_CAPTURE_FIRST would capture from
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_capture_first_index RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_CAPTURE_FIRST_INDEX( subject , group , pattern1 [, pattern2 ...] )
+ * 
+ * @par
+ *     @param subject - the data to match
+ *
+ *     @param group - the capture group that must be set, as for 
+ * PREG_CAPTURE_FIRST.  Use 0 to find the first pattern that matches.
+ *
+ *     @param pattern1... - perl compatible regular expressions with 
+ * delimiters and optional modifiers
+ *
+ *     @return - the position in the list (starting from 1) of the first 
+ * pattern that matches the subject and sets the group
+ *     @return - NULL - if none does
+ *
+ * @details
+ *    preg_capture_first_index takes the same arguments and tries the 
+ * patterns the same way as PREG_CAPTURE_FIRST.  It is meant for format 
+ * detection, where the position of the pattern identifies the format.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_CAPTURE_FIRST_INDEX( '[2013-01-02] x' , 0 , '/^\\d{4}-/' , 
+ *                                 '/^\\[\\d{4}-/' );
+ *
+ * @b Yields: 2
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "ghfcns.h"
+
+/*
+ * A pattern in the list.
+ */
+struct preg_cf_pattern_s {
+    struct preg_re_s *re ;      /* NULL if the pattern isn't constant */
+    int is_null ;               /* the pattern is a NULL constant */
+    int *ovector ;              /* for use by pcre_exec */
+    int oveccount ;             /* size of ovector */
+    int groupnum ;              /* group to capture, -1 if there isn't one */
+    int need[2] ;               /* bytes the subject must have, -1 if none */
+};
+
+/*
+ * What the PREG_CAPTURE_FIRST udfs keep in initid->ptr.
+ */
+struct preg_cf_s {
+    struct preg_s preg ;        /* must be first.  See pregInitWith */
+    int constant_group ;        /* is the group argument constant? */
+    int npatterns ;             /* patterns in the list */
+    struct preg_cf_pattern_s *patterns ;
+};
+
+/*
+ * Public function declarations:
+ */
+bool preg_capture_first_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_capture_first( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                          unsigned long *length, char *is_null, char *error );
+void preg_capture_first_deinit( UDF_INIT* initid );
+
+bool preg_capture_first_index_init(UDF_INIT *initid, UDF_ARGS *args, 
+                                   char *message);
+longlong preg_capture_first_index( UDF_INIT *initid , UDF_ARGS *args, 
+                                   char *is_null, char *error );
+void preg_capture_first_index_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private function definitions:
+ */
+
+/**
+ * @fn static struct preg_re_s *cfCompileFirst( UDF_ARGS *args , char *msg , int msglen )
+ *
+ * @brief compile the first pattern in the list (for pregInitInline)
+ */
+static struct preg_re_s *cfCompileFirst( UDF_ARGS *args , char *msg , int msglen )
+{
+    return pregCompileRegexArgNum( args , 2 , msg , msglen ) ;
+}
+
+/**
+ * @fn static int cfGroupNum( struct preg_re_s *re , UDF_ARGS *args )
+ *
+ * @brief find the number of the group argument in a pattern
+ *
+ * @return - the group number
+ * @return -1 - if the pattern doesn't have the group
+ */
+static int cfGroupNum( struct preg_re_s *re , UDF_ARGS *args )
+{
+    char *name ;                /* named group */
+    int groupnum ;
+
+    if( !args->args[1] )
+        return -1 ;
+
+    if( args->arg_type[1] == INT_RESULT )
+        groupnum = (int)(*(longlong *)args->args[1]) ;
+    else
+    {
+        name = ghargdup( args , 1 ) ;
+        if( !name )
+            return -1 ;
+        groupnum = pregEngineGroupNumber( re , name ) ;
+        free( name ) ;
+    }
+
+    if( groupnum < 0 || groupnum > pregEngineCaptureCount( re ) )
+        return -1 ;
+
+    return groupnum ;
+}
+
+/**
+ * @fn static int cfNeedByte( pcre *re , int what , unsigned long options )
+ *
+ * @brief get a byte that must be in any subject the pattern matches
+ *
+ * @param re - the pcre code of the pattern, or NULL if another engine 
+ * compiled it
+ * @param what - PCRE_INFO_FIRSTBYTE or PCRE_INFO_LASTLITERAL
+ * @param options - the pattern's options (PCRE_INFO_OPTIONS)
+ *
+ * @return - the byte, in lower case if it is a letter
+ * @return -1 - if there isn't one that can be used
+ *
+ * @details pcre doesn't say if the byte is caseless, so letters are 
+ * looked up without (ascii) case.  Only ascii bytes are used: in utf-8 mode, 
+ * caseless letters can also match some multi-byte characters (such as 
+ * the kelvin sign for k), so letters aren't used at all.
+ */
+static int cfNeedByte( pcre *re , int what , unsigned long options )
+{
+    int c ;
+
+    if( !re || pcre_fullinfo( re , NULL , what , &c ) < 0 || 
+        c < 0 || c > 127 )
+        return -1 ;
+
+    if( (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') )
+    {
+        if( options & PCRE_UTF8 )
+            return -1 ;
+        c |= 0x20 ;
+    }
+
+    return c ;
+}
+
+/**
+ * @fn static int cfPrepare( struct preg_cf_pattern_s *pat , 
+ *                           struct preg_re_s *re , 
+ *                           UDF_ARGS *args , int with_group , 
+ *                           char *msg , int msglen )
+ *
+ * @brief make what is needed to try a compiled pattern
+ *
+ * @param with_group - find the group number too (if the group is constant)
+ *
+ * @return 0 - on success
+ * @return 1 - if the offsets vector can't be made
+ */
+static int cfPrepare( struct preg_cf_pattern_s *pat , struct preg_re_s *re , 
+                      UDF_ARGS *args , int with_group , 
+                      char *msg , int msglen )
+{
+    pcre *code = pregEnginePcre( re ) ;
+    unsigned long options = 0 ;
+
+    pat->ovector = pregCreateOffsetsVector( re , NULL , &pat->oveccount , 
+                                            msg , msglen ) ;
+    if( !pat->ovector )
+        return 1 ;
+
+    if( with_group )
+        pat->groupnum = cfGroupNum( re , args ) ;
+
+    if( code )
+        pcre_fullinfo( code , NULL , PCRE_INFO_OPTIONS , &options ) ;
+    pat->need[0] = cfNeedByte( code , PCRE_INFO_FIRSTBYTE , options ) ;
+    pat->need[1] = cfNeedByte( code , PCRE_INFO_LASTLITERAL , options ) ;
+
+    return 0 ;
+}
+
+/**
+ * @fn static int cfCanMatch( struct preg_cf_pattern_s *pat , 
+ *                            const char *subject , int subject_len , 
+ *                            unsigned char *seen , int *have_seen )
+ *
+ * @brief check the bytes a pattern needs against the bytes in the subject
+ *
+ * @param seen - bitmap of the bytes in the subject, letters in lower case
+ * @param have_seen - has seen been filled in for this row?
+ *
+ * @return 1 - if the pattern might match
+ * @return 0 - if it can't
+ */
+static int cfCanMatch( struct preg_cf_pattern_s *pat , 
+                       const char *subject , int subject_len , 
+                       unsigned char *seen , int *have_seen )
+{
+    int i , c ;
+
+    if( pat->need[0] < 0 && pat->need[1] < 0 )
+        return 1 ;
+
+    if( !*have_seen )
+    {
+        memset( seen , 0 , 32 ) ;
+        for( i = 0 ; i < subject_len ; i++ )
+        {
+            c = (unsigned char)subject[i] ;
+            if( c >= 'A' && c <= 'Z' )
+                c |= 0x20 ;
+            seen[ c >> 3 ] |= 1 << (c & 7) ;
+        }
+        *have_seen = 1 ;
+    }
+
+    for( i = 0 ; i < 2 ; i++ )
+    {
+        c = pat->need[i] ;
+        if( c >= 0 && !(seen[ c >> 3 ] & (1 << (c & 7))) )
+            return 0 ;
+    }
+
+    return 1 ;
+}
+
+/**
+ * @fn static void cfFreePattern( struct preg_cf_pattern_s *pat , 
+ *                               struct preg_re_s *re )
+ *
+ * @brief free what was made by cfPrepare, and the compiled pattern
+ */
+static void cfFreePattern( struct preg_cf_pattern_s *pat , 
+                           struct preg_re_s *re )
+{
+    free( pat->ovector ) ;
+    pat->ovector = NULL ;
+    if( re )
+        pregEngineFree( re ) ;
+}
+
+/**
+ * @fn static int cfInitPatterns( struct preg_cf_s *cf , UDF_ARGS *args , 
+ *                                char *message , const char *name )
+ *
+ * @brief compile the constant patterns after the first, and prepare them
+ * all
+ *
+ * @return 0 - on success
+ * @return 1 - on error, with the reason in message
+ */
+static int cfInitPatterns( struct preg_cf_s *cf , UDF_ARGS *args , 
+                           char *message , const char *name )
+{
+    struct preg_cf_pattern_s *pat ;
+    struct preg_re_s *re ;
+    int i ;
+
+    cf->constant_group = args->args[1] != NULL ;
+    cf->npatterns = args->arg_count - 2 ;
+    cf->patterns = calloc( cf->npatterns , sizeof( struct preg_cf_pattern_s ));
+    if( !cf->patterns )
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , "%s: out of memory" , name ) ;
+        return 1 ;
+    }
+
+    for( i = 0 ; i < cf->npatterns ; i++ )
+    {
+        pat = &cf->patterns[i] ;
+        pat->groupnum = -1 ;
+        if( ghargIsNullConstant( args , i + 2 ) )
+        {
+            pat->is_null = 1 ;
+            continue ;
+        }
+        if( !args->args[i + 2] )
+            continue ;
+
+        // the first pattern stays in cf->preg.re, and is freed with it
+        if( i == 0 )
+            re = cf->preg.re ;
+        else
+        {
+            re = pregCompileRegexArgNum( args , i + 2 , message , 
+                                         MYSQL_ERRMSG_SIZE ) ;
+            if( !re )
+                return 1 ;
+            cf->preg.stats.compiles++ ;
+        }
+        pat->re = re ;
+
+        if( cfPrepare( pat , re , args , cf->constant_group , message , 
+                       MYSQL_ERRMSG_SIZE ) )
+            return 1 ;
+    }
+
+    return 0 ;
+}
+
+/**
+ * @fn static bool cfInit( UDF_INIT *initid , UDF_ARGS *args , 
+ *                         char *message , const char *name )
+ *
+ * @brief the per-query initializations shared by the PREG_CAPTURE_FIRST 
+ * udfs
+ *
+ * @details pregInitInline compiles the first pattern (and keeps the start 
+ * of it for the statement summary), and the other constant patterns are 
+ * compiled here.  They are all compiled in this thread, since the init
+ * checks each of them for the group.
+ */
+static bool cfInit( UDF_INIT *initid , UDF_ARGS *args , 
+                    char *message , const char *name )
+{
+    enum Item_result group_type ;
+    int i ;
+
+    if( args->arg_count < 3 )
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , 
+                  "%s: needs a subject, a group and at least one pattern" , 
+                  name ) ;
+        return 1;
+    }
+
+    // the group is a number or a name.  pregInitInline makes the first 2 
+    // arguments strings, so it is put back.
+    group_type = args->arg_type[1] == INT_RESULT ? INT_RESULT : STRING_RESULT ;
+    for( i = 2 ; i < (int)args->arg_count ; i++ )
+        args->arg_type[i] = STRING_RESULT ;
+
+    initid->maybe_null=1;	
+
+    if( pregInitInline( initid , args , message , 2 , cfCompileFirst , 
+                        sizeof( struct preg_cf_s ) ) )
+        return 1 ;
+    args->arg_type[1] = group_type ;
+
+    if( cfInitPatterns( (struct preg_cf_s *)initid->ptr , args , 
+                        message , name ) )
+    {
+        // mysql doesn't call _deinit when _init fails
+        preg_capture_first_deinit( initid ) ;
+        return 1 ;
+    }
+
+    return 0 ;
+}
+
+/**
+ * @fn static int cfMatch( UDF_INIT *initid , UDF_ARGS *args , 
+ *                         const char *name , const char **match , 
+ *                         int *match_len , char *error )
+ *
+ * @brief try the patterns in order until one matches and sets the group
+ *
+ * @param initid - the udf's initid
+ * @param args - the udf's args
+ * @param name - the udf's name for error messages
+ * @param match - set to the start of the group in the subject
+ * @param match_len - set to the length of the group
+ * @param error - set if a pattern doesn't compile or pcre_exec fails
+ *
+ * @return - the position of the pattern in the list, starting from 1
+ * @return 0 - if no pattern matches and sets the group
+ * @return -1 - on error
+ */
+static int cfMatch( UDF_INIT *initid , UDF_ARGS *args , const char *name , 
+                    const char **match , int *match_len , char *error )
+{
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_cf_s *cf ;      /* local holder of initid->ptr */
+    struct preg_s *ptr ;        /* cf->preg */
+    struct preg_cf_pattern_s *pat ;
+    struct preg_cf_pattern_s row_pat ; /* a pattern that isn't constant */
+    struct preg_re_s *re ;
+    struct preg_re_s *row_re ;  /* compiled for this row, to be freed */
+    pcre_extra extra ;
+    const char *subject ;       /* args[0] */
+    int subject_len ;           /* length of subject */
+    unsigned char seen[32] ;    /* bytes in the subject */
+    int have_seen = 0 ;         /* has seen been filled in? */
+    int groupnum ;              /* group to capture */
+    int found = 0 ;             /* pattern that matched */
+    int rc ;                    /* return from pcre_exec */
+    int i ;
+
+    cf = (struct preg_cf_s *) initid->ptr ;
+    ptr = &cf->preg ;
+    ptr->stats.rows++ ;
+
+    subject = args->args[0] ;
+    subject_len = (int)args->lengths[0] ;
+    if( !subject || !args->args[1] )
+        return 0 ;
+
+    memset(&extra, 0, sizeof(extra));
+    pregSetLimits(&extra);
+
+    for( i = 0 ; i < cf->npatterns && !found ; i++ )
+    {
+        pat = &cf->patterns[i] ;
+        row_re = NULL ;
+        if( pat->is_null )
+            continue ;
+
+        if( pat->re )
+        {
+            re = pat->re ;
+            groupnum = cf->constant_group ? pat->groupnum : 
+                cfGroupNum( re , args ) ;
+        }
+        else
+        {
+            if( !args->args[i + 2] )
+                continue ;
+
+            row_re = re = pregCompileRegexArgNum( args , i + 2 , msg , 
+                                                  sizeof(msg) ) ;
+            if( !re )
+            {
+                ghlogprintf( "%s: compile failed: %s\n", name , msg );
+                *error = 1 ;
+                return -1 ;
+            }
+            ptr->stats.compiles++ ;
+
+            memset( &row_pat , 0 , sizeof(row_pat) ) ;
+            pat = &row_pat ;
+            if( cfPrepare( pat , re , args , 1 , msg , sizeof(msg) ) )
+            {
+                ghlogprintf( "%s: can't create offset vector :%s\n", 
+                             name , msg );
+                *error = 1 ;
+                cfFreePattern( pat , row_re ) ;
+                return -1 ;
+            }
+            groupnum = pat->groupnum ;
+        }
+
+        if( groupnum >= 0 && 
+            cfCanMatch( pat , subject , subject_len , seen , &have_seen ) )
+        {
+            rc = pregExec( ptr , re , &extra , subject , subject_len , 0 , 0 ,
+                           pat->ovector , pat->oveccount ) ;
+            if( rc < 0 && rc != PCRE_ERROR_NOMATCH )
+            {
+                ghlogprintf( "%s: pcre_exec returned error %d (%s)\n", 
+                             name , rc , pregExecErrorString(rc) ) ;
+                *error = 1 ;
+            }
+            else if( rc > groupnum && pat->ovector[ 2 * groupnum ] >= 0 )
+            {
+                found = i + 1 ;
+                *match = subject + pat->ovector[ 2 * groupnum ] ;
+                *match_len = pat->ovector[ 2 * groupnum + 1 ] - 
+                    pat->ovector[ 2 * groupnum ] ;
+            }
+        }
+
+        if( row_re )
+            cfFreePattern( pat , row_re ) ;
+        if( *error )
+            return -1 ;
+    }
+
+    return found ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_capture_first_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                  char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_CAPTURE_FIRST
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_capture_first_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return cfInit( initid , args , message , "PREG_CAPTURE_FIRST" ) ;
+}
+
+/**
+ * @fn char *preg_capture_first( UDF_INIT *initid , UDF_ARGS *args, 
+ *                               char *result, unsigned long *length, 
+ *                               char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_CAPTURE_FIRST udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used.  The capture is returned in place.
+ * @param length - set to the length of the capture
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the group from the first pattern that matches and sets it
+ * @return - NULL - if there isn't one
+ */
+char *preg_capture_first( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                          unsigned long *length, char *is_null, char *error )
+{
+    const char *match ;         /* the capture */
+    int match_len ;             /* length of match */
+
+    *is_null = 1 ;
+    *error = 0 ;
+    *length = 0 ;
+
+    if( cfMatch( initid , args , "PREG_CAPTURE_FIRST" , &match , &match_len ,
+                 error ) <= 0 )
+        return NULL ;
+
+    *is_null = 0 ;
+    *length = match_len ;
+    return (char *)match ;
+}
+
+/** 
+ * @fn void preg_capture_first_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_CAPTURE_FIRST 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ *
+ * @details The first pattern is freed by pregDeInit.
+ */
+void preg_capture_first_deinit(UDF_INIT *initid)
+{
+    struct preg_cf_s *cf ;      /* local holder of initid->ptr */
+    int i ;
+
+    cf = (struct preg_cf_s *) initid->ptr ;
+    if( cf && cf->patterns )
+    {
+        for( i = 0 ; i < cf->npatterns ; i++ )
+            cfFreePattern( &cf->patterns[i] , 
+                           i ? cf->patterns[i].re : NULL ) ;
+        free( cf->patterns ) ;
+    }
+
+    pregDeInit(initid);
+}
+
+
+/**
+ * @fn bool preg_capture_first_index_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                        char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_CAPTURE_FIRST_INDEX
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_capture_first_index_init(UDF_INIT *initid, UDF_ARGS *args, 
+                                   char *message)
+{
+    return cfInit( initid , args , message , "PREG_CAPTURE_FIRST_INDEX" ) ;
+}
+
+/**
+ * @fn longlong preg_capture_first_index( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                        char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_CAPTURE_FIRST_INDEX udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - position of the first pattern that matches and sets the group
+ */
+longlong preg_capture_first_index( UDF_INIT *initid , UDF_ARGS *args, 
+                                   char *is_null, char *error )
+{
+    const char *match ;         /* not used */
+    int match_len ;             /* not used */
+    int found ;
+
+    *is_null = 1 ;
+    *error = 0 ;
+
+    found = cfMatch( initid , args , "PREG_CAPTURE_FIRST_INDEX" , &match , 
+                     &match_len , error ) ;
+    if( found <= 0 )
+        return 0 ;
+
+    *is_null = 0 ;
+    return found ;
+}
+
+/** 
+ * @fn void preg_capture_first_index_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_CAPTURE_FIRST_INDEX 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_capture_first_index_deinit(UDF_INIT *initid)
+{
+    preg_capture_first_deinit( initid ) ;
+}
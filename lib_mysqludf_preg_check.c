@@ -118,7 +118,9 @@ void preg_check_deinit( UDF_INIT* initid );
  * @return 1 - on error
  *
  * @details This function checks to make sure there is 1 argument.  It
- * then call pregInit to perform the common initializations.
+ * doesn't call pregInit, since that compiles a constant pattern, and 
+ * reporting a bad pattern is what PREG_CHECK is for.  The pattern is 
+ * compiled by preg_check instead, and only the statistics are kept here.
  */
 bool preg_check_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
 {
@@ -128,8 +130,15 @@ bool preg_check_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
         return 1;
     }
     initid->maybe_null=0;	
+    args->arg_type[0] = STRING_RESULT ;
 
-    pregInit( initid , args , message );
+    // calloc'd, so pregDeInit finds nothing compiled or buffered
+    initid->ptr = (char *)calloc( 1 , sizeof( struct preg_s ) ) ;
+    if( !initid->ptr )
+    {
+        strncpy(message,"preg_check: not enough memory", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
 
     return 0;
 }
@@ -164,7 +173,7 @@ longlong preg_check( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
 {
     char msg [ 255 ] ;
     struct preg_s *ptr ;
-    pcre *re ;                  /* the compiled regex */
+    struct preg_re_s *re ;      /* the compiled regex */
 
 
 #ifndef GH_1_0_NULL_HANDLING
@@ -176,6 +185,8 @@ longlong preg_check( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
 #endif
 
     ptr = (struct preg_s *) initid->ptr ;
+    if( ptr )
+        ptr->stats.rows++ ;
     if( args->args[0] && args->lengths[0] )
     {
         re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
@@ -183,8 +194,10 @@ longlong preg_check( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
         {
             return 0;
         }
+        if( ptr )
+            ptr->stats.compiles++ ;
 
-        pcre_free( re ) ;
+        pregEngineFree( re ) ;
         return 1 ;
     }
 
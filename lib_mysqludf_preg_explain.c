@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_explain.c
+ *
+ * @brief Implements the PREG_EXPLAIN mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_EXPLAIN  PREG_EXPLAIN
+ *
+ * @brief show the pattern that is actually compiled for a pcre pattern
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_explain RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_EXPLAIN( pattern )
+ * 
+ * @par
+ *     @param pattern - is a string that is a perl compatible regular 
+ * expression as documented at:
+ * http://us.php.net/manual/en/ref.pcre.php This expression passed to
+ * this function should have delimiters and can contain the standard
+ * perl modifiers after the ending delimiter.
+ *
+ *     @return - string - the pattern that is given to pcre_compile, with /
+ * delimiters and the modifiers that were used.  The modifier of the 
+ * engine that runs the pattern is added if it isn't pcre.
+ *     @return - NULL - if pattern is NULL
+ *
+ * @details
+ *    preg_explain is a udf that shows what the other functions will
+ * compile for a pattern.  This is mostly useful with the O modifier, 
+ * which has the pattern rewritten into a form that is faster to match 
+ * (but matches the same things at the same places with the same 
+ * captures) before it is compiled.  The rewrites factor alternations of
+ * literals that share prefixes (/foobar|foobaz/ becomes /foo(?>ba[rz])/),
+ * make greedy quantifiers possessive where giving back characters can't
+ * help (/\\d+-/ becomes /\\d++-/) and turn .*? before a final literal into
+ * a negated class (/<.*?>/ becomes /<[^>\\n]*+>/).  Patterns using 
+ * extended or ungreedy mode, inline options or \\Q...\\E are not rewritten.
+ *
+ * The returned pattern can be passed to the other functions without the
+ * O modifier.
+ *
+ * Patterns that are run by a cheaper engine than pcre get its modifier, 
+ * so /timeout/i becomes /timeout/iL (see the Engines section of the 
+ * README).  A modifier that forces an engine is kept.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_EXPLAIN('/foobar|foobaz|fooqux/O' );
+ *
+ * @b Yields:
+ * @verbatim
++-------------------------------------------+
+| PREG_EXPLAIN('/foobar|foobaz|fooqux/O' )  |
++-------------------------------------------+
+| /foo(?>ba[rz]|qux)/                       |
++-------------------------------------------+
+@endverbatim
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "ghfcns.h"
+#include "preg_optimize.h"
+
+
+/*
+ * Public function declarations:
+ */
+bool preg_explain_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_explain( UDF_INIT *initid __attribute__((unused)),
+                    UDF_ARGS *args, char *result, unsigned long *length,
+                    char *is_null __attribute__((unused)),
+                    char *error __attribute__((unused)));
+void preg_explain_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private functions:
+ */
+
+/**
+ * @fn static char *explainPattern( UDF_ARGS *args , int *l , 
+ *                                  char *msg , int msglen )
+ *
+ * @brief build the explanation of the pattern in args[0]
+ *
+ * @param args - the args supplied by mysql udf api
+ * @param l - put the length of the explanation here
+ * @param msg - buffer where error messages can be placed
+ * @param msglen - size of the error message buffer above
+ *
+ * @return - the explanation.  It must be free'd by the caller.
+ * @return - NULL - on error
+ *
+ * @details This repeats what compileRegex does: the optimized pattern
+ * is used if the O modifier is given and it compiles, and the engine is
+ * chosen for the pattern that is used.  The pattern should already be 
+ * known to be valid.
+ */
+static char *explainPattern( UDF_ARGS *args , int *l , char *msg , int msglen )
+{
+    const char *error ;         /* from pcre_compile */
+    int erroffset ;             /* from pcre_compile */
+    int coptions ;              /* pcre_compile options from the modifiers */
+    int do_study ;              /* was S given? */
+    int do_optimize ;           /* was O given? */
+    char *optimized ;           /* the optimized pattern */
+    char *pattern ;             /* the pattern without delimiters */
+    char *p ;
+    struct preg_re_s *re ;      /* to test the optimized pattern */
+    const struct preg_engine_s *forced ; /* engine from a modifier */
+    const struct preg_engine_s *engine ; /* engine that runs the pattern */
+    char *s ;                   /* the explanation */
+    char *val ;                 /* null terminated copy of the argument */
+
+    val = ghargdup( args , 0 ) ;
+    if( !val )
+    {
+        strncpy( msg , "Out of memory" , msglen ) ;
+        return NULL ;
+    }
+
+    pattern = parseRegex( val , &coptions , &do_study , &do_optimize , 
+                          &forced , msg , msglen ) ;
+    free( val ) ;
+    if( !pattern )
+        return NULL ;
+
+    if( do_optimize && (optimized = pregOptimizePattern( pattern , coptions )) )
+    {
+        re = pregEngineCompile( optimized , coptions , forced , 
+                                &error , &erroffset ) ;
+        if( re )
+        {
+            pregEngineFree( re ) ;
+            free( pattern ) ;
+            pattern = optimized ;
+        }
+        else
+            free( optimized ) ;
+    }
+
+    // Every character could need escaping, plus delimiters and modifiers
+    s = malloc( strlen( pattern ) * 2 + 16 ) ;
+    if( !s )
+    {
+        strncpy( msg , "Out of memory" , msglen ) ;
+        free( pattern ) ;
+        return NULL ;
+    }
+
+    *l = 0 ;
+    s[ (*l)++ ] = '/' ;
+    for( p = pattern ; *p ; p++ )
+    {
+        if( *p == '\\' && p[1] )
+        {
+            s[ (*l)++ ] = *p++ ;
+        }
+        else if( *p == '/' )
+        {
+            s[ (*l)++ ] = '\\' ;
+        }
+        s[ (*l)++ ] = *p ;
+    }
+    s[ (*l)++ ] = '/' ;
+    engine = forced ? forced : pregEngineChoose( pattern , coptions ) ;
+    free( pattern ) ;
+
+    if( coptions & PCRE_CASELESS )       s[ (*l)++ ] = 'i' ;
+    if( coptions & PCRE_MULTILINE )      s[ (*l)++ ] = 'm' ;
+    if( coptions & PCRE_DOTALL )         s[ (*l)++ ] = 's' ;
+    if( coptions & PCRE_EXTENDED )       s[ (*l)++ ] = 'x' ;
+    if( coptions & PCRE_ANCHORED )       s[ (*l)++ ] = 'A' ;
+    if( coptions & PCRE_DOLLAR_ENDONLY ) s[ (*l)++ ] = 'D' ;
+    if( do_study )                       s[ (*l)++ ] = 'S' ;
+    if( coptions & PCRE_UNGREEDY )       s[ (*l)++ ] = 'U' ;
+    if( coptions & PCRE_EXTRA )          s[ (*l)++ ] = 'X' ;
+    if( coptions & PCRE_UTF8 )           s[ (*l)++ ] = 'u' ;
+    if( forced || engine != &preg_engine_pcre ) 
+        s[ (*l)++ ] = engine->modifier ;
+    s[ *l ] = '\0' ;
+
+    return s ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_explain_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                            char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_EXPLAIN
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks that there is 1 argument and then
+ * calls pregInit, which checks constant patterns by compiling them.
+ */
+bool preg_explain_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    if (args->arg_count != 1)
+    {
+        strncpy(message,"PREG_EXPLAIN: needs exactly one argument", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    initid->maybe_null=1;	
+
+    return ( pregInit( initid , args , message ) ) ;
+}
+
+
+/**
+ * @fn char *preg_explain(UDF_INIT *initid , UDF_ARGS *args, char *result, 
+ *                        unsigned long *length, char *is_null , char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_EXPLAIN udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - small place that the result could be placed (not used)
+ * @param length - put the length of the result here.
+ * @param is_null - set this if return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the pattern that is compiled
+ * @return - NULL - if the pattern is NULL or some other problem
+ */
+char *preg_explain(UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                   unsigned long *length, char *is_null , char *error )
+{
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    struct preg_re_s *re ;      /* the compiled pattern */
+    char *s ;                   /* the explanation */
+    int l = 0 ;                 /* length of s */
+
+    ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
+
+    *is_null = 1 ;
+    *error = 0 ;
+    *length = 0 ;
+
+    if( !args->args[0] )
+        return NULL ;
+
+    // non-constant patterns haven't been checked yet
+    if( !ptr->constant_pattern )
+    {
+        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
+        if( !re )
+        {
+            ghlogprintf( "PREG_EXPLAIN: compile failed: %s\n", msg );
+            *error = 1 ;
+            return NULL ;
+        }
+        ptr->stats.compiles++ ;
+        pregEngineFree( re ) ;
+    }
+    else if( !pregConstantRe( ptr , error ) )
+        return NULL ;   // a background compile failed
+
+    s = explainPattern( args , &l , msg , sizeof(msg) ) ;
+    if( !s )
+    {
+        ghlogprintf( "PREG_EXPLAIN: %s\n", msg );
+        *error = 1 ;
+        return NULL ;
+    }
+
+    return pregMoveToReturnValues( initid , length , is_null , error , s , l );
+}
+
+
+/**
+ * @fn void preg_explain_deinit(UDF_INIT *initid)
+ *
+ * @brief cleanup function for PREG_EXPLAIN
+ *
+ * @param initid - pointer to struct to be cleaned.
+ */
+void preg_explain_deinit( UDF_INIT* initid )
+{
+    pregDeInit( initid ) ;
+}
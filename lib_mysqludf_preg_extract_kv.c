@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_extract_kv.c
+ *
+ * @brief Implements the PREG_EXTRACT_KV mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_EXTRACT_KV  PREG_EXTRACT_KV
+ *
+ * @brief extract key=value pairs from text (such as logfmt log lines) as JSON
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_extract_kv RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_EXTRACT_KV( subject [, pair_pattern [, keys]] )
+ * 
+ * @par
+ *     @param subject - is the text with the key/value pairs
+ *
+ *     @param pair_pattern - optional perl compatible regular expression 
+ * with delimiters that matches one pair.  The key is the group named 
+ * 'key' (or else group 1) and the value is the group named 'value' (or 
+ * else group 2).  If it is missing or NULL, logfmt style pairs are 
+ * matched: key=value or key="quoted value", where the key starts after 
+ * whitespace or at the start of the subject.
+ *
+ *     @param keys - optional comma separated list of the keys to return.  
+ * If it is missing or NULL, all keys are returned.
+ *
+ *     @return - string - a JSON object with the pairs.  Values in double 
+ * quotes have the quotes removed, and a backslash in them escapes the 
+ * next character.  Values whose group didn't take part in a match are 
+ * null.
+ *     @return - NULL - if subject is NULL
+ *
+ * @details
+ *    preg_extract_kv is a udf that gets all of the fields of a line in a 
+ * single pass, where separate PREG_CAPTURE calls would scan the line once 
+ * for each field.  The pairs are matched one after the other and written
+ * straight into the JSON result.  Without keys, every pair is returned in 
+ * the order it appears, so a repeated key appears more than once.  With 
+ * keys, only the first pair for each listed key is returned, and the scan
+ * stops as soon as all of them have been found.  The keys are put in a 
+ * hash set once per query when they are constant.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_EXTRACT_KV('level=info msg="disk full" took=12ms');
+ *
+ * @b Yields:
+ * @verbatim
+{"level":"info","msg":"disk full","took":"12ms"}
+@endverbatim
+ *
+ * SELECT PREG_EXTRACT_KV( line , NULL , 'user,status' ) FROM log;
+ *
+ * SELECT PREG_EXTRACT_KV('a: 1; b: 2' , '/(\\w+):\\s*([^;]*)/');
+ *
+ * @b Yields:
+ * @verbatim
+{"a":"1","b":"2"}
+@endverbatim
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "preg_utils.h"
+#include "ghfcns.h"
+
+/*
+ * The default pair pattern (logfmt).
+ */
+#define PREG_KV_DEFAULT_PATTERN \
+    "/(?<!\\S)([^\\s=]+)=(\"(?:[^\"\\\\]|\\\\.)*\"|\\S*)/"
+
+/*
+ * An entry in the hash set of keys to return.  s is NULL for empty slots.
+ */
+struct preg_kv_key_s {
+    const char *s ;             /* the key (in key_text) */
+    int l ;                     /* length of the key */
+    unsigned int hash ;
+};
+
+/*
+ * What PREG_EXTRACT_KV keeps in initid->ptr.
+ */
+struct preg_kv_s {
+    struct preg_s preg ;        /* must be first.  See pregInitWith */
+    int key_group ;             /* capture group with the key */
+    int value_group ;           /* capture group with the value */
+    int *ovector ;              /* for a constant pattern */
+    int oveccount ;             /* size of ovector */
+    int constant_keys ;         /* were the keys built at init? */
+    char *key_text ;            /* copy of the keys argument */
+    struct preg_kv_key_s *keys ; /* hash set of keys.  NULL for all keys */
+    int nslots ;                /* size of keys (a power of 2) */
+    int nkeys ;                 /* number of keys in the set */
+    char *seen ;                /* for each slot, was the key found yet? */
+};
+
+/*
+ * Public function declarations:
+ */
+bool preg_extract_kv_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_extract_kv( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                       unsigned long *length, char *is_null, char *error );
+void preg_extract_kv_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private function definitions:
+ */
+
+/**
+ * @fn static unsigned int kvHash( const char *s , int l )
+ *
+ * @brief FNV-1a hash of a key
+ */
+static unsigned int kvHash( const char *s , int l )
+{
+    unsigned int h = 2166136261U ;
+
+    while( l-- )
+    {
+        h ^= (unsigned char)*s++ ;
+        h *= 16777619U ;
+    }
+    return h ;
+}
+
+/**
+ * @fn static int kvLookup( struct preg_kv_s *kv , const char *s , int l )
+ *
+ * @brief find a key in the hash set
+ *
+ * @return - the slot of the key - if found
+ * @return - -1 - if not
+ */
+static int kvLookup( struct preg_kv_s *kv , const char *s , int l )
+{
+    unsigned int h ;
+    int i ;
+
+    h = kvHash( s , l ) ;
+    for( i = h & (kv->nslots - 1) ; kv->keys[i].s ; 
+         i = (i + 1) & (kv->nslots - 1) )
+    {
+        if( kv->keys[i].hash == h && kv->keys[i].l == l && 
+            !memcmp( kv->keys[i].s , s , l ) )
+            return i ;
+    }
+    return -1 ;
+}
+
+/**
+ * @fn static void kvFreeKeys( struct preg_kv_s *kv )
+ *
+ * @brief free the hash set of keys
+ */
+static void kvFreeKeys( struct preg_kv_s *kv )
+{
+    free( kv->key_text ) ;
+    free( kv->keys ) ;
+    free( kv->seen ) ;
+    kv->key_text = NULL ;
+    kv->keys = NULL ;
+    kv->seen = NULL ;
+    kv->nkeys = 0 ;
+}
+
+/**
+ * @fn static int kvBuildKeys( struct preg_kv_s *kv , const char *s , 
+ *                             unsigned long l )
+ *
+ * @brief build the hash set from a comma separated list of keys
+ *
+ * @param kv - the info stored in initid->ptr
+ * @param s - the list.  NULL means all keys.
+ * @param l - length of s
+ *
+ * @return 0 - on success
+ * @return -1 - if out of memory
+ *
+ * @details Spaces around the keys are ignored, as are empty keys.  The 
+ * set is kept at most half full so that probe sequences stay short.
+ */
+static int kvBuildKeys( struct preg_kv_s *kv , const char *s , 
+                        unsigned long l )
+{
+    char *p , *end , *k ;       /* walk key_text */
+    int n = 1 ;                 /* upper bound on the number of keys */
+    int kl , i ;
+    unsigned long j ;
+
+    kvFreeKeys( kv ) ;
+    if( !s )
+        return 0 ;
+
+    for( j = 0 ; j < l ; j++ )
+    {
+        if( s[j] == ',' )
+            n++ ;
+    }
+    for( kv->nslots = 8 ; kv->nslots < n * 2 ; kv->nslots *= 2 )
+        ;
+
+    kv->key_text = malloc( l + 1 ) ;
+    kv->keys = calloc( kv->nslots , sizeof( struct preg_kv_key_s ) ) ;
+    kv->seen = malloc( kv->nslots ) ;
+    if( !kv->key_text || !kv->keys || !kv->seen )
+    {
+        kvFreeKeys( kv ) ;
+        return -1 ;
+    }
+    memcpy( kv->key_text , s , l ) ;
+    kv->key_text[l] = '\0' ;
+
+    for( p = kv->key_text , end = p + l ; p <= end ; p = k + 1 )
+    {
+        k = memchr( p , ',' , end - p ) ;
+        if( !k )
+            k = end ;
+
+        while( p < k && isspace( (unsigned char)*p ) )
+            p++ ;
+        for( kl = k - p ; kl && isspace( (unsigned char)p[kl-1] ) ; kl-- )
+            ;
+
+        if( !kl || kvLookup( kv , p , kl ) >= 0 )
+            continue ;
+
+        kv->nkeys++ ;
+        for( i = kvHash( p , kl ) & (kv->nslots - 1) ; kv->keys[i].s ; 
+             i = (i + 1) & (kv->nslots - 1) )
+            ;
+        kv->keys[i].s = p ;
+        kv->keys[i].l = kl ;
+        kv->keys[i].hash = kvHash( p , kl ) ;
+    }
+
+    return 0 ;
+}
+
+/**
+ * @fn static struct preg_re_s *kvCompileArg( UDF_ARGS *args , char *msg , int msglen )
+ *
+ * @brief compile the pair pattern, or the default pattern if there isn't
+ * one
+ */
+static struct preg_re_s *kvCompileArg( UDF_ARGS *args , char *msg , int msglen )
+{
+    if( args->arg_count < 2 || !args->args[1] )
+        return compileRegex( PREG_KV_DEFAULT_PATTERN , 
+                             strlen( PREG_KV_DEFAULT_PATTERN ) , msg , msglen );
+
+    return pregCompileRegexArgNum( args , 1 , msg , msglen ) ;
+}
+
+/**
+ * @fn static int kvGroups( struct preg_re_s *re , int *key_group , int *value_group , 
+ *                          char *msg , int msglen )
+ *
+ * @brief find the key and value capture groups of a pair pattern
+ *
+ * @return 0 - on success
+ * @return -1 - if the pattern has fewer than 2 capture groups
+ */
+static int kvGroups( struct preg_re_s *re , int *key_group , 
+                     int *value_group , char *msg , int msglen )
+{
+    if( pregEngineCaptureCount( re ) < 2 )
+    {
+        strncpy( msg , "PREG_EXTRACT_KV: pair_pattern needs a key and a value group" , msglen ) ;
+        return -1 ;
+    }
+
+    *key_group = pregEngineGroupNumber( re , "key" ) ;
+    if( *key_group < 0 )
+        *key_group = 1 ;
+    *value_group = pregEngineGroupNumber( re , "value" ) ;
+    if( *value_group < 0 )
+        *value_group = 2 ;
+
+    return 0 ;
+}
+
+/**
+ * @fn static int kvValue( char *dst , const char *s , int l )
+ *
+ * @brief write a value as a JSON string
+ *
+ * @param dst - where to write.  NULL to only get the length.
+ * @param s - the value as matched
+ * @param l - length of s
+ *
+ * @return - the number of bytes written (or that would be written)
+ *
+ * @details A value in double quotes has the quotes removed, and a 
+ * backslash in it escapes the next character.
+ */
+static int kvValue( char *dst , const char *s , int l )
+{
+    int n = 2 ;                 /* the quotes */
+    int i , start ;
+
+    if( l < 2 || s[0] != '"' || s[l-1] != '"' )
+    {
+        if( dst )
+            pregJsonString( dst , s , l ) ;
+        return pregJsonStringLength( s , l ) ;
+    }
+
+    s++ ;
+    l -= 2 ;
+    if( dst )
+        *dst++ = '"' ;
+
+    for( i = 0 ; i < l ; )
+    {
+        for( start = i ; i < l && s[i] != '\\' ; i++ )
+            ;
+        n += pregJsonEscapedLength( s + start , i - start ) ;
+        if( dst )
+            dst = pregJsonEscape( dst , s + start , i - start ) ;
+
+        if( i < l )
+        {
+            // skip the backslash unless it is the last character
+            if( i + 1 < l )
+                i++ ;
+            n += pregJsonEscapedLength( s + i , 1 ) ;
+            if( dst )
+                dst = pregJsonEscape( dst , s + i , 1 ) ;
+            i++ ;
+        }
+    }
+
+    if( dst )
+        *dst = '"' ;
+
+    return n ;
+}
+
+
+/**
+ * @fn static int kvInitConstants( struct preg_kv_s *kv , UDF_ARGS *args , 
+ *                                 char *message )
+ *
+ * @brief set up the groups and offset vector of a constant pattern, and 
+ * the hash set for constant keys
+ *
+ * @return 0 - on success
+ * @return 1 - on error, with the reason in message
+ */
+static int kvInitConstants( struct preg_kv_s *kv , UDF_ARGS *args , 
+                            char *message )
+{
+    if( kv->preg.constant_pattern && kv->preg.re )
+    {
+        if( kvGroups( kv->preg.re , &kv->key_group , &kv->value_group , 
+                      message , MYSQL_ERRMSG_SIZE ) )
+            return 1 ;
+
+        kv->ovector = pregCreateOffsetsVector( kv->preg.re , NULL , 
+                                               &kv->oveccount , message , 
+                                               MYSQL_ERRMSG_SIZE ) ;
+        if( !kv->ovector )
+            return 1 ;
+    }
+
+    if( args->arg_count < 3 || args->args[2] )
+    {
+        kv->constant_keys = 1 ;
+        if( args->arg_count > 2 && 
+            kvBuildKeys( kv , args->args[2] , args->lengths[2] ) )
+        {
+            strncpy(message,"PREG_EXTRACT_KV: out of memory", MYSQL_ERRMSG_SIZE);
+            return 1 ;
+        }
+    }
+
+    return 0 ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_extract_kv_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                               char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_EXTRACT_KV
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks the number of arguments and calls 
+ * pregInitInline, which compiles the pair pattern (the 2nd argument, or 
+ * the default) if it is constant.  It is compiled in this thread, since 
+ * its groups are checked here.  A constant pattern's groups and 
+ * offset vector, and the hash set for constant keys, are set up here 
+ * once for the whole query.
+ */
+bool preg_extract_kv_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    struct preg_kv_s *kv ;      /* local holder of initid->ptr */
+
+    if (args->arg_count < 1 || args->arg_count > 3)
+    {
+        strncpy(message,"PREG_EXTRACT_KV: requires 1 to 3 arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    if( args->arg_count > 2 )
+        args->arg_type[2] = STRING_RESULT ;
+
+    initid->maybe_null=1;	
+
+    if( pregInitInline( initid , args , message , 1 , kvCompileArg , 
+                        sizeof( struct preg_kv_s ) ) )
+        return 1 ;
+
+    kv = (struct preg_kv_s *)initid->ptr ;
+    if( kvInitConstants( kv , args , message ) )
+    {
+        // mysql doesn't call _deinit when _init fails
+        preg_extract_kv_deinit( initid ) ;
+        return 1 ;
+    }
+
+    return 0 ;
+}
+
+
+/**
+ * @fn char *preg_extract_kv( UDF_INIT *initid , UDF_ARGS *args, 
+ *                            char *result, unsigned long *length, 
+ *                            char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_EXTRACT_KV udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used.  ptr->return_buffer is returned instead.
+ * @param length - set to the length of the JSON returned
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the JSON object (in ptr->return_buffer)
+ * @return - NULL - if subject is NULL
+ *
+ * @details The pair pattern is matched repeatedly from the end of the 
+ * last match, like preg_replace does, and each pair is appended to the 
+ * return buffer as soon as it is found.  The buffer grows as needed.
+ */
+char *preg_extract_kv( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                       unsigned long *length, char *is_null, char *error )
+{
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_kv_s *kv ;      /* local holder of initid->ptr */
+    struct preg_s *ptr ;        /* &kv->preg */
+    struct preg_re_s *re ;      /* the compiled pattern */
+    pcre_extra extra ;
+    int *ovector ;              /* for use by pcre_exec */
+    int oveccount ;             /* size of ovector */
+    int key_group , value_group ;
+    int rc ;                    /* return from pcre_exec */
+    char *subject ;             /* args[0] */
+    int subject_len ;           /* length of subject */
+    int offset = 0 ;            /* where to look for the next pair */
+    int used = 0 ;              /* bytes of JSON written */
+    int remaining ;             /* listed keys not found yet */
+    int need ;                  /* bytes needed for the next pair */
+    int slot ;                  /* of the key in the hash set */
+    const char *k , *v ;        /* the key and value */
+    int kl , vl ;               /* lengths of the key and value */
+
+    kv = (struct preg_kv_s *) initid->ptr ;
+    ptr = &kv->preg ;
+    ptr->stats.rows++ ;
+
+    *is_null = 1 ;
+    *error = 0 ;
+    *length = 0 ;
+
+    subject = args->args[0] ;
+    subject_len = (int)args->lengths[0] ;
+    if( !subject )
+        return NULL ;
+
+    if( ptr->constant_pattern )
+    {
+        re = ptr->re ;
+        ovector = kv->ovector ;
+        oveccount = kv->oveccount ;
+        key_group = kv->key_group ;
+        value_group = kv->value_group ;
+    }
+    else
+    {
+        re = kvCompileArg( args , msg , sizeof(msg) ) ;
+        if( !re )
+        {
+            ghlogprintf( "PREG_EXTRACT_KV: compile failed: %s\n", msg );
+            *error = 1 ;
+            return NULL ;
+        }
+        ptr->stats.compiles++ ;
+
+        ovector = NULL ;
+        if( kvGroups( re , &key_group , &value_group , msg , sizeof(msg) ) || 
+            !(ovector = pregCreateOffsetsVector( re , NULL , &oveccount , 
+                                                 msg , sizeof(msg) )) )
+        {
+            ghlogprintf( "%s\n", msg );
+            *error = 1 ;
+            pregEngineFree( re ) ;
+            return NULL ;
+        }
+    }
+
+    if( !kv->constant_keys && 
+        kvBuildKeys( kv , args->args[2] , args->lengths[2] ) )
+    {
+        ghlogprintf( "PREG_EXTRACT_KV: out of memory\n" );
+        *error = 1 ;
+    }
+    remaining = kv->nkeys ;
+    if( kv->seen )
+        memset( kv->seen , 0 , kv->nslots ) ;
+
+    memset(&extra, 0, sizeof(extra));
+    pregSetLimits(&extra);
+
+    if( !*error && !pregGrowReturnBuffer( ptr , 1 ) )
+        ptr->return_buffer[ used++ ] = '{' ;
+    else
+        *error = 1 ;
+
+    // empty matches are not pairs.  pregExecNext steps past them.
+    while( !*error && offset <= subject_len && (!kv->keys || remaining) )
+    {
+        rc = pregExecNext( ptr , re , &extra , subject , subject_len , 
+                           &offset , ovector , oveccount ) ;
+        if( rc < 0 )
+        {
+            if( rc != PCRE_ERROR_NOMATCH )
+            {
+                ghlogprintf("PREG_EXTRACT_KV: pcre_exec returned error %d (%s)\n", 
+                            rc, pregExecErrorString(rc) ) ;
+                *error = 1 ;
+            }
+            break ;
+        }
+
+        if( key_group >= rc || ovector[ 2 * key_group ] < 0 )
+            continue ;
+        k = subject + ovector[ 2 * key_group ] ;
+        kl = ovector[ 2 * key_group + 1 ] - ovector[ 2 * key_group ] ;
+
+        if( kv->keys )
+        {
+            slot = kvLookup( kv , k , kl ) ;
+            if( slot < 0 || kv->seen[slot] )
+                continue ;
+            kv->seen[slot] = 1 ;
+            remaining-- ;
+        }
+
+        v = NULL ;
+        vl = 4 ;                // null
+        if( value_group < rc && ovector[ 2 * value_group ] >= 0 )
+        {
+            v = subject + ovector[ 2 * value_group ] ;
+            vl = ovector[ 2 * value_group + 1 ] - ovector[ 2 * value_group ] ;
+        }
+
+        // a comma, the key, a colon, the value and the closing brace
+        need = 1 + pregJsonStringLength( k , kl ) + 1 + 
+               (v ? kvValue( NULL , v , vl ) : vl) + 1 ;
+        if( pregGrowReturnBuffer( ptr , used + need ) )
+        {
+            *error = 1 ;
+            break ;
+        }
+
+        if( used > 1 )
+            ptr->return_buffer[ used++ ] = ',' ;
+        used = pregJsonString( ptr->return_buffer + used , k , kl ) - 
+               ptr->return_buffer ;
+        ptr->return_buffer[ used++ ] = ':' ;
+        if( v )
+            used += kvValue( ptr->return_buffer + used , v , vl ) ;
+        else
+        {
+            memcpy( ptr->return_buffer + used , "null" , 4 ) ;
+            used += 4 ;
+        }
+    }
+
+    if( !ptr->constant_pattern )
+    {
+        free( ovector ) ;
+        pregEngineFree( re ) ;
+    }
+
+    if( *error )
+        return NULL ;
+
+    // there is always room for this.  See need above.
+    ptr->return_buffer[ used++ ] = '}' ;
+    ptr->return_buffer[ used ] = '\0' ;
+
+    *is_null = 0 ;
+    *length = used ;
+    return ptr->return_buffer ;
+}
+
+/** 
+ * @fn void preg_extract_kv_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_EXTRACT_KV 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_extract_kv_deinit(UDF_INIT *initid)
+{
+    struct preg_kv_s *kv ;      /* local holder of initid->ptr */
+
+    kv = (struct preg_kv_s *) initid->ptr ;
+    if( kv )
+    {
+        kvFreeKeys( kv ) ;
+        free( kv->ovector ) ;
+    }
+
+    pregDeInit(initid);
+}
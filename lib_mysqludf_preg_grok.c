@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_grok.c
+ *
+ * @brief Implements the PREG_GROK and PREG_GROK_DEFINE mysql udfs
+ *
+ */
+
+
+/**
+ * @page PREG_GROK  PREG_GROK
+ *
+ * @brief return the named fields of a grok expression match as JSON
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_grok RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_GROK( pattern , subject )
+ * 
+ * @par
+ *     @param pattern - is a perl compatible regular expression with 
+ * delimiters and optional modifiers, which can contain grok references:
+ * %{NAME} is replaced by the definition of NAME and %{NAME:field} is 
+ * replaced by the definition of NAME captured as the group 'field'.  The
+ * G modifier, which turns on grok references for the other preg 
+ * functions, is implied.
+ *
+ *     @param subject - is the data to match
+ *
+ *     @return - string - a JSON object with each named group as a key and 
+ * the captured text (or null if the group didn't take part in the match) 
+ * as the value.  The keys are in alphabetical order.
+ *     @return - NULL - if the pattern doesn't match the subject
+ *
+ * @details
+ *    preg_grok is a udf for parsing log lines and other semi-structured 
+ * text.  The pattern is matched once, and all of the fields are returned 
+ * together.  The built-in library has the common grok base patterns 
+ * (WORD, INT, NUMBER, IPV4, IPV6, IP, HOSTNAME, IPORHOST, URIPATH, 
+ * URIPARAM, URI, TIMESTAMP_ISO8601, HTTPDATE, SYSLOGTIMESTAMP, LOGLEVEL, 
+ * QUOTEDSTRING, COMMONAPACHELOG, COMBINEDAPACHELOG, DATA, GREEDYDATA and 
+ * more), and more can be added with PREG_GROK_DEFINE.  Expanded patterns
+ * are compiled once and cached by pattern, so non-constant patterns are 
+ * only compiled the first time they are seen.  The type in a 
+ * %{NAME:field:type} reference is ignored, so all values are strings.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_GROK('/%{IPV4:client} %{WORD:method} %{URIPATH:path}/' , 
+ *                  '10.0.0.1 GET /index.html');
+ *
+ * @b Yields:
+ * @verbatim
+{"client":"10.0.0.1","method":"GET","path":"/index.html"}
+@endverbatim
+ *
+ * SELECT PREG_GROK('/^%{COMMONAPACHELOG}/' , line ) FROM access_log;
+ *
+ * Yields: clientip, ident, auth, timestamp, verb, request, httpversion, 
+ * rawrequest, response and bytes for every line
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ */
+
+
+/**
+ * @page PREG_GROK_DEFINE  PREG_GROK_DEFINE
+ *
+ * @brief add a definition to the grok pattern library
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_grok_define RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_GROK_DEFINE( name , definition )
+ * 
+ * @par
+ *     @param name - the name used in %{name} references.  It can only have
+ * letters, digits and underscores.
+ *
+ *     @param definition - a perl compatible regular expression WITHOUT
+ * delimiters or modifiers.  It can refer to other definitions.
+ *
+ *     @return - 1 - on success
+ *     @return - NULL - if either argument is NULL
+ *
+ * @details
+ *    preg_grok_define adds a definition, or replaces a user definition of
+ * the same name.  The built-in definitions can't be replaced, and naming 
+ * one is an error.
+ * The definition is checked by expanding and compiling it, and an error 
+ * is returned if that fails.  The expanded definition is kept, so 
+ * PREG_GROK_DEFINE('METHOD','%{METHOD}|PATCH') adds to the old METHOD.  
+ * Definitions are shared by all connections,
+ * and last until the library is unloaded (or the server restarts), so they
+ * are usually loaded from a table at startup.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_GROK_DEFINE('METHOD' , 'GET|POST|PUT|DELETE|HEAD');
+ *
+ * SELECT PREG_GROK_DEFINE( name , definition ) FROM grok_patterns;
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "preg_grok.h"
+#include "preg_utils.h"
+#include "ghfcns.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_grok_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_grok( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                 unsigned long *length, char *is_null, char *error );
+void preg_grok_deinit( UDF_INIT* initid );
+
+bool preg_grok_define_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_grok_define( UDF_INIT *initid , UDF_ARGS *args, 
+                           char *is_null, char *error );
+void preg_grok_define_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private function definitions:
+ */
+
+/**
+ * @fn static struct preg_re_s *grokCompileArg( UDF_ARGS *args , char *msg , int msglen )
+ *
+ * @brief get the compiled pattern for the first argument from the grok
+ * cache
+ *
+ * @details The G modifier is appended to the pattern, since PREG_GROK 
+ * always expands grok references.  Modifiers are the last thing in a 
+ * pattern, so this is always where it goes.
+ *
+ * @note
+ *    call pregGrokCacheRelease (not pregEngineFree) on the returned pattern
+ */
+static struct preg_re_s *grokCompileArg( UDF_ARGS *args , char *msg , int msglen )
+{
+    struct preg_re_s *re ;      /* the compiled pattern */
+    char *val ;                 /* pattern with G appended */
+
+    *msg = '\0' ;
+
+    if( !args->args[0] || !args->lengths[0] )
+    {
+        strncpy( msg , "Empty pattern" , msglen ) ;
+        return NULL ;
+    }
+
+    val = malloc( args->lengths[0] + 1 ) ;
+    if( !val )
+    {
+        strncpy( msg , "Out of memory" , msglen ) ;
+        return NULL ;
+    }
+    memcpy( val , args->args[0] , args->lengths[0] ) ;
+    val[ args->lengths[0] ] = 'G' ;
+
+    re = pregGrokCacheGet( val , args->lengths[0] + 1 , msg , msglen ) ;
+
+    free( val ) ;
+
+    return re ;
+}
+
+/**
+ * @fn static int grokGroupIsSet( int *ovector , int rc , int n )
+ *
+ * @brief did capture group n take part in the match?
+ */
+static int grokGroupIsSet( int *ovector , int rc , int n )
+{
+    return n < rc && ovector[ 2 * n ] >= 0 ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_grok_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_GROK
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks the number of arguments and calls 
+ * pregInitWith, so that a constant pattern comes from the grok cache.
+ */
+bool preg_grok_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    if (args->arg_count != 2)
+    {
+        strncpy(message,"PREG_GROK: needs exactly two arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    initid->maybe_null=1;	
+
+    return ( pregInitWith( initid , args , message , 0 , grokCompileArg , 
+                           sizeof( struct preg_s ) ) ) ;
+}
+
+
+/**
+ * @fn char *preg_grok( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+ *                      unsigned long *length, char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_GROK udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used.  ptr->return_buffer is returned instead.
+ * @param length - set to the length of the JSON returned
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the JSON object (in ptr->return_buffer)
+ * @return - NULL - if there is no match
+ *
+ * @details The subject is matched once.  The name table of the pattern 
+ * is walked twice: once to size the JSON and once to write it straight 
+ * into the return buffer.  pcre keeps the name table sorted by name, so 
+ * when (?J) allows duplicate names, the entries for one name are next to 
+ * each other and the first one that is set is used.
+ */
+char *preg_grok( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                 unsigned long *length, char *is_null, char *error )
+{
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    struct preg_re_s *re ;      /* the compiled pattern */
+    pcre *code ;                /* re's pcre code, for the name table */
+    pcre_extra extra ;
+    int *ovector ;              /* for use by pcre_exec */
+    int oveccount ;             /* size of ovector */
+    int rc ;                    /* return from pcre_exec */
+    int namecount = 0 ;         /* number of named groups */
+    int entrysize = 0 ;         /* size of a name table entry */
+    unsigned char *table = NULL ; /* the name table */
+    unsigned char *entry ;      /* an entry in the name table */
+    const char *name ;          /* name from the entry */
+    const char *prev = NULL ;   /* name from the previous key written */
+    int pass , i , n ;
+    int l = 0 ;                 /* length of the JSON */
+    char *p = NULL ;            /* where to write the JSON */
+
+    ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
+
+    *is_null = 1 ;
+    *error = 0 ;
+    *length = 0 ;
+
+    if( !args->args[0] || !args->args[1] )
+        return NULL ;
+
+    if( ptr->constant_pattern )
+    {
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return NULL ;
+    }
+    else
+    {
+        re = grokCompileArg( args , msg , sizeof(msg) ) ;
+        if( !re )
+        {
+            ghlogprintf( "PREG_GROK: compile failed: %s\n", msg );
+            *error = 1 ;
+            return NULL ;
+        }
+    }
+
+    ovector = pregCreateOffsetsVector( re , NULL , &oveccount , msg , 
+                                       sizeof(msg) ) ;
+    if( !ovector )
+    {
+        ghlogprintf( "PREG_GROK: can't create offset vector :%s\n", msg );
+        *error = 1 ;
+        if( !ptr->constant_pattern ) 
+            pregGrokCacheRelease( re ) ;
+        return NULL ;
+    }
+
+    memset(&extra, 0, sizeof(extra));
+    pregSetLimits(&extra);
+
+    rc = pregExec( ptr , re , &extra , args->args[1] , 
+                   (int)args->lengths[1] , 0 , 0 , ovector , oveccount ) ;
+    if( rc < 0 && rc != PCRE_ERROR_NOMATCH )
+    {
+        ghlogprintf( "PREG_GROK: pcre_exec returned error %d (%s)\n", 
+                     rc, pregExecErrorString(rc) ) ;
+        *error = 1 ;
+    }
+
+    // only pcre patterns can have named groups
+    code = pregEnginePcre( re ) ;
+    if( rc > 0 && code &&
+        (pcre_fullinfo( code , NULL , PCRE_INFO_NAMECOUNT , &namecount ) < 0 ||
+         pcre_fullinfo( code , NULL , PCRE_INFO_NAMEENTRYSIZE , &entrysize ) < 0 ||
+         pcre_fullinfo( code , NULL , PCRE_INFO_NAMETABLE , &table ) < 0 ) )
+    {
+        ghlogprintf( "PREG_GROK: error retrieving information about pattern\n" ) ;
+        *error = 1 ;
+    }
+
+    for( pass = 0 ; rc > 0 && !*error && pass < 2 ; pass++ )
+    {
+        if( pass )
+        {
+            if( pregReserveReturnBuffer( ptr , l ) )
+            {
+                *error = 1 ;
+                break ;
+            }
+            p = ptr->return_buffer ;
+            *p++ = '{' ;
+        }
+        l = 2 ;                 // the braces
+        prev = NULL ;
+
+        for( i = 0 , entry = table ; i < namecount ; i++ , entry += entrysize )
+        {
+            n = (entry[0] << 8) | entry[1] ;
+            name = (const char *)entry + 2 ;
+
+            // a duplicate name.  Skip it if it has already been written.
+            if( prev && !strcmp( prev , name ) )
+                continue ;
+
+            // for duplicate names, wait for the first one that is set
+            if( !grokGroupIsSet( ovector , rc , n ) && i + 1 < namecount &&
+                !strcmp( name , (const char *)entry + entrysize + 2 ) )
+                continue ;
+
+            if( prev )
+            {
+                l++ ;
+                if( pass )
+                    *p++ = ',' ;
+            }
+            prev = name ;
+
+            l += pregJsonStringLength( name , strlen( name ) ) + 1 ;
+            if( grokGroupIsSet( ovector , rc , n ) )
+                l += pregJsonStringLength( args->args[1] + ovector[2*n] , 
+                                           ovector[2*n+1] - ovector[2*n] ) ;
+            else
+                l += 4 ;        // null
+
+            if( pass )
+            {
+                p = pregJsonString( p , name , strlen( name ) ) ;
+                *p++ = ':' ;
+                if( grokGroupIsSet( ovector , rc , n ) )
+                    p = pregJsonString( p , args->args[1] + ovector[2*n] , 
+                                        ovector[2*n+1] - ovector[2*n] ) ;
+                else
+                {
+                    memcpy( p , "null" , 4 ) ;
+                    p += 4 ;
+                }
+            }
+        }
+
+        if( pass )
+        {
+            *p++ = '}' ;
+            *p = '\0' ;
+            *is_null = 0 ;
+            *length = l ;
+        }
+    }
+
+    free( ovector ) ;
+
+    if( !ptr->constant_pattern ) 
+        pregGrokCacheRelease( re ) ;
+
+    if( *is_null )
+        return NULL ;
+
+    return ptr->return_buffer ;
+}
+
+/** 
+ * @fn void preg_grok_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_GROK 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ *
+ * @details A constant pattern came from the grok cache, so it is given
+ * back there instead of being freed by pregDeInit.
+ */
+void preg_grok_deinit(UDF_INIT *initid)
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[255] ;             /* error from a background compile */
+
+    ptr = (struct preg_s *) initid->ptr ;
+    if( ptr )
+        pregWaitCompile( ptr , msg , sizeof(msg) ) ;
+    if( ptr && ptr->re )
+    {
+        pregGrokCacheRelease( ptr->re ) ;
+        ptr->re = NULL ;
+    }
+
+    pregDeInit(initid);
+}
+
+
+/**
+ * @fn bool preg_grok_define_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_GROK_DEFINE
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks to make sure there are 2 arguments.  The 
+ * definition isn't a delimited pattern, so pregInit is not needed.
+ */
+bool preg_grok_define_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    if (args->arg_count != 2)
+    {
+        strncpy(message,"PREG_GROK_DEFINE: needs exactly two arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    args->arg_type[0] = STRING_RESULT ;
+    args->arg_type[1] = STRING_RESULT ;
+
+    initid->maybe_null=1;	
+
+    return 0;
+}
+
+
+/**
+ * @fn longlong preg_grok_define( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_GROK_DEFINE udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - 1 - if the definition was added
+ */
+longlong preg_grok_define( UDF_INIT *initid , UDF_ARGS *args, 
+                           char *is_null, char *error )
+{
+    char msg[255] ;             /* to store errors from the definition */
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    if( !args->args[0] || !args->args[1] )
+    {
+        *is_null = 1 ;
+        return 0 ;
+    }
+
+    if( pregGrokDefine( args->args[0] , (int)args->lengths[0] , 
+                        args->args[1] , (int)args->lengths[1] , 
+                        msg , sizeof(msg) ) )
+    {
+        ghlogprintf( "PREG_GROK_DEFINE: %s\n" , msg ) ;
+        *error = 1 ;
+        return 0 ;
+    }
+
+    return 1 ;
+}
+
+/** 
+ * @fn void preg_grok_define_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_GROK_DEFINE.  Nothing to do.
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_grok_define_deinit(UDF_INIT *initid)
+{
+}
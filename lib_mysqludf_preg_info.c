@@ -41,9 +41,24 @@
  *    CREATE FUNCTION lib_mysqludf_preg_info RETURNS STRING SONAME 'lib_mysqludf_preg.so' ;
  *
  * @par Synopsis
- *    LIB_MYSQLUDF_PREG_INFO()
+ *    LIB_MYSQLUDF_PREG_INFO( [what] )
  * 
+ *     @param what - optional.  'pool' gets the counters of the return 
+ * buffer pools instead of the version.
+ *
  *     @return string - version information for the lib_mysqludf_preg package
+ *     @return string - for 'pool', the buffers reused from the pools 
+ * (hits), malloc'd because the pool had none (misses), and freed instead of
+ * being kept (trims), the bytes kept in the pools now, and the number of 
+ * threads with a pool
+ *     @return NULL - if what is something else
+ *
+ * @details
+ *    Every preg function borrows its return buffer from a pool kept by the
+ * thread that runs the statement, and gives it back when the statement 
+ * ends.  Each thread keeps up to 4 MB, or the number of bytes in the 
+ * LIB_MYSQLUDF_PREG_POOL_BYTES environment variable of the server (0 turns
+ * the pools off).  Few hits and many trims mean the pools are too small.
  *
  * @par Examples:
  *    SELECT LIB_MYSQLUDF_PREG_INFO();
@@ -56,11 +71,19 @@
 | lib_mysqludf_preg 0.6.1  | 
 +--------------------------+
   @endverbatim
+ *
+ *    SELECT LIB_MYSQLUDF_PREG_INFO('pool');
+ *
+ * @b Yields:
+ * @verbatim
+hits=1052 misses=12 trims=0 retained=2162688 threads=4
+  @endverbatim
  */
 
 
 #include "ghmysql.h"
 //#include "preg.h"
+#include "preg_pool.h"
 
 
 /**
@@ -98,17 +121,24 @@ void lib_mysqludf_info_deinit( UDF_INIT* initid );
  * @return 0 - on success
  * @return 1 - on error
  *
- * @details This function checks to make sure there are no arguments.
+ * @details This function checks to make sure there is at most one 
+ * argument.
  */
 bool lib_mysqludf_preg_info_init(UDF_INIT *initid, UDF_ARGS *args, 
                                     char *message)
 {
-    if (args->arg_count != 0)
+    if (args->arg_count > 1)
     {
-        strncpy(message, "lib_mysqludf_preg_info: does not accept arguments", MYSQL_ERRMSG_SIZE) ;
+        strncpy(message, "lib_mysqludf_preg_info: accepts at most one argument", MYSQL_ERRMSG_SIZE) ;
         return 1;
     }
 
+    if( args->arg_count )
+    {
+        args->arg_type[0] = STRING_RESULT ;
+        initid->maybe_null = 1 ;
+    }
+
     return 0;
 }
 
@@ -140,6 +170,28 @@ char *lib_mysqludf_preg_info( UDF_INIT *initid , UDF_ARGS *args,
                               char *result, unsigned long *length,
                               char *is_null , char *error )
 {
+    struct preg_pool_stats_s st ;
+
+    if( args->arg_count )
+    {
+        if( !args->args[0] || args->lengths[0] != 4 || 
+            strncasecmp( args->args[0] , "pool" , 4 ) )
+        {
+            *is_null = 1 ;
+            *error = 0 ;
+            return NULL ;
+        }
+
+        pregPoolGetStats( &st ) ;
+        *length = snprintf( result , 255 , 
+                            "hits=%llu misses=%llu trims=%llu retained=%llu "
+                            "threads=%lu" , st.hits , st.misses , st.trims ,
+                            st.retained , st.threads ) ;
+        *is_null = 0 ;
+        *error = 0 ;
+        return result ;
+    }
+
     strcpy( result , PACKAGE_STRING );
     *length = strlen( result ) ;
     *is_null = 0 ; 
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_json_array.c
+ *
+ * @brief Implements the PREG_JSON_ARRAY_ANY, PREG_JSON_ARRAY_COUNT and 
+ * PREG_JSON_ARRAY_FIRST mysql udfs
+ *
+ */
+
+
+/**
+ * @page PREG_JSON_ARRAY_ANY  PREG_JSON_ARRAY_ANY
+ *
+ * @brief test if any string in a JSON array matches a perl-compatible 
+ * regular expression
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_json_array_any RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_JSON_ARRAY_ANY( pattern , json_array )
+ * 
+ * @par
+ *     @param pattern - is a string that is a perl compatible regular 
+ * expression with delimiters and optional modifiers
+ *
+ *     @param json_array - a JSON array, such as a list of tags or urls
+ *
+ *     @return 1 - if a string element matches
+ *     @return 0 - if none do
+ *     @return NULL - if json_array is NULL or is not a JSON array
+ *
+ * @details
+ *    preg_json_array_any is the same as expanding the array with 
+ * JSON_TABLE and using PREG_RLIKE on each element, without making a row
+ * for every element.  The array is walked in place and each string 
+ * element is matched as it is found, so nothing is copied unless the 
+ * element has escapes.  Elements that are not strings (numbers, nested 
+ * arrays, objects, etc.) are skipped.  The walk stops at the first 
+ * element that matches.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_JSON_ARRAY_ANY('/^urgent/i' , '["Urgent-fix", "docs"]');
+ *
+ * @b Yields: 1
+ *
+ * SELECT * FROM posts WHERE PREG_JSON_ARRAY_ANY('/^mysql/' , posts.tags);
+ */
+
+
+/**
+ * @page PREG_JSON_ARRAY_COUNT  PREG_JSON_ARRAY_COUNT
+ *
+ * @brief count the strings in a JSON array that match a perl-compatible 
+ * regular expression
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_json_array_count RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_JSON_ARRAY_COUNT( pattern , json_array )
+ * 
+ * @par
+ *     @param pattern - is a string that is a perl compatible regular 
+ * expression with delimiters and optional modifiers
+ *
+ *     @param json_array - a JSON array
+ *
+ *     @return - the number of string elements that match
+ *     @return NULL - if json_array is NULL or is not a JSON array
+ *
+ * @details
+ *    preg_json_array_count walks the array like PREG_JSON_ARRAY_ANY, but
+ * has to look at every element.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_JSON_ARRAY_COUNT('/^https:/' , '["https://a", "http://b", 
+ *                              "https://c"]');
+ *
+ * @b Yields: 2
+ */
+
+
+/**
+ * @page PREG_JSON_ARRAY_FIRST  PREG_JSON_ARRAY_FIRST
+ *
+ * @brief return the first string in a JSON array that matches a 
+ * perl-compatible regular expression
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_json_array_first RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_JSON_ARRAY_FIRST( pattern , json_array )
+ * 
+ * @par
+ *     @param pattern - is a string that is a perl compatible regular 
+ * expression with delimiters and optional modifiers
+ *
+ *     @param json_array - a JSON array
+ *
+ *     @return - string - the first string element that matches, with its 
+ * JSON escapes decoded
+ *     @return NULL - if no element matches, or json_array is NULL or is 
+ * not a JSON array
+ *
+ * @details
+ *    preg_json_array_first walks the array like PREG_JSON_ARRAY_ANY, and 
+ * stops at the first element that matches.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_JSON_ARRAY_FIRST('/\\.pdf$/' , '["a.txt", "b.pdf", "c.pdf"]');
+ *
+ * @b Yields: b.pdf
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "preg_utils.h"
+#include "ghfcns.h"
+
+/*
+ * What the PREG_JSON_ARRAY udfs keep in initid->ptr.
+ */
+struct preg_json_array_s {
+    struct preg_s preg ;        /* must be first.  See pregInitWith */
+    int *ovector ;              /* for a constant pattern */
+    int oveccount ;             /* size of ovector */
+};
+
+/*
+ * Public function declarations:
+ */
+bool preg_json_array_any_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_json_array_any( UDF_INIT *initid , UDF_ARGS *args, 
+                              char *is_null, char *error );
+void preg_json_array_any_deinit( UDF_INIT* initid );
+
+bool preg_json_array_count_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_json_array_count( UDF_INIT *initid , UDF_ARGS *args, 
+                                char *is_null, char *error );
+void preg_json_array_count_deinit( UDF_INIT* initid );
+
+bool preg_json_array_first_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_json_array_first( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                             unsigned long *length, char *is_null, char *error );
+void preg_json_array_first_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private function definitions:
+ */
+
+/**
+ * @fn static bool jsonArrayInit( UDF_INIT *initid , UDF_ARGS *args , 
+ *                                char *message , const char *name )
+ *
+ * @brief the per-query initializations shared by the PREG_JSON_ARRAY udfs
+ *
+ * @details A constant pattern is compiled, and its offsets vector made, 
+ * once for the query.  It is compiled in this thread (pregInitInline), 
+ * since the offsets vector needs it.
+ */
+static bool jsonArrayInit( UDF_INIT *initid , UDF_ARGS *args , 
+                           char *message , const char *name )
+{
+    struct preg_json_array_s *ja ; /* local holder of initid->ptr */
+
+    if (args->arg_count != 2)
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , 
+                  "%s: needs exactly two arguments" , name ) ;
+        return 1;
+    }
+
+    initid->maybe_null=1;	
+
+    if( pregInitInline( initid , args , message , 0 , pregCompileRegexArg , 
+                        sizeof( struct preg_json_array_s ) ) )
+        return 1 ;
+
+    ja = (struct preg_json_array_s *)initid->ptr ;
+    if( ja->preg.constant_pattern && ja->preg.re )
+    {
+        ja->ovector = pregCreateOffsetsVector( ja->preg.re , NULL , 
+                                               &ja->oveccount , message , 
+                                               MYSQL_ERRMSG_SIZE ) ;
+        if( !ja->ovector )
+        {
+            // mysql doesn't call _deinit when _init fails
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+    }
+
+    return 0 ;
+}
+
+/**
+ * @fn static int jsonArrayMatch( UDF_INIT *initid , UDF_ARGS *args , 
+ *                                const char *name , int stop , 
+ *                                const char **match , int *match_len , 
+ *                                char *error )
+ *
+ * @brief match the pattern against the string elements of the array
+ *
+ * @param initid - the udf's initid
+ * @param args - the udf's args
+ * @param name - the udf's name for error messages
+ * @param stop - stop at the first element that matches?
+ * @param match - set to the last element that matched
+ * @param match_len - set to the length of match
+ * @param error - set if an error occurs
+ *
+ * @return - the number of elements that matched
+ * @return -1 - if the array is NULL or malformed, or on error
+ *
+ * @details Elements without escapes are matched where they are in the 
+ * JSON text.  Elements with escapes are decoded into the return buffer
+ * first, which only grows when an element is bigger than any before it.
+ * The one offsets vector is used for every element.
+ */
+static int jsonArrayMatch( UDF_INIT *initid , UDF_ARGS *args , 
+                           const char *name , int stop , 
+                           const char **match , int *match_len , 
+                           char *error )
+{
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_json_array_s *ja ; /* local holder of initid->ptr */
+    struct preg_s *ptr ;        /* &ja->preg */
+    struct preg_json_scan_s scan ;
+    struct preg_re_s *re ;      /* the compiled pattern */
+    pcre_extra extra ;
+    int *ovector ;              /* for use by pcre_exec */
+    int oveccount ;             /* size of ovector */
+    int type ;                  /* of the element */
+    const char *value ;         /* the element */
+    int value_len ;             /* length of the element */
+    int escaped ;               /* does the element have escapes? */
+    int rc ;                    /* return from pcre_exec */
+    int count = 0 ;             /* elements that matched */
+
+    ja = (struct preg_json_array_s *) initid->ptr ;
+    ptr = &ja->preg ;
+    ptr->stats.rows++ ;
+
+    if( !args->args[1] || 
+        pregJsonArrayOpen( &scan , args->args[1] , (int)args->lengths[1] ) )
+        return -1 ;
+
+    if( ptr->constant_pattern )
+    {
+        if( !ptr->re )
+            return -1 ;
+        re = ptr->re ;
+        ovector = ja->ovector ;
+        oveccount = ja->oveccount ;
+    }
+    else
+    {
+        re = pregCompileRegexArg( args , msg , sizeof(msg) ) ;
+        if( !re )
+        {
+            ghlogprintf( "%s: compile failed: %s\n", name , msg );
+            *error = 1 ;
+            return -1 ;
+        }
+        ptr->stats.compiles++ ;
+
+        ovector = pregCreateOffsetsVector( re , NULL , &oveccount , 
+                                           msg , sizeof(msg) ) ;
+        if( !ovector )
+        {
+            ghlogprintf( "%s: %s\n", name , msg );
+            *error = 1 ;
+            pregEngineFree( re ) ;
+            return -1 ;
+        }
+    }
+
+    memset(&extra, 0, sizeof(extra));
+    pregSetLimits(&extra);
+
+    while( (type = pregJsonArrayNext( &scan , &value , &value_len , 
+                                      &escaped )) > 0 )
+    {
+        if( type != PREG_JSON_STRING )
+            continue ;
+
+        if( escaped )
+        {
+            if( pregGrowReturnBuffer( ptr , value_len ) )
+            {
+                *error = 1 ;
+                break ;
+            }
+            value_len = pregJsonUnescape( ptr->return_buffer , value , 
+                                          value_len ) ;
+            value = ptr->return_buffer ;
+        }
+
+        rc = pregExec( ptr , re , &extra , value , value_len , 0 , 0 , 
+                       ovector , oveccount ) ;
+        if( rc < 0 )
+        {
+            if( rc != PCRE_ERROR_NOMATCH )
+            {
+                ghlogprintf( "%s: pcre_exec returned error %d (%s)\n", 
+                             name , rc , pregExecErrorString(rc) ) ;
+                *error = 1 ;
+                break ;
+            }
+            continue ;
+        }
+
+        count++ ;
+        *match = value ;
+        *match_len = value_len ;
+        if( stop )
+            break ;
+    }
+
+    if( !ptr->constant_pattern )
+    {
+        free( ovector ) ;
+        pregEngineFree( re ) ;
+    }
+
+    if( *error || type < 0 )
+        return -1 ;
+
+    return count ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_json_array_any_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                   char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_JSON_ARRAY_ANY
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_json_array_any_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return jsonArrayInit( initid , args , message , "PREG_JSON_ARRAY_ANY" ) ;
+}
+
+/**
+ * @fn longlong preg_json_array_any( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                   char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_JSON_ARRAY_ANY udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return 1 - if a string element matches
+ * @return 0 - if none do
+ *
+ * @details The walk stops at the first element that matches.  If the 
+ * JSON is malformed after that element, it isn't noticed.
+ */
+longlong preg_json_array_any( UDF_INIT *initid , UDF_ARGS *args, 
+                              char *is_null, char *error )
+{
+    const char *match ;         /* not used */
+    int match_len ;             /* not used */
+    int count ;
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    count = jsonArrayMatch( initid , args , "PREG_JSON_ARRAY_ANY" , 1 , 
+                            &match , &match_len , error ) ;
+    if( count < 0 )
+    {
+        *is_null = 1 ;
+        return 0 ;
+    }
+
+    return count ? 1 : 0 ;
+}
+
+/** 
+ * @fn void preg_json_array_any_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_JSON_ARRAY_ANY 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_json_array_any_deinit(UDF_INIT *initid)
+{
+    struct preg_json_array_s *ja ; /* local holder of initid->ptr */
+
+    ja = (struct preg_json_array_s *) initid->ptr ;
+    if( ja )
+        free( ja->ovector ) ;
+
+    pregDeInit(initid);
+}
+
+
+/**
+ * @fn bool preg_json_array_count_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                     char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_JSON_ARRAY_COUNT
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_json_array_count_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return jsonArrayInit( initid , args , message , "PREG_JSON_ARRAY_COUNT" ) ;
+}
+
+/**
+ * @fn longlong preg_json_array_count( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                     char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_JSON_ARRAY_COUNT udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the number of string elements that match
+ */
+longlong preg_json_array_count( UDF_INIT *initid , UDF_ARGS *args, 
+                                char *is_null, char *error )
+{
+    const char *match ;         /* not used */
+    int match_len ;             /* not used */
+    int count ;
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    count = jsonArrayMatch( initid , args , "PREG_JSON_ARRAY_COUNT" , 0 , 
+                            &match , &match_len , error ) ;
+    if( count < 0 )
+    {
+        *is_null = 1 ;
+        return 0 ;
+    }
+
+    return count ;
+}
+
+/** 
+ * @fn void preg_json_array_count_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_JSON_ARRAY_COUNT 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_json_array_count_deinit(UDF_INIT *initid)
+{
+    preg_json_array_any_deinit( initid ) ;
+}
+
+
+/**
+ * @fn bool preg_json_array_first_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                     char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_JSON_ARRAY_FIRST
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_json_array_first_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return jsonArrayInit( initid , args , message , "PREG_JSON_ARRAY_FIRST" ) ;
+}
+
+/**
+ * @fn char *preg_json_array_first( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                  char *result, unsigned long *length, 
+ *                                  char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_JSON_ARRAY_FIRST udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used.  The element is returned in place or in 
+ * ptr->return_buffer.
+ * @param length - set to the length of the element returned
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the first string element that matches
+ * @return - NULL - if there isn't one
+ *
+ * @details An element without escapes is returned where it is in the 
+ * argument, and one with escapes was already decoded into the return 
+ * buffer, so the result is never copied.
+ */
+char *preg_json_array_first( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                             unsigned long *length, char *is_null, char *error )
+{
+    const char *match ;         /* the element that matched */
+    int match_len ;             /* length of match */
+
+    *is_null = 1 ;
+    *error = 0 ;
+    *length = 0 ;
+
+    if( jsonArrayMatch( initid , args , "PREG_JSON_ARRAY_FIRST" , 1 , 
+                        &match , &match_len , error ) <= 0 )
+        return NULL ;
+
+    *is_null = 0 ;
+    *length = match_len ;
+    return (char *)match ;
+}
+
+/** 
+ * @fn void preg_json_array_first_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_JSON_ARRAY_FIRST 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_json_array_first_deinit(UDF_INIT *initid)
+{
+    preg_json_array_any_deinit( initid ) ;
+}
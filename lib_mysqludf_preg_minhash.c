@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_minhash.c
+ *
+ * @brief Implements the PREG_MINHASH and PREG_MINHASH_SIMILARITY mysql udfs
+ *
+ */
+
+
+/**
+ * @page PREG_MINHASH  PREG_MINHASH
+ *
+ * @brief compute a MinHash signature of the tokens matched by a PCRE pattern
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_minhash RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_MINHASH( token_pattern , text , k [, shingle_size] )
+ * 
+ * @par
+ *     @param token_pattern - is a string that is a perl compatible regular 
+ * expression as documented at:
+ * http://us.php.net/manual/en/ref.pcre.php This expression passed to
+ * this function should have delimiters and can contain the standard
+ * perl modifiers after the ending delimiter.  Every (non-empty) match of
+ * this pattern in text is a token.
+ *
+ *     @param text - is the data to tokenize
+ *
+ *     @param k - the number of hash functions (1 - 1024).  The signature 
+ * is 4*k bytes long.
+ *
+ *     @param shingle_size - optional number of consecutive tokens that 
+ * are hashed together (1 - 16).  Defaults to 1, which hashes single tokens.
+ *
+ *     @return - binary string - the 4*k byte signature of text
+ *     @return - NULL - if the pattern does not match text at all
+ *
+ * @details
+ *    preg_minhash is a udf that computes a MinHash signature, which can be
+ * used to estimate the similarity of two documents without moving them 
+ * out of the database.  The matches of token_pattern are found in text 
+ * (without copying text), each group of shingle_size consecutive tokens is 
+ * hashed, and the minimum value of each of k seeded hash functions over 
+ * all of those shingles is stored as a 32 bit little endian number in the 
+ * signature.  If there are fewer tokens than shingle_size, all of the 
+ * tokens are used as a single shingle.  Signatures should be compared
+ * with PREG_MINHASH_SIMILARITY.
+ *
+ * @par Examples:
+ *
+ * SELECT LENGTH( PREG_MINHASH('/\\w+/' , 'the quick brown fox' , 64 ) );
+ *
+ * @b Yields:
+ * @verbatim
++-----------------------------------------------------------------+
+| LENGTH( PREG_MINHASH('/\\w+/' , 'the quick brown fox' , 64 ) ) |
++-----------------------------------------------------------------+
+|                                                             256 |
++-----------------------------------------------------------------+
+@endverbatim
+ *
+ * UPDATE documents SET signature=PREG_MINHASH('/\\w+/' , LOWER(body) , 128, 3 );
+ *
+ * Yields: a signature of 3 word shingles for every document
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ * Signatures are only comparable if they were created with the same
+ * pattern, k and shingle_size.
+ */
+
+
+/**
+ * @page PREG_MINHASH_SIMILARITY  PREG_MINHASH_SIMILARITY
+ *
+ * @brief estimate the similarity of two PREG_MINHASH signatures
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_minhash_similarity RETURNS REAL SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_MINHASH_SIMILARITY( signature1 , signature2 )
+ * 
+ * @par
+ *     @param signature1 - a signature returned by PREG_MINHASH
+ *
+ *     @param signature2 - another signature returned by PREG_MINHASH
+ *
+ *     @return - number between 0 and 1 - the fraction of the hash 
+ * functions whose minimums are the same in both signatures.
+ *     @return - NULL - if either signature is NULL or the signatures were
+ * not created with the same k.
+ *
+ * @details
+ *    preg_minhash_similarity is a udf that estimates the Jaccard 
+ * similarity of the shingle sets from which two signatures were built.
+ *
+ * @par Examples:
+ *
+ * SELECT d2.id FROM documents d1, documents d2 WHERE d1.id=1 AND d2.id != 1 
+ *   AND PREG_MINHASH_SIMILARITY( d1.signature , d2.signature ) > 0.8;
+ *
+ * Yields: the documents that are near-duplicates of document 1
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "ghfcns.h"
+
+// Defines
+#define PREG_MINHASH_MAX_K 1024         // maximum number of hash functions
+#define PREG_MINHASH_MAX_SHINGLE 16     // maximum tokens in a shingle
+#define OVECCOUNT 30    // offsets vector size - can be constant since it  
+                        // it is not used for capturing 
+
+
+/*
+ * Public function declarations:
+ */
+bool preg_minhash_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_minhash( UDF_INIT *initid __attribute__((unused)),
+                    UDF_ARGS *args, char *result, unsigned long *length,
+                    char *is_null __attribute__((unused)),
+                    char *error __attribute__((unused)));
+void preg_minhash_deinit( UDF_INIT* initid );
+
+bool preg_minhash_similarity_init(UDF_INIT *initid, UDF_ARGS *args, 
+                                  char *message);
+double preg_minhash_similarity( UDF_INIT *initid __attribute__((unused)),
+                                UDF_ARGS *args,
+                                char *is_null __attribute__((unused)),
+                                char *error __attribute__((unused)));
+void preg_minhash_similarity_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private functions:
+ */
+
+/**
+ * @fn static ulonglong minhashMix( ulonglong h )
+ *
+ * @brief scramble the bits of a 64 bit hash (splitmix64 finalizer)
+ */
+static ulonglong minhashMix( ulonglong h )
+{
+    h ^= h >> 30 ;
+    h *= 0xbf58476d1ce4e5b9ULL ;
+    h ^= h >> 27 ;
+    h *= 0x94d049bb133111ebULL ;
+    h ^= h >> 31 ;
+    return h ;
+}
+
+/**
+ * @fn static ulonglong minhashTokenHash( const char *s , int l )
+ *
+ * @brief 64 bit FNV-1a hash of a token
+ */
+static ulonglong minhashTokenHash( const char *s , int l )
+{
+    ulonglong h = 0xcbf29ce484222325ULL ;
+
+    while( l-- > 0 )
+    {
+        h ^= (unsigned char)*s++ ;
+        h *= 0x100000001b3ULL ;
+    }
+    return h ;
+}
+
+/**
+ * @fn static void minhashAddShingle( unsigned int *mins , int k ,
+ *                                    ulonglong *ring , int ntokens , int n )
+ *
+ * @brief hash the last n tokens as a shingle and update the minimums
+ *
+ * @param mins - the current minimums of the k hash functions
+ * @param k - number of hash functions
+ * @param ring - token hashes, indexed by token number % PREG_MINHASH_MAX_SHINGLE
+ * @param ntokens - number of tokens seen so far
+ * @param n - number of tokens in the shingle
+ *
+ * @details The k hash functions are derived from the two halves of the
+ * shingle hash (h_i = a + i*b), which is much cheaper than hashing the 
+ * shingle k times and is good enough for MinHash.
+ */
+static void minhashAddShingle( unsigned int *mins , int k , 
+                               ulonglong *ring , int ntokens , int n )
+{
+    ulonglong h ;               /* hash of the shingle */
+    unsigned int a , b , v ;
+    int i ;
+
+    h = (ulonglong)n ;
+    for( i = ntokens - n ; i < ntokens ; i++ )
+    {
+        h = minhashMix( h + ring[ i % PREG_MINHASH_MAX_SHINGLE ] ) ;
+    }
+
+    a = (unsigned int)h ;
+    b = (unsigned int)(h >> 32) | 1 ;
+    for( i = 0 , v = a ; i < k ; i++ , v += b )
+    {
+        if( v < mins[i] )
+            mins[i] = v ;
+    }
+}
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_minhash_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                            char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_MINHASH
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks the number and types of the arguments
+ * and the ranges of constant k and shingle_size arguments.  When k is 
+ * constant, the signature size is known and max_length is set to it so
+ * that pregInit allocates a return buffer of just that size.
+ */
+bool preg_minhash_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    longlong k ;
+
+    if (args->arg_count < 3 || args->arg_count > 4)
+    {
+        strncpy(message,"PREG_MINHASH: requires 3 or 4 arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    if( args->arg_type[2] != INT_RESULT || 
+        (args->arg_count > 3 && args->arg_type[3] != INT_RESULT) )
+    {
+        strncpy(message,"PREG_MINHASH: k and shingle_size must be integers", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    if( args->args[2] )
+    {
+        k = *(longlong *)args->args[2] ;
+        if( k < 1 || k > PREG_MINHASH_MAX_K )
+        {
+            strncpy(message,"PREG_MINHASH: k must be between 1 and 1024", MYSQL_ERRMSG_SIZE);
+            return 1;
+        }
+        initid->max_length = (unsigned long)k * 4 ;
+    }
+
+    if( args->arg_count > 3 && args->args[3] && 
+        (*(longlong *)args->args[3] < 1 || 
+         *(longlong *)args->args[3] > PREG_MINHASH_MAX_SHINGLE) )
+    {
+        strncpy(message,"PREG_MINHASH: shingle_size must be between 1 and 16", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    // preg_minhash returns NULL for text without tokens
+    initid->maybe_null=1;	
+
+    return ( pregInit( initid , args , message ) ) ;
+}
+
+
+/**
+ * @fn char *preg_minhash(UDF_INIT *initid , UDF_ARGS *args, char *result, 
+ *                        unsigned long *length, char *is_null , char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_MINHASH udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - small place that the signature could be placed (not used)
+ * @param length - put the length of the signature here.
+ * @param is_null - set this if return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the signature - if at least one token was found
+ * @return - NULL - if no tokens or some other problem
+ *
+ * @details This function calls pregExecNext repeatedly directly on the 
+ * subject argument (which isn't copied) to find the tokens.  The hash
+ * minimums are kept in the return buffer, which is then converted to
+ * little endian order so that signatures are portable.
+ */
+char *preg_minhash(UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                   unsigned long *length, char *is_null , char *error )
+{
+    pcre_extra extra;
+    int i ;
+    int k ;                     /* number of hash functions */
+    char msg[255] ;             /* to store errors from regex compile */
+    unsigned int *mins ;        /* minimums - kept in the return buffer */
+    int ntokens = 0 ;           /* number of tokens found */
+    int offset = 0 ;            /* where to look for the next token */
+    int ovector[OVECCOUNT];     /* for use by pcre_exec */
+    unsigned char *p ;          /* for little endian conversion */
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    int rc ;                    /* return from pcre_exec */
+    struct preg_re_s *re ;      /* the compiled pattern */
+    ulonglong ring[ PREG_MINHASH_MAX_SHINGLE ] ; /* recent token hashes */
+    int shingle = 1 ;           /* number of tokens per shingle */
+    char *subject ;             /* args[1] - not copied */
+    int subject_len ;           /* length of subject */
+    unsigned int v ;
+
+    ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
+
+    *is_null = 1 ;              /* default to NULL return */
+    *error = 0 ;                /* default to no error */
+    *length = 0 ;               /* just to be safe  */
+
+    subject = args->args[1] ;
+    subject_len = (int)args->lengths[1] ;
+    if( !subject || !args->args[2] )
+    {
+        return NULL ;
+    }
+
+    k = (int)(*(longlong *)args->args[2]) ;
+    if( args->arg_count > 3 && args->args[3] )
+        shingle = (int)(*(longlong *)args->args[3]) ;
+
+    if( k < 1 || k > PREG_MINHASH_MAX_K || 
+        shingle < 1 || shingle > PREG_MINHASH_MAX_SHINGLE )
+    {
+        ghlogprintf( "PREG_MINHASH: k or shingle_size out of range\n" );
+        *error = 1 ;
+        return NULL ;
+    }
+
+    // compile the regex if necessary
+    if( ptr->constant_pattern )
+    {
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return NULL ;
+    }
+    else
+    {
+        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
+        if( !re )
+        {
+            ghlogprintf( "PREG_MINHASH: compile failed: %s\n", msg );
+            *error = 1 ;
+            return  NULL ;
+        }
+        ptr->stats.compiles++ ;
+    }
+
+    if( pregReserveReturnBuffer( ptr , k * 4 ) )
+    {
+        *error = 1 ;
+        if( !ptr->constant_pattern ) 
+            pregEngineFree( re ) ;
+        return NULL ;
+    }
+
+    mins = (unsigned int *)ptr->return_buffer ;
+    for( i = 0 ; i < k ; i++ )
+        mins[i] = 0xffffffff ;
+
+    memset(&extra, 0, sizeof(extra));
+    pregSetLimits(&extra);
+
+    // empty matches are not tokens.  pregExecNext steps past them.
+    while( offset <= subject_len )
+    {
+        rc = pregExecNext( ptr , re, &extra, subject, subject_len, &offset,
+                           ovector, OVECCOUNT ) ;
+        if( rc < 0 )
+        {
+            if( rc != PCRE_ERROR_NOMATCH )
+            {
+                ghlogprintf("PREG_MINHASH: pcre_exec returned error %d (%s)\n", 
+                            rc, pregExecErrorString(rc) ) ;
+                *error = 1 ;
+            }
+            break ;
+        }
+
+        ring[ ntokens % PREG_MINHASH_MAX_SHINGLE ] = 
+            minhashTokenHash( subject + ovector[0] , ovector[1] - ovector[0] );
+        ++ntokens ;
+
+        if( ntokens >= shingle )
+            minhashAddShingle( mins , k , ring , ntokens , shingle ) ;
+    }
+
+    if( !ptr->constant_pattern ) 
+        pregEngineFree( re ) ;
+
+    if( *error || !ntokens )
+    {
+        return NULL ;
+    }
+
+    // Too few tokens for even 1 shingle.  Use all of them as the shingle.
+    if( ntokens < shingle )
+        minhashAddShingle( mins , k , ring , ntokens , ntokens ) ;
+
+    // store the minimums as little endian so that signatures are portable
+    p = (unsigned char *)ptr->return_buffer ;
+    for( i = 0 ; i < k ; i++ , p += 4 )
+    {
+        v = mins[i] ;
+        p[0] = (unsigned char)v ;
+        p[1] = (unsigned char)(v >> 8) ;
+        p[2] = (unsigned char)(v >> 16) ;
+        p[3] = (unsigned char)(v >> 24) ;
+    }
+
+    *is_null = 0 ;
+    *length = k * 4 ;
+    return ptr->return_buffer ;
+}
+
+/** 
+ * @fn void preg_minhash_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_MINHASH 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_minhash_deinit(UDF_INIT *initid)
+{
+    pregDeInit(initid);
+}
+
+
+/**
+ * @fn bool preg_minhash_similarity_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                       char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_MINHASH_SIMILARITY
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks to make sure there are 2 arguments.  No
+ * pattern is involved, so pregInit is not needed.
+ */
+bool preg_minhash_similarity_init(UDF_INIT *initid, UDF_ARGS *args, 
+                                  char *message)
+{
+    if (args->arg_count != 2)
+    {
+        strncpy(message,"PREG_MINHASH_SIMILARITY: needs exactly two arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    args->arg_type[0] = STRING_RESULT ;
+    args->arg_type[1] = STRING_RESULT ;
+
+    initid->maybe_null=1;	
+
+    return 0;
+}
+
+
+/**
+ * @fn double preg_minhash_similarity( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                     char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_MINHASH_SIMILARITY udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the fraction of equal hash minimums in the 2 signatures
+ *
+ * @details The signatures are compared 4 bytes (one hash function) at 
+ * a time.  There is no need to decode them.
+ */
+double preg_minhash_similarity( UDF_INIT *initid , UDF_ARGS *args, 
+                                char *is_null, char *error )
+{
+    int i ;
+    int k ;                     /* number of hash functions */
+    int same = 0 ;              /* number of equal minimums */
+    char *s1 , *s2 ;            /* the signatures */
+
+    *is_null = 1 ;
+    *error = 0 ;
+
+    s1 = args->args[0] ;
+    s2 = args->args[1] ;
+    if( !s1 || !s2 || args->lengths[0] != args->lengths[1] || 
+        !args->lengths[0] || (args->lengths[0] % 4) )
+    {
+        return 0.0 ;
+    }
+
+    k = (int)(args->lengths[0] / 4) ;
+    for( i = 0 ; i < k ; i++ , s1 += 4 , s2 += 4 )
+    {
+        if( !memcmp( s1 , s2 , 4 ) )
+            ++same ;
+    }
+
+    *is_null = 0 ;
+    return (double)same / k ;
+}
+
+
+/** 
+ * @fn void preg_minhash_similarity_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_MINHASH_SIMILARITY 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_minhash_similarity_deinit(UDF_INIT *initid)
+{
+}
@@ -200,11 +200,12 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
     int *ovector;               /* for offsets of captures */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
     int rc ;                    /* number of regex's matched by pattern  */
-    pcre *re ;                  /* the compiled pattern */
+    struct preg_re_s *re ;      /* the compiled pattern */
     char *subject ;             /* args[1] */
     int ret = -1 ;              /* position that will be returned */
 
     ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
 
     *is_null = 1 ;              /* default to NULL return */
     *error = 0 ;                /* default to no error */
@@ -221,7 +222,11 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
 
     // compile the regex if necessary
     if( ptr->constant_pattern )
-        re = ptr->re ;
+    {
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return -1 ;
+    }
     else
     {
         re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
@@ -231,6 +236,7 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
             *error = 1 ;
             return  -1 ;
         }
+        ptr->stats.compiles++ ;
     }
     
     // create vector to hold offsets for pcre
@@ -240,7 +246,7 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
         ghlogprintf( "PREG_POSITION: can't create offset vector :%s\n", msg );
         *error = 1 ;
         if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
+            pregEngineFree( re ) ;
         return -1 ;
     }
 
@@ -252,7 +258,8 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
     subject = ghargdup( args , 1 ) ;
     if( subject )
     {
-        ex_subject = pregSkipToOccurence( re , subject , args->lengths[1] , 
+        ex_subject = pregSkipToOccurence( ptr , re , subject , 
+                                          args->lengths[1] , 
                                           ovector , oveccount , occurence,&rc);
 
         groupnum = -1 ;
@@ -276,7 +283,7 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
     free( ovector ) ;
 
     if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
+        pregEngineFree( re ) ;
 
     return ret ;
 }
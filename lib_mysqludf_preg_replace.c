@@ -206,7 +206,7 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
     int count ;                 /* number of matches */
     char msg[255] ;             /* to store errors from regex compile */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
-    pcre *re ;                  /* the compiled pattern */
+    struct preg_re_s *re ;      /* the compiled pattern */
     char *subject ;             /* args[1] */
     unsigned long subject_len;  /* length of subject */
     char *replacement ;         /* args[2] */
@@ -214,8 +214,10 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
     char *s  ;                  /* string modified with replacements */
     int s_len ;                 /* length of modified string */
     int limit ;                 /* args[3] */
+    ulonglong start ;           /* start time of the replace */
 
     ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
 
     *is_null = 0 ;
     *error = 0 ;                /* default to no error */
@@ -230,7 +232,9 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
 
     if( ptr->constant_pattern )
     {
-        re = ptr->re ;
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return NULL ;
     }
     else
     {
@@ -241,14 +245,11 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
             *error = 1 ;
             return  NULL ;
         }
+        ptr->stats.compiles++ ;
     }
 
     int nullReplacement ; 
-    nullReplacement = 0 ; 
-    if( ghargIsNullConstant( args , 1 ) ) 
-    {
-        nullReplacement = 1 ; 
-    }
+    nullReplacement = pregNullReplacement( args , 1 ) ; 
 
     replacement = ghargdups( args , 1 , &repl_len ) ;
     if( !replacement )
@@ -256,7 +257,7 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
         ghlogprintf( "PREG_REPLACE: out of memory\n" );
         *error = 1 ;
         if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
+            pregEngineFree( re ) ;
 
         return  NULL ;
     }
@@ -267,7 +268,7 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
         ghlogprintf( "PREG_REPLACE: can't allocate for subject\n", msg );
         *error = 1 ;
         if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
+            pregEngineFree( re ) ;
         free( replacement );
         return  NULL ;
     }
@@ -283,17 +284,19 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
 
     memset(&msg, 0, sizeof(msg));
 
+    count = 0 ;                 /* pregReplace only increments it */
+    start = pregStatsStart() ;
     s = pregReplace( re , NULL , subject, subject_len , replacement , 
                      repl_len , 0 , &s_len , limit , &count , 
                      msg ,  sizeof(msg) ) ;
+    // on error, pregReplace leaves the pcre_exec return code in s_len
+    pregStatsExec( ptr , start , subject_len , s ? count : 0 , s ? 0 : s_len );
 
-#ifndef GH_1_0_NULL_HANDLING
     if( nullReplacement && s && subject && strcmp( s , subject ) ) {
         result = NULL  ;
         *is_null = 1 ; 
     }
     else 
-#endif
     {
         if (!s && msg[0] != NULL) {
             *error = 1;
@@ -307,7 +310,7 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
     free( replacement ) ;
         
     if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
+        pregEngineFree( re ) ;
 
     return result ;
 }
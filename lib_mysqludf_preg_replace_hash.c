@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_replace_hash.c
+ *
+ * @brief Implements the PREG_REPLACE_HASH mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_REPLACE_HASH  PREG_REPLACE_HASH
+ *
+ * @brief hash the result of a regular expression search & replace 
+ * without building it
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_replace_hash RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_REPLACE_HASH( pattern , replacement , subject [ , limit ] )
+ * 
+ * @par
+ *     @param pattern - is a string that is a perl compatible regular 
+ * expression with delimiters and optional modifiers
+ *
+ *     @param replacement - is the string to use as the replacement, as for
+ * PREG_REPLACE
+ *
+ *     @param subject - is the data to perform the match & replace on
+ *
+ *     @param limit - optional number that is the maximum replacements to 
+ * perform.  Use -1 (or leave empty) for no limit.
+ *
+ *     @return - BIGINT - a 64 bit hash (FNV-1a) of what PREG_REPLACE would 
+ * return for the same arguments
+ *     @return - NULL - if subject is NULL, or when PREG_REPLACE would 
+ * return NULL for a NULL replacement
+ *
+ * @details
+ *    preg_replace_hash is for grouping strings by what they become after 
+ * a search and replace, such as clustering log messages by template with 
+ * the numbers and ids replaced by placeholders.  GROUP BY PREG_REPLACE(...)
+ * makes the server keep the replaced string of every row in a temporary 
+ * table.  preg_replace_hash runs the same replace, but the output is fed 
+ * through the hash as it is produced, so the replaced string is never 
+ * built or copied, and the grouping is done on a number.  Different 
+ * strings can have the same hash, but with 64 bits that is very unlikely 
+ * unless there are billions of different strings.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_REPLACE_HASH('/\\d+/' , 'N' , 'took 12ms') = 
+ *        PREG_REPLACE_HASH('/\\d+/' , 'N' , 'took 345ms');
+ *
+ * @b Yields: 1
+ *
+ * SELECT MIN(message), COUNT(*) FROM log 
+ *     GROUP BY PREG_REPLACE_HASH('/\\b\\d+\\b/' , '<N>' , message);
+ *
+ * Yields: an example message and the count for each message template
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "ghfcns.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_replace_hash_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_replace_hash( UDF_INIT *initid , UDF_ARGS *args, 
+                            char *is_null, char *error );
+void preg_replace_hash_deinit( UDF_INIT* initid );
+
+
+/**
+ * @fn bool preg_replace_hash_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                 char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_REPLACE_HASH
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be up to
+ * MYSQL_ERRMSG_SIZE.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This function checks the arguments the way PREG_REPLACE does 
+ * and calls pregInit to handle the common init tasks.
+ */
+bool preg_replace_hash_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    if (args->arg_count < 3 || args->arg_count > 4)
+    {
+        strncpy(message,"PREG_REPLACE_HASH: requires 3 or 4 arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    if( args->arg_count > 3 && args->arg_type[3] != INT_RESULT )
+    {
+        strncpy(message,"PREG_REPLACE_HASH: 4th argument (limit) must be a number", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    args->arg_type[2] = STRING_RESULT ;  // other 2 are set in common init
+
+    initid->maybe_null=1;	
+
+    return pregInit( initid , args , message ) ;
+}
+
+
+/**
+ * @fn longlong preg_replace_hash( UDF_INIT *initid , UDF_ARGS *args, 
+ *                                 char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_REPLACE_HASH udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this is return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return - the hash of the replaced subject
+ *
+ * @details This calls pregReplaceHash, which runs the pregReplace engine
+ * with a hashing sink in place of the result buffer.  The subject is 
+ * matched where it is.  Only the replacement is copied, since the 
+ * back reference parser needs it to be null terminated.
+ */
+longlong preg_replace_hash( UDF_INIT *initid , UDF_ARGS *args, 
+                            char *is_null, char *error )
+{
+    int count ;                 /* number of matches */
+    char msg[255] ;             /* to store errors from regex compile */
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    struct preg_re_s *re ;      /* the compiled pattern */
+    char *replacement ;         /* args[1] */
+    unsigned long repl_len ;    /* length of replacement */
+    int limit ;                 /* args[3] */
+    int rc ;                    /* from pregReplaceHash */
+    unsigned long long hash ;   /* of the replaced subject */
+    ulonglong start ;           /* start time of the replace */
+
+    ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
+
+    *is_null = 1 ;
+    *error = 0 ;
+
+    if( !args->args[2] )
+        return 0 ;
+
+    if( ptr->constant_pattern )
+    {
+        re = pregConstantRe( ptr , error ) ;
+        if( !re )
+            return 0 ;
+    }
+    else
+    {
+        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
+        if( !re )
+        {
+            ghlogprintf( "PREG_REPLACE_HASH: compile failed: %s\n", msg );
+            *error = 1 ;
+            return 0 ;
+        }
+        ptr->stats.compiles++ ;
+    }
+
+    replacement = ghargdups( args , 1 , &repl_len ) ;
+    if( !replacement )
+    {
+        ghlogprintf( "PREG_REPLACE_HASH: out of memory\n" );
+        *error = 1 ;
+        if( !ptr->constant_pattern ) 
+            pregEngineFree( re ) ;
+        return 0 ;
+    }
+
+    if( args->arg_count > 3 && args->args[3] )
+        limit = (int)( *(longlong *)args->args[3]) ;
+    else
+        limit = -1 ;
+
+    memset(&msg, 0, sizeof(msg));
+
+    count = 0 ;                 /* pregReplaceHash only increments it */
+    start = pregStatsStart() ;
+    rc = pregReplaceHash( re , NULL , args->args[2] , (int)args->lengths[2] ,
+                          replacement , repl_len , limit , &count , &hash , 
+                          msg , sizeof(msg) ) ;
+    pregStatsExec( ptr , start , args->lengths[2] , rc ? 0 : count , rc ) ;
+
+    free( replacement ) ;
+    if( !ptr->constant_pattern ) 
+        pregEngineFree( re ) ;
+
+    if( rc )
+    {
+        ghlogprintf( "PREG_REPLACE_HASH: %s\n", msg );
+        *error = 1 ;
+        return 0 ;
+    }
+
+    // same NULL replacement rule as PREG_REPLACE (see pregNullReplacement):
+    // NULL only if the replace changed the subject
+    if( pregNullReplacement( args , 1 ) && count &&
+        hash != pregHash( args->args[2] , (int)args->lengths[2] ) )
+        return 0 ;
+
+    *is_null = 0 ;
+    return (longlong)hash ;
+}
+
+
+/** 
+ * @fn void preg_replace_hash_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_REPLACE_HASH 
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_replace_hash_deinit(UDF_INIT *initid)
+{
+    pregDeInit( initid ) ;
+}
@@ -169,7 +169,7 @@ longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
     char msg [ 255 ] ;
     int ovector[OVECCOUNT];     /* for use by pcre_exex */
     int rc ;
-    pcre *re ;                  /* the compiled regex */
+    struct preg_re_s *re ;      /* the compiled regex */
     pcre_extra extra;
 
 #ifndef GH_1_0_NULL_HANDLING
@@ -182,12 +182,15 @@ longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
 
     
     ptr = (struct preg_s *) initid->ptr ;
+    ptr->stats.rows++ ;
     // Need to leave out the length check here because some patterns can return true against an empty string
     if( args->args[1] /*&& args->lengths[1]*/ )
     {
         if( ptr->constant_pattern )
         {
-            re = ptr->re ;
+            re = pregConstantRe( ptr , error ) ;
+            if( !re )
+                return 0 ;
         }
         else
         {
@@ -198,17 +201,18 @@ longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
                 *error = 1 ;
                 return 0;
             }
+            ptr->stats.compiles++ ;
         }
 
         memset(&extra, 0, sizeof(extra));
         pregSetLimits(&extra);
         
-        rc = pcre_exec(re, &extra,  args->args[1] , (int)args->lengths[1],
-                       0,0,ovector, OVECCOUNT); 
+        rc = pregExec( ptr , re, &extra,  args->args[1] , 
+                       (int)args->lengths[1], 0,0,ovector, OVECCOUNT); 
 
         if( !ptr->constant_pattern ) 
         {
-            pcre_free( re ) ;
+            pregEngineFree( re ) ;
         }
 
         if( rc > 0 )
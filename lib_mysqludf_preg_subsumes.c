@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/**
+ * @file lib_mysqludf_preg_subsumes.c
+ *
+ * @brief Implements the PREG_SUBSUMES and PREG_OVERLAPS mysql udfs
+ *
+ */
+
+
+/**
+ * @page PREG_SUBSUMES  PREG_SUBSUMES
+ *
+ * @brief test whether one pattern matches everything that another does
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_subsumes RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_SUBSUMES( pattern1 , pattern2 )
+ * 
+ * @par
+ *     @param pattern1 - is a string that is a perl compatible regular 
+ * expression as documented at:
+ * http://us.php.net/manual/en/ref.pcre.php This expression passed to
+ * this function should have delimiters and can contain the standard
+ * perl modifiers after the ending delimiter.
+ *
+ *     @param pattern2 - another regular expression like pattern1
+ *
+ *     @return - 1 - if pattern1 matches every subject that pattern2 matches
+ *     @return - 0 - if there is a subject that pattern2 matches but 
+ * pattern1 doesn't
+ *     @return - NULL - if it is unknown.  This happens when either pattern
+ * uses a feature that isn't regular (backreferences, lookarounds, atomic 
+ * groups, possessive quantifiers, \\b, ...) or isn't supported (the u 
+ * modifier, inline options, unicode properties, anchors in the middle of 
+ * a pattern, ^ and $ with the m modifier) or when the patterns are too big
+ * to compare.
+ *
+ * @details
+ *    preg_subsumes is a udf that decides if a rule is made redundant by 
+ * another rule, for instance when cleaning up a table of filters.  The
+ * comparison uses the same meaning of "match" as PREG_RLIKE, so /foo/ 
+ * subsumes /foobar/ and /^foo\\d+$/.  Both patterns are turned into finite 
+ * automata and the product of the automata is searched for a subject 
+ * that one accepts and the other doesn't.  No subjects are enumerated, so
+ * the answer is exact.  The automata of constant patterns are built once 
+ * per query.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_SUBSUMES('/fox/' , '/quick (brown|red) fox/' );
+ *
+ * @b Yields:
+ * @verbatim
++---------------------------------------------------------+
+| PREG_SUBSUMES('/fox/' , '/quick (brown|red) fox/' )     |
++---------------------------------------------------------+
+|                                                       1 |
++---------------------------------------------------------+
+@endverbatim
+ *
+ * SELECT r2.id FROM rules r1, rules r2 WHERE r1.id != r2.id 
+ *    AND PREG_SUBSUMES( r1.pattern , r2.pattern );
+ *
+ * Yields: the rules that are redundant because another rule matches 
+ * everything they do.  (Rules that match the same subjects subsume each
+ * other, so both are returned.)
+ *
+ * @note
+ *    Remember to add a backslash to escape patterns that use \ notation.
+ * Case folding with the i modifier is only done for ascii letters.
+ */
+
+
+/**
+ * @page PREG_OVERLAPS  PREG_OVERLAPS
+ *
+ * @brief test whether two patterns can match the same subject
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_overlaps RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_OVERLAPS( pattern1 , pattern2 )
+ * 
+ * @par
+ *     @param pattern1 - is a string that is a perl compatible regular 
+ * expression with delimiters and optional modifiers.
+ *
+ *     @param pattern2 - another regular expression like pattern1
+ *
+ *     @return - 1 - if there is a subject that both patterns match
+ *     @return - 0 - if no subject is matched by both patterns
+ *     @return - NULL - if it is unknown.  See PREG_SUBSUMES for the
+ * features that can't be compared.
+ *
+ * @details
+ *    preg_overlaps is a udf that finds rules that conflict with each 
+ * other, for instance routing rules that send the same subject to two 
+ * different places.  It works the same way as PREG_SUBSUMES.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_OVERLAPS('/^\\d+$/' , '/^[a-z]+$/' );
+ *
+ * @b Yields:
+ * @verbatim
++--------------------------------------------------+
+| PREG_OVERLAPS('/^\\d+$/' , '/^[a-z]+$/' )        |
++--------------------------------------------------+
+|                                                0 |
++--------------------------------------------------+
+@endverbatim
+ */
+
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "ghfcns.h"
+#include "preg_automaton.h"
+
+
+/*
+ * The per-query information.  This is kept in initid->ptr instead of 
+ * struct preg_s, since there are two patterns and no return buffer.
+ */
+struct preg_subsumes_s {
+    preg_automaton *a[ 2 ] ;    /* automata of constant patterns */
+    int constant[ 2 ] ;         /* is the pattern argument constant? */
+};
+
+
+/*
+ * Public function declarations:
+ */
+bool preg_subsumes_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_subsumes( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
+                        char *error );
+void preg_subsumes_deinit( UDF_INIT* initid );
+
+bool preg_overlaps_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+longlong preg_overlaps( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
+                        char *error );
+void preg_overlaps_deinit( UDF_INIT* initid );
+
+
+/*
+ * Private functions:
+ */
+
+/**
+ * @fn static int subsumesCreateAutomaton( UDF_ARGS *args , int i , 
+ *                                         preg_automaton **a , 
+ *                                         char *msg , int msglen )
+ *
+ * @brief build the automaton for pattern argument i
+ *
+ * @param args - the args supplied by mysql udf api
+ * @param i - the argument number of the pattern
+ * @param a - put the automaton here.  It is NULL if the pattern is valid
+ * but can't be converted.
+ * @param msg - buffer where error messages can be placed
+ * @param msglen - size of the error message buffer above
+ *
+ * @return 0 - on success (even if *a is NULL)
+ * @return 1 - if the pattern is invalid or memory runs out
+ *
+ * @details The pattern is compiled by pcre first, so that invalid 
+ * patterns are errors (as they are for the other functions) instead of 
+ * being reported as unknown.
+ */
+static int subsumesCreateAutomaton( UDF_ARGS *args , int i , 
+                                    preg_automaton **a , 
+                                    char *msg , int msglen )
+{
+    int coptions ;              /* pcre_compile options from the modifiers */
+    int do_study ;              /* not used */
+    int do_optimize ;           /* not used - the original is compared */
+    const struct preg_engine_s *engine ; /* not used */
+    char *pattern ;             /* the pattern without delimiters */
+    struct preg_re_s *re ;      /* to validate the pattern */
+    char *val ;                 /* null terminated copy of the argument */
+
+    *a = NULL ;
+    *msg = '\0' ;
+
+    val = ghargdup( args , i ) ;
+    if( !val )
+    {
+        strncpy( msg , args->lengths[i] && args->args[i] ? 
+                 "Out of memory" : "Empty pattern" , msglen ) ;
+        return 1 ;
+    }
+
+    re = compileRegex( val , args->lengths[i] , msg , msglen ) ;
+    if( !re )
+    {
+        free( val ) ;
+        return 1 ;
+    }
+    pregEngineFree( re ) ;
+
+    pattern = parseRegex( val , &coptions , &do_study , &do_optimize , 
+                          &engine , msg , msglen ) ;
+    free( val ) ;
+    if( !pattern )
+        return 1 ;
+
+    // msg gets the reason when the pattern isn't supported, but that 
+    // isn't an error.
+    *a = pregAutomatonCreate( pattern , coptions , msg , msglen ) ;
+    free( pattern ) ;
+
+    return 0 ;
+}
+
+/**
+ * @fn static void subsumesDeInit( UDF_INIT *initid )
+ *
+ * @brief the _deinit for both PREG_SUBSUMES and PREG_OVERLAPS
+ */
+static void subsumesDeInit( UDF_INIT *initid )
+{
+    struct preg_subsumes_s *ptr = (struct preg_subsumes_s *)initid->ptr ;
+
+    if( ptr )
+    {
+        pregAutomatonFree( ptr->a[0] ) ;
+        pregAutomatonFree( ptr->a[1] ) ;
+        free( ptr ) ;
+        initid->ptr = NULL ;
+    }
+}
+
+/**
+ * @fn static bool subsumesInit( UDF_INIT *initid , UDF_ARGS *args , 
+ *                               char *message , const char *name )
+ *
+ * @brief the _init for both PREG_SUBSUMES and PREG_OVERLAPS
+ *
+ * @details This checks the arguments and builds the automata of the 
+ * constant patterns.
+ */
+static bool subsumesInit( UDF_INIT *initid , UDF_ARGS *args , 
+                          char *message , const char *name )
+{
+    struct preg_subsumes_s *ptr ;
+    char msg[ 255 ] ;
+    int i ;
+
+    if( args->arg_count != 2 )
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , 
+                  "%s: requires exactly 2 arguments" , name ) ;
+        return 1 ;
+    }
+
+    if( args->arg_type[0] != STRING_RESULT || 
+        args->arg_type[1] != STRING_RESULT )
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , 
+                  "%s: patterns must be strings" , name ) ;
+        return 1 ;
+    }
+
+    ptr = (struct preg_subsumes_s *)calloc( 1 , sizeof(*ptr) ) ;
+    if( !ptr )
+    {
+        snprintf( message , MYSQL_ERRMSG_SIZE , "%s: out of memory" , name ) ;
+        return 1 ;
+    }
+    initid->ptr = (char *)ptr ;
+
+    for( i = 0 ; i < 2 ; i++ )
+    {
+        if( !args->args[i] )
+            continue ;
+
+        ptr->constant[i] = 1 ;
+        if( subsumesCreateAutomaton( args , i , &ptr->a[i] , 
+                                     msg , sizeof(msg) ) )
+        {
+            snprintf( message , MYSQL_ERRMSG_SIZE , "%s: %s" , name , msg ) ;
+            subsumesDeInit( initid ) ;
+            return 1 ;
+        }
+    }
+
+    // NULL is returned when the answer is unknown
+    initid->maybe_null = 1 ;
+
+    return 0 ;
+}
+
+/**
+ * @fn static longlong subsumesCompare( UDF_INIT *initid , UDF_ARGS *args ,
+ *                                      char *is_null , char *error , 
+ *                                      const char *name , 
+ *                                      int (*compare)( preg_automaton * ,
+ *                                                      preg_automaton * ) )
+ *
+ * @brief the main routine for both PREG_SUBSUMES and PREG_OVERLAPS
+ *
+ * @details Automata are built here for patterns that aren't constant
+ * and then passed to compare.
+ */
+static longlong subsumesCompare( UDF_INIT *initid , UDF_ARGS *args , 
+                                 char *is_null , char *error , 
+                                 const char *name , 
+                                 int (*compare)( preg_automaton * , 
+                                                 preg_automaton * ) )
+{
+    struct preg_subsumes_s *ptr ;
+    preg_automaton *a[ 2 ] ;    /* the automata of the patterns */
+    char msg[ 255 ] ;           /* to store errors from regex compile */
+    int i ;
+    int rc = -1 ;               /* result of the comparison */
+
+    ptr = (struct preg_subsumes_s *)initid->ptr ;
+
+    *is_null = 1 ;              /* default to NULL return */
+    *error = 0 ;                /* default to no error */
+
+    for( i = 0 ; i < 2 ; i++ )
+    {
+        if( ptr->constant[i] )
+            a[i] = ptr->a[i] ;
+        else if( !args->args[i] )
+            a[i] = NULL ;
+        else if( subsumesCreateAutomaton( args , i , &a[i] , 
+                                          msg , sizeof(msg) ) )
+        {
+            ghlogprintf( "%s: compile failed: %s\n" , name , msg ) ;
+            *error = 1 ;
+            a[i] = NULL ;
+        }
+    }
+
+    if( a[0] && a[1] )
+        rc = compare( a[0] , a[1] ) ;
+
+    for( i = 0 ; i < 2 ; i++ )
+    {
+        if( !ptr->constant[i] )
+            pregAutomatonFree( a[i] ) ;
+    }
+
+    if( rc < 0 || *error )
+        return 0 ;
+
+    *is_null = 0 ;
+    return rc ;
+}
+
+
+/*
+ * Public function definitions:
+ */
+
+/**
+ * @fn bool preg_subsumes_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                             char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_SUBSUMES
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_subsumes_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return subsumesInit( initid , args , message , "PREG_SUBSUMES" ) ;
+}
+
+/**
+ * @fn longlong preg_subsumes( UDF_INIT *initid, UDF_ARGS *args, 
+ *                             char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_SUBSUMES udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this if return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return 1 - if pattern1 matches everything that pattern2 does
+ * @return 0 - if it doesn't 
+ * @return NULL (via is_null) - if it is unknown
+ */
+longlong preg_subsumes( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
+                        char *error )
+{
+    return subsumesCompare( initid , args , is_null , error , 
+                            "PREG_SUBSUMES" , pregAutomatonSubsumes ) ;
+}
+
+/**
+ * @fn void preg_subsumes_deinit(UDF_INIT *initid)
+ *
+ * @brief cleanup function for PREG_SUBSUMES
+ *
+ * @param initid - pointer to struct to be cleaned.
+ */
+void preg_subsumes_deinit( UDF_INIT* initid )
+{
+    subsumesDeInit( initid ) ;
+}
+
+/**
+ * @fn bool preg_overlaps_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                             char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_OVERLAPS
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ */
+bool preg_overlaps_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return subsumesInit( initid , args , message , "PREG_OVERLAPS" ) ;
+}
+
+/**
+ * @fn longlong preg_overlaps( UDF_INIT *initid, UDF_ARGS *args, 
+ *                             char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine for the PREG_OVERLAPS udf.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param is_null - set this if return value is null
+ * @param error - to be set if an error occurs
+ *
+ * @return 1 - if some subject matches both patterns
+ * @return 0 - if none does
+ * @return NULL (via is_null) - if it is unknown
+ */
+longlong preg_overlaps( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
+                        char *error )
+{
+    return subsumesCompare( initid , args , is_null , error , 
+                            "PREG_OVERLAPS" , pregAutomatonOverlaps ) ;
+}
+
+/**
+ * @fn void preg_overlaps_deinit(UDF_INIT *initid)
+ *
+ * @brief cleanup function for PREG_OVERLAPS
+ *
+ * @param initid - pointer to struct to be cleaned.
+ */
+void preg_overlaps_deinit( UDF_INIT* initid )
+{
+    subsumesDeInit( initid ) ;
+}
@@ -33,16 +33,103 @@
 
 #include "ghmysql.h"
 #include "preg.h"
+#include "preg_pool.h"
+#include "preg_background.h"
 
 /* For pthreads */
 #include <pthread.h>
 
+#include <sys/time.h>
+
+#include "ghfcns.h"
+
+/*
+ * Statement summary threshold in microseconds.  0 means no summaries.
+ */
+static ulonglong preg_stats_threshold = 0 ;
+static pthread_once_t preg_stats_once = PTHREAD_ONCE_INIT ;
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static void pregStatsReadThreshold( void )
+ *
+ * @brief read the statement summary threshold from the environment
+ */
+static void pregStatsReadThreshold( void )
+{
+    char *s ;
+
+    s = getenv( PREG_STATS_THRESHOLD_ENV ) ;
+    if( s )
+        preg_stats_threshold = strtoull( s , NULL , 10 ) ;
+}
+
+/**
+ * @fn static ulonglong pregStatsThreshold( void )
+ *
+ * @brief get the statement summary threshold
+ */
+static ulonglong pregStatsThreshold( void )
+{
+    pthread_once( &preg_stats_once , pregStatsReadThreshold ) ;
+    return preg_stats_threshold ;
+}
+
+/**
+ * @fn static ulonglong pregStatsNow( void )
+ *
+ * @brief get the time in microseconds
+ */
+static ulonglong pregStatsNow( void )
+{
+    struct timeval tv ;
+
+    gettimeofday( &tv , NULL ) ;
+    return (ulonglong)tv.tv_sec * 1000000 + tv.tv_usec ;
+}
+
+/**
+ * @fn static void pregStatsLog( struct preg_s *ptr )
+ *
+ * @brief write the statement summary to the error log if the statement
+ * took longer than the threshold
+ *
+ * @details The summary is one line, so that one expensive statement 
+ * produces one record.  Non-printable characters in the pattern are
+ * replaced by '.' to keep it on one line.
+ */
+static void pregStatsLog( struct preg_s *ptr )
+{
+    struct preg_stats_s *st = &ptr->stats ;
+    char *p ;
+
+    if( !pregStatsThreshold() || st->exec_usec < pregStatsThreshold() )
+        return ;
+
+    for( p = st->pattern ; *p ; p++ )
+    {
+        if( !isprint( (unsigned char)*p ) )
+            *p = '.' ;
+    }
+
+    ghlogprintf( "preg: statement summary: pattern='%s%s' rows=%llu "
+                 "exec_usec=%llu bytes=%llu matches=%llu compiles=%llu "
+                 "limit_errors=%llu peak_buffer=%lu\n" , 
+                 *st->pattern ? st->pattern : "(not constant)" ,
+                 strlen( st->pattern ) == PREG_STATS_PATTERN_LEN ? "..." : "" ,
+                 st->rows , st->exec_usec , st->bytes , st->matches , 
+                 st->compiles , st->limit_errors , st->peak_buffer ) ;
+}
+
 /*
  * Public Functions:
  */
 
 /**
- * @fn pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
+ * @fn struct preg_re_s *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
  *
  * @brief compile the regex (arg[0])
  *
@@ -63,20 +150,35 @@
  * calls compileRegex.
  *
  * @note 
- *    make sure to call pcre_free to free up the returned result (if not null)
+ *    make sure to call pregEngineFree to free up the returned result (if not null)
  * 
  */
-pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
+struct preg_re_s *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
 {
-    pcre *re ;                  /* the compiled pattern */
+    return pregCompileRegexArgNum( args , 0 , msg , msglen ) ;
+}
+
+/**
+ * @fn struct preg_re_s *pregCompileRegexArgNum( UDF_ARGS *args , int argnum , 
+ *                                               char *msg , int msglen ) 
+ *
+ * @brief compile the regex in args[argnum]
+ *
+ * @details pregCompileRegexArg for functions whose pattern is not the
+ * first argument.
+ */
+struct preg_re_s *pregCompileRegexArgNum( UDF_ARGS *args , int argnum , 
+                                          char *msg , int msglen ) 
+{
+    struct preg_re_s *re ;      /* the compiled pattern */
     char *val ;                 /* The pattern to compile */
 
     *msg ='\0';
 
-    val = ghargdup( args , 0 ) ;
+    val = ghargdup( args , argnum ) ;
     if( !val )
     {
-        if( args->lengths[0] && args->args[0] )
+        if( args->lengths[argnum] && args->args[argnum] )
         {
             strncpy( msg , "Out of memory" , msglen ) ;
         }
@@ -87,7 +189,7 @@ pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen )
         return NULL ;
     }
 
-    re = compileRegex( val , args->lengths[0], msg, msglen ) ;
+    re = compileRegex( val , args->lengths[argnum], msg, msglen ) ;
 
     free( val ) ;
 
@@ -96,13 +198,15 @@ pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen )
 
 
 /**
- * @fn int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message )
+ * @fn int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message ,
+ *                      pregCompileFn compile )
  *
  * @brief initialize contents of initid->ptr 
  *
  * @param ptr - the pointer to initialize the info in
  * @param args - the args supplied by mysql udf api (ultimately, the user)
  * @param message - put error message in here if error
+ * @param compile - function that compiles the pattern argument
  * 
  * @return 0 - on success
  * @return 1 - on error
@@ -114,10 +218,11 @@ pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen )
  * @note 
  *    make sure to call destroyPtrInfo when done
  */
-int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message )
+int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message ,
+                 pregCompileFn compile )
 {
     // 128 is a safe size for mysql, which reccomends 80 chars or less messages
-    ptr->re = pregCompileRegexArg( args, message,128 );
+    ptr->re = compile( args, message,128 );
     if( !ptr->re )
     {
         return 1;
@@ -127,7 +232,7 @@ int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message )
 }
 
 /**
- * @fn int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count, 
+ * @fn int *pregCreateOffsetsVector( struct preg_re_s *re , pcre_extra *extra , int *count, 
  *                                   char *msg , int msglen )
  *
  * @brief allocate a memory area that can be used for holding the offset vector
@@ -144,18 +249,19 @@ int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message )
  *
  * @details The ovector is used by the pcre for capturing the offsets of
  * the parenthesized sub-expressions of a pcre expression.  This function
- * uses pcre_fullinfo to retrieve the number of capture groups in the 
+ * uses pregEngineCaptureCount to retrieve the number of capture groups in the 
  * expression, and then it allocates a vector of that size+1 and
  * sets the passed in count to that size as well.
  */
-int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
+int *pregCreateOffsetsVector( struct preg_re_s *re , pcre_extra *extra , int *count ,
                               char *msg , int msglen )
 {
     int *ovec ;                 /* vector to return */
     int oveccount ;             /* number of capture groups found */
 
     *count = 0 ;
-    if( pcre_fullinfo(re, extra , PCRE_INFO_CAPTURECOUNT, &oveccount ) < 0 )
+    oveccount = pregEngineCaptureCount( re ) ;
+    if( oveccount < 0 )
     {
         strncpy(msg,"preg: error retrieving information about pattern",msglen);
         return NULL ;
@@ -175,7 +281,31 @@ int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
 }
 
 /**
- * @fn int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
+ * @fn int pregNullReplacement( UDF_ARGS *args , int argnum )
+ *
+ * @brief tells whether a replacement arg is a NULL that nulls the result
+ *
+ * @param args - the args to the mysql UDF 
+ * @param argnum - the index of the replacement in args
+ * 
+ * @return 1 - if args[argnum] is a constant NULL
+ * @return 0 - otherwise, or always with GH_1_0_NULL_HANDLING
+ *
+ * @details PREG_REPLACE and PREG_REPLACE_HASH share this rule: when it 
+ * returns 1, a replace that changes the subject returns NULL.  Otherwise
+ * a NULL replacement is used as an empty string.
+ */
+int pregNullReplacement( UDF_ARGS *args , int argnum )
+{
+#ifdef GH_1_0_NULL_HANDLING
+    return 0 ;
+#else
+    return ghargIsNullConstant( args , argnum ) ;
+#endif
+}
+
+/**
+ * @fn int pregGetGroupNum( struct preg_re_s *re ,  UDF_ARGS *args , int argnum )
  *
  * @brief gets the string number of a capture group from a pcre 
  *
@@ -188,15 +318,15 @@ int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
  *
  * @details This function extract the desired group number from the 
  * given arguments.  If it is a named capture group, it is converted
- * to a number using pcre_get_stringnumber.  This number is then returned.
+ * to a number using pregEngineGroupNumber.  This number is then returned.
  */
-int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
+int pregGetGroupNum( struct preg_re_s *re ,  UDF_ARGS *args , int argnum )
 {
     char *group ;               /* named group - args[argnum] */
     int groupnum ;              /* string number of capture group */
     
     // The groupnum was specified as an optional parameter
-    if( argnum >= args->arg_count ) 
+    if( (unsigned int)argnum >= args->arg_count ) 
         groupnum = 0 ;
     else if( args->arg_type[argnum] == INT_RESULT )
     {   // numeric capture group
@@ -211,7 +341,7 @@ int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
             return -1 ;
         }
 
-        groupnum =pcre_get_stringnumber(re , group);
+        groupnum =pregEngineGroupNumber(re , group);
         free( group ) ;
     }
 
@@ -219,12 +349,14 @@ int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
 }
 
 /**
- * @fn int pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
+ * @fn int pregSkipToOccurence( struct preg_s *ptr , struct preg_re_s *re , 
+ *                              char *subject , int subject_len , 
  *                              int *ovector  , int oveccount , int occurence, 
  *                              int *rc)
  *
  * @brief return a pointer to the nth occurence of a pcre in a string
  *
+ * @param ptr - the info stored in initid->ptr (for the statistics)
  * @param re - compiled regular expression
  * @param subject - the string on which to perform matching
  * @param subject_len - length of the subject string
@@ -240,9 +372,10 @@ int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
  * given arguments.  If it is a named capture group, it is converted
  * to a number using pcre_get_stringnumber.  This number is then returned.
  */
-char *pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
-                              int *ovector  , int oveccount , int occurence, 
-                              int *rc)
+char *pregSkipToOccurence( struct preg_s *ptr , struct preg_re_s *re , 
+                           char *subject , int subject_len , 
+                           int *ovector  , int oveccount , int occurence, 
+                           int *rc)
 {
     char *ex_subject ;          /* position of last match */
     int subject_offset = 0 ;    /* offset of next match from last one */
@@ -259,7 +392,7 @@ char *pregSkipToOccurence( pcre *re , char *subject , int subject_len ,
     while( occurence-- && subject_offset <= subject_len ) {
 
         // Run the regex and find the groupnum if possible
-        *rc = pcre_exec(re, &extra,  subject + subject_offset , 
+        *rc = pregExec( ptr , re, &extra,  subject + subject_offset , 
                         subject_len - subject_offset, 0,0,
                         ovector, oveccount); 
         if( *rc <= 0 )
@@ -275,26 +408,194 @@ char *pregSkipToOccurence( pcre *re , char *subject , int subject_len ,
     return ret ;
 }
 
+/**
+ * @fn ulonglong pregStatsStart( void )
+ *
+ * @brief get the start time of a timed operation
+ *
+ * @return the time in microseconds if statement summaries are on
+ * @return 0 - if statement summaries are off
+ */
+ulonglong pregStatsStart( void )
+{
+    return pregStatsThreshold() ? pregStatsNow() : 0 ;
+}
+
+/**
+ * @fn void pregStatsExec( struct preg_s *ptr , ulonglong start , 
+ *                         long bytes , long matches , int rc )
+ *
+ * @brief add the cost of a matching operation to the statement counters
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param start - return value of pregStatsStart
+ * @param bytes - subject bytes scanned
+ * @param matches - number of matches found
+ * @param rc - pcre return code (for counting limit errors)
+ */
+void pregStatsExec( struct preg_s *ptr , ulonglong start , long bytes , 
+                    long matches , int rc )
+{
+    if( start )
+        ptr->stats.exec_usec += pregStatsNow() - start ;
+    if( bytes > 0 )
+        ptr->stats.bytes += bytes ;
+    if( matches > 0 )
+        ptr->stats.matches += matches ;
+    if( rc == PCRE_ERROR_MATCHLIMIT || rc == PCRE_ERROR_RECURSIONLIMIT )
+        ptr->stats.limit_errors++ ;
+}
+
+/**
+ * @fn int pregExec( struct preg_s *ptr , struct preg_re_s *re , 
+ *                   pcre_extra *extra , 
+ *                   const char *subject , int length , int start_offset , 
+ *                   int options , int *ovector , int ovecsize )
+ *
+ * @brief pcre_exec that also updates the statement counters in ptr
+ *
+ * @return - the return value of pcre_exec
+ *
+ * @details The match is run by the engine that compiled re.
+ *
+ * @details A match only counts the bytes up to its end as scanned, so 
+ * that loops over the matches in a subject count each byte once.
+ */
+int pregExec( struct preg_s *ptr , struct preg_re_s *re , pcre_extra *extra , 
+              const char *subject , int length , int start_offset , 
+              int options , int *ovector , int ovecsize )
+{
+    ulonglong start ;           /* start time of match */
+    int rc ;                    /* return value of pcre_exec */
+
+    start = pregStatsStart() ;
+    rc = pregEngineExec( re , extra , subject , length , start_offset , 
+                         options , ovector , ovecsize ) ;
+    pregStatsExec( ptr , start , 
+                   (rc >= 0 && ovecsize >= 2 ? ovector[1] : length) - start_offset ,
+                   rc >= 0 , rc ) ;
+
+    return rc ;
+}
+
+/**
+ * @fn int pregExecNext( struct preg_s *ptr , struct preg_re_s *re , 
+ *                       pcre_extra *extra , const char *subject , 
+ *                       int length , int *offset , 
+ *                       int *ovector , int ovecsize )
+ *
+ * @brief pregEngineNext that also updates the statement counters in ptr
+ *
+ * @param offset - where to start.  It is moved past the match.
+ *
+ * @return - the return value of pcre_exec.  PCRE_ERROR_NOMATCH when 
+ * there are no more matches.
+ *
+ * @details For functions that walk all of the (non-empty) matches in a 
+ * subject.
+ */
+int pregExecNext( struct preg_s *ptr , struct preg_re_s *re , 
+                  pcre_extra *extra , const char *subject , int length , 
+                  int *offset , int *ovector , int ovecsize )
+{
+    ulonglong start ;           /* start time of match */
+    int start_offset = *offset ;
+    int rc ;                    /* return value of pcre_exec */
+
+    start = pregStatsStart() ;
+    rc = pregEngineNext( re , extra , subject , length , offset , 
+                         ovector , ovecsize ) ;
+    pregStatsExec( ptr , start , 
+                   (rc >= 0 && ovecsize >= 2 ? ovector[1] : length) - start_offset ,
+                   rc >= 0 , rc ) ;
+
+    return rc ;
+}
+
 /**
  * @fn void destroyPtrInfo( struct preg_s *ptr )
  *
  * @brief free up the memory used by ptr and alloced in initPtrInfo
  *
  * @param ptr - free members of this struct
+ *
+ * @details The return buffer is given back to the thread's buffer pool.
  */
 void destroyPtrInfo( struct preg_s *ptr )
 {
+    char msg[ PREG_BACKGROUND_MSG_SIZE ] ;
+
+    pregWaitCompile( ptr , msg , sizeof( msg ) ) ;
     if( ptr->re )
     {
-        pcre_free( ptr->re ) ;
+        pregEngineFree( ptr->re ) ;
         ptr->re = NULL ;
     }
     if( ptr->return_buffer ) {
-        free( ptr->return_buffer ) ;
+        pregPoolPut( ptr->return_buffer , ptr->return_buffer_size ) ;
         ptr->return_buffer = NULL ;
     }
 }
 
+/**
+ * @fn int pregWaitCompile( struct preg_s *ptr , char *msg , int msglen )
+ *
+ * @brief wait for a constant pattern given to a background thread by 
+ * pregInitWith, and put it in ptr->re
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param msg - gets the error message if the compile failed
+ * @param msglen - size of msg
+ *
+ * @return 0 - on success, or if there was nothing to wait for
+ * @return 1 - if the compile failed
+ *
+ * @details _deinit functions that free ptr->re themselves call this 
+ * first.  The main functions call pregConstantRe instead.  _init 
+ * functions that need to look at the compiled pattern use pregInitInline,
+ * so there is nothing to wait for.
+ */
+int pregWaitCompile( struct preg_s *ptr , char *msg , int msglen )
+{
+    if( !ptr->compile_job )
+        return ptr->compile_failed ;
+
+    ptr->re = pregBackgroundWait( ptr->compile_job , msg , msglen ) ;
+    ptr->compile_job = NULL ;
+    if( !ptr->re )
+        ptr->compile_failed = 1 ;
+
+    return ptr->compile_failed ;
+}
+
+/**
+ * @fn struct preg_re_s *pregConstantRe( struct preg_s *ptr , char *error )
+ *
+ * @brief get the compiled constant pattern
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param error - set if the pattern didn't compile.  Can be NULL.
+ *
+ * @return - the compiled pattern
+ * @return - NULL - if it didn't compile
+ *
+ * @details If the pattern was given to a background thread, the first 
+ * row waits for it here.  A compile error is logged once, and every row 
+ * then returns an error, as the _init would have failed otherwise.
+ */
+struct preg_re_s *pregConstantRe( struct preg_s *ptr , char *error )
+{
+    char msg[ PREG_BACKGROUND_MSG_SIZE ] ;
+
+    if( ptr->compile_job && pregWaitCompile( ptr , msg , sizeof( msg ) ) )
+        ghlogprintf( "preg: compile failed: %s\n" , msg ) ;
+
+    if( ptr->compile_failed && error )
+        *error = 1 ;
+
+    return ptr->re ;
+}
+
 /**
  * @fn void pregDeInit(UDF_INIT *initid)
  *
@@ -303,7 +604,8 @@ void destroyPtrInfo( struct preg_s *ptr )
  * @param initid - various info supplied by mysql api - read more at
  * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
  *
- * @details - frees the ptr members and then frees the ptr itself.  It
+ * @details - logs the statement summary if the statement was expensive,
+ * frees the ptr members and then frees the ptr itself.  It
  * can usually be the only thing called by the _deinit functions of the
  * preg routeines.
  */
@@ -314,6 +616,7 @@ void pregDeInit(UDF_INIT *initid)
     if (initid->ptr)
     {
         ptr = (struct preg_s *)initid->ptr ;
+        pregStatsLog( ptr ) ;
         destroyPtrInfo( ptr ) ;
         free( ptr ) ;
         initid->ptr = NULL ;
@@ -345,12 +648,32 @@ void pregDeInit(UDF_INIT *initid)
  * is a constant.
  */
 bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    return pregInitWith( initid , args , message , 0 , pregCompileRegexArg ,
+                         sizeof( struct preg_s ) ) ;
+}
+
+/**
+ * @fn static bool pregInitCommon(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                char *message, int argnum, 
+ *                                pregCompileFn compile, size_t size,
+ *                                int background)
+ *
+ * @brief pregInitWith and pregInitInline
+ *
+ * @param background - 1 to let a background thread compile a constant 
+ * pattern, if there are any.  0 to compile it here.
+ */
+static bool pregInitCommon(UDF_INIT *initid, UDF_ARGS *args, char *message,
+                           int argnum, pregCompileFn compile, size_t size,
+                           int background)
 {
     struct preg_s *ptr;       /* temp holder of initid->ptr */
     int i ;
+    unsigned long l ;         /* length of pattern kept for statistics */
 
     // use calloc so deInit can check for NULL's before freeing
-    initid->ptr = (char *)calloc( 1,sizeof( struct preg_s ) ) ;
+    initid->ptr = (char *)calloc( 1, size ) ;
     ptr = (struct preg_s *)initid->ptr ;
 
     if( !ptr )
@@ -359,7 +682,7 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
         return 1;
     }
     
-    if( ghargIsNullConstant( args , 0 ) ) 
+    if( (unsigned int)argnum < args->arg_count && ghargIsNullConstant( args , argnum ) ) 
     {
         ptr->constant_pattern = 1 ;
 #ifdef GH_1_0_NULL_HANDLING
@@ -370,16 +693,34 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
 
 
     // Convert first 2 args (pattern & subject) to strings.
-    for (i=0 ; i < 2; i++)
+    for (i=0 ; i < 2 && i < (int)args->arg_count ; i++)
         args->arg_type[i]=STRING_RESULT;
 
-    if(args->arg_count && args->args[0] ) 
+    if( (unsigned int)argnum >= args->arg_count || args->args[argnum] ) 
     {
-        if( initPtrInfo( ptr , args ,  message ) )
+        // let a background thread compile it if there are any (see 
+        // preg_background.c).  The main function waits for it.
+        if( background )
+            ptr->compile_job = pregBackgroundCompile( args , argnum , compile ) ;
+        if( !ptr->compile_job && initPtrInfo( ptr , args ,  message , compile ) )
         {
+            // mysql doesn't call _deinit when _init fails
+            free( ptr ) ;
+            initid->ptr = NULL ;
             return 1;
         }
 
+        // keep the start of the pattern for the statement summary.  
+        // ptr was calloc'd, so it stays terminated.
+        ptr->stats.compiles++ ;
+        if( (unsigned int)argnum < args->arg_count )
+        {
+            l = args->lengths[argnum] ;
+            if( l > PREG_STATS_PATTERN_LEN )
+                l = PREG_STATS_PATTERN_LEN ;
+            memcpy( ptr->stats.pattern , args->args[argnum] , l ) ;
+        }
+
         /**
          * If the pattern is constant, compile it once to improve perfomance.
          * Set the constant_pattern member to inform main function.
@@ -402,7 +743,141 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
         ptr->return_buffer_size = 1024000 ;
     }
 
-    ptr->return_buffer = malloc( ptr->return_buffer_size ) ;
+    // borrow from this thread's pool of warm buffers.  This can round
+    // return_buffer_size up.
+    ptr->return_buffer = pregPoolGet( &ptr->return_buffer_size ) ;
+
+    return 0 ;
+}
+
+/**
+ * @fn bool pregInitWith(UDF_INIT *initid, UDF_ARGS *args, char *message,
+ *                       int argnum, pregCompileFn compile, size_t size)
+ *
+ * @brief
+ *     pregInit for functions that need something different
+ *
+ * @param argnum - the argument that has the pattern.  For an optional 
+ * pattern, this can be past the last argument, and then compile is 
+ * expected to supply a default pattern.
+ * @param compile - compiles a constant pattern argument.  It is called 
+ * like pregCompileRegexArg.
+ * @param size - the size to allocate for initid->ptr.  Functions that 
+ * keep more per query state use a struct that starts with a struct preg_s.
+ *
+ * @details This is for functions whose patterns are not the first 
+ * argument, or need something done before (or instead of) the usual
+ * compile.  Their _deinit routines must handle ptr->re if it wasn't
+ * compiled by pregCompileRegexArg, and any state of their own.
+ */
+bool pregInitWith(UDF_INIT *initid, UDF_ARGS *args, char *message,
+                  int argnum, pregCompileFn compile, size_t size)
+{
+    return pregInitCommon( initid , args , message , argnum , compile , size ,
+                           1 ) ;
+}
+
+/**
+ * @fn bool pregInitInline(UDF_INIT *initid, UDF_ARGS *args, char *message,
+ *                         int argnum, pregCompileFn compile, size_t size)
+ *
+ * @brief
+ *     pregInitWith, but a constant pattern is always compiled here
+ *
+ * @details For functions whose _init needs the compiled pattern, such as
+ * to check its groups.  Handing it to a background thread only to wait 
+ * for it would gain nothing.
+ */
+bool pregInitInline(UDF_INIT *initid, UDF_ARGS *args, char *message,
+                    int argnum, pregCompileFn compile, size_t size)
+{
+    return pregInitCommon( initid , args , message , argnum , compile , size ,
+                           0 ) ;
+}
+
+/**
+ * int pregReserveReturnBuffer( struct preg_s *ptr , int l )
+ *
+ * @brief
+ *     makes sure ptr->return_buffer can hold l bytes plus a terminator
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param l - number of bytes that will be written into the buffer
+ *
+ * @return 0 - on success
+ * @return -1  - on error
+ *
+ * @details If ptr->return_buffer is too small, it is replaced with a
+ * bigger one.  The old contents are NOT preserved.  This is useful for
+ * functions that build their return values directly in the buffer.
+ */
+int pregReserveReturnBuffer( struct preg_s *ptr , int l )
+{
+    char *newbuf ;
+
+    if( l > 0 && (unsigned long)l > ptr->stats.peak_buffer )
+        ptr->stats.peak_buffer = l ;
+
+    if( (l+1) > ptr->return_buffer_size )
+    {
+        newbuf = malloc( l + 1 ) ;
+        if( !newbuf )
+        {
+            fprintf( stderr ,
+                     "preg: out of memory reallocing return buffer\n" ) ;
+            return -1 ;
+        }
+
+        free( ptr->return_buffer ) ;
+        ptr->return_buffer = newbuf ;
+        ptr->return_buffer_size = l + 1 ;
+    }
+
+    return 0 ;
+}
+
+/**
+ * int pregGrowReturnBuffer( struct preg_s *ptr , int l )
+ *
+ * @brief
+ *     makes sure ptr->return_buffer can hold l bytes plus a terminator,
+ * keeping what is already in it
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param l - number of bytes that will be in the buffer
+ *
+ * @return 0 - on success
+ * @return -1  - on error
+ *
+ * @details This is for functions that build their return values directly
+ * in the buffer without knowing the final length first.  The buffer at 
+ * least doubles each time it grows, so appending stays linear.
+ */
+int pregGrowReturnBuffer( struct preg_s *ptr , int l )
+{
+    char *newbuf ;
+    unsigned long size ;
+
+    if( l > 0 && (unsigned long)l > ptr->stats.peak_buffer )
+        ptr->stats.peak_buffer = l ;
+
+    if( (l+1) > ptr->return_buffer_size )
+    {
+        size = ptr->return_buffer_size * 2 ;
+        if( size < (unsigned long)(l+1) )
+            size = l + 1 ;
+
+        newbuf = realloc( ptr->return_buffer , size ) ;
+        if( !newbuf )
+        {
+            fprintf( stderr ,
+                     "preg: out of memory reallocing return buffer\n" ) ;
+            return -1 ;
+        }
+
+        ptr->return_buffer = newbuf ;
+        ptr->return_buffer_size = size ;
+    }
 
     return 0 ;
 }
@@ -430,21 +905,9 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
  */
 int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l )
 {
-    char *newbuf ; 
-
-    if( (l+1) > ptr->return_buffer_size )
+    if( pregReserveReturnBuffer( ptr , l ) )
     {
-        newbuf = malloc( l + 1 ) ;
-        if( !newbuf )
-        {
-            fprintf( stderr , 
-                     "preg: out of memory reallocing return buffer\n" ) ;
-            return -1 ;
-        }
-
-        free( ptr->return_buffer ) ;
-        ptr->return_buffer = newbuf ; 
-        ptr->return_buffer_size = l + 1 ;
+        return -1 ;
     }
 
     memcpy( ptr->return_buffer , s , l ) ;
@@ -36,16 +36,42 @@
 
 // Include the libpcre headers
 #include <pcre.h>
+#include "preg_engine.h"
 #include "from_php.h"
 
+// Environment variable with the statement summary threshold (microseconds)
+#define PREG_STATS_THRESHOLD_ENV "LIB_MYSQLUDF_PREG_STATS_USEC"
+#define PREG_STATS_PATTERN_LEN 64   // longer patterns are truncated
+
 /*
  * PCRE Structures:
  */
+
+/*
+ * Counters for one udf instance (ie. one call in one statement).  These
+ * are logged by pregDeInit when the statement was expensive.
+ */
+struct preg_stats_s {
+    ulonglong rows ;            /* rows processed */
+    ulonglong exec_usec ;       /* time spent matching */
+    ulonglong bytes ;           /* subject bytes scanned */
+    ulonglong matches ;         /* successful matches */
+    ulonglong compiles ;        /* patterns compiled */
+    ulonglong limit_errors ;    /* match or recursion limits reached */
+    unsigned long peak_buffer ; /* most bytes put in the return buffer */
+    char pattern[ PREG_STATS_PATTERN_LEN + 1 ] ; /* constant pattern */
+};
+
+struct preg_background_job_s ;
+
 struct preg_s {
-    pcre *re ;                  /* the compiled regex */
+    struct preg_re_s *re ;      /* the compiled regex */
     int constant_pattern ;      /* is the pattern argument constant? */
+    struct preg_background_job_s *compile_job ; /* pending compile of re */
+    int compile_failed ;        /* did the background compile fail? */
     char *return_buffer ;       /* alloc'd memory for returning strings */
     unsigned long return_buffer_size ;
+    struct preg_stats_s stats ; /* statement cost counters */
 };
 
 /*
@@ -53,35 +79,59 @@ struct preg_s {
  */
 
 // from_php.c
-//pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen ) ;
+//struct preg_re_s *compileRegex( char *regex , int regex_len , char *msg , int msglen ) ;
 
 /*
-char *pregReplace(pcre *re , pcre_extra *extra , 
+char *pregReplace(struct preg_re_s *re , pcre_extra *extra , 
                   char *subject, int subject_len, char *replace, 
                   int replace_len , 
                   int is_callable_replace, int *result_len, int limit, 
                   int *replace_count, char *msg , int msglen );
 */
 // preg.c
+typedef struct preg_re_s *(*pregCompileFn)( UDF_ARGS *args , char *msg , int msglen ) ;
+
 void destroyPtrInfo( struct preg_s *ghptr );
-int initPtrInfo( struct preg_s *ghptr , UDF_ARGS *args,char*msg );
+int initPtrInfo( struct preg_s *ghptr , UDF_ARGS *args,char*msg ,
+                 pregCompileFn compile );
 bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message);
-pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) ;
+bool pregInitWith(UDF_INIT *initid, UDF_ARGS *args, char *message,
+                  int argnum, pregCompileFn compile, size_t size);
+bool pregInitInline(UDF_INIT *initid, UDF_ARGS *args, char *message,
+                    int argnum, pregCompileFn compile, size_t size);
+int pregWaitCompile( struct preg_s *ptr , char *msg , int msglen ) ;
+struct preg_re_s *pregConstantRe( struct preg_s *ptr , char *error ) ;
+struct preg_re_s *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) ;
+struct preg_re_s *pregCompileRegexArgNum( UDF_ARGS *args , int argnum , 
+                                          char *msg , int msglen ) ;
 int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l );
+int pregReserveReturnBuffer( struct preg_s *ptr , int l );
+int pregGrowReturnBuffer( struct preg_s *ptr , int l );
 void pregDeInit(UDF_INIT *initid) ;
 
-int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
+int *pregCreateOffsetsVector( struct preg_re_s *re , pcre_extra *extra , int *count ,
                               char *msg , int msglen );
 
 char *pregMoveToReturnValues( UDF_INIT *initid ,
                               unsigned long *length , 
                               char *is_null , char *error ,
                               char *s , int s_len  )  ;
-int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum );
+int pregNullReplacement( UDF_ARGS *args , int argnum );
+int pregGetGroupNum( struct preg_re_s *re ,  UDF_ARGS *args , int argnum );
 
-char *pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
+char *pregSkipToOccurence( struct preg_s *ptr , struct preg_re_s *re , 
+                           char *subject , int subject_len , 
                            int *ovector  , int oveccount , int occurence, 
                            int *rc);
+int pregExec( struct preg_s *ptr , struct preg_re_s *re , pcre_extra *extra , 
+              const char *subject , int length , int start_offset , 
+              int options , int *ovector , int ovecsize ) ;
+int pregExecNext( struct preg_s *ptr , struct preg_re_s *re , 
+                  pcre_extra *extra , const char *subject , int length , 
+                  int *offset , int *ovector , int ovecsize ) ;
+ulonglong pregStatsStart( void ) ;
+void pregStatsExec( struct preg_s *ptr , ulonglong start , long bytes , 
+                    long matches , int rc ) ;
 void pregSetLimits(pcre_extra *extra);
 const char *pregExecErrorString(int errno);
 
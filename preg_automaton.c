@@ -0,0 +1,1471 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_automaton.c
+ *  
+ * @brief A small finite automaton implementation for the regular subset
+ *        of PCRE syntax.  It is used to decide whether one pattern 
+ *        subsumes or overlaps another.
+ *
+ * @details A pattern is parsed into a Thompson NFA.  The language of the
+ * NFA is the set of subjects that the pattern matches somewhere (which is 
+ * what PREG_RLIKE tests), so unanchored patterns get a loop on any byte 
+ * before and after them.  Two NFAs are compared by exploring the product 
+ * of their DFAs, which are built lazily over the byte classes that the 
+ * two patterns can distinguish.
+ *
+ * Anything that can't be described by a finite automaton (backreferences,
+ * lookarounds, atomic groups, possessive quantifiers, word boundaries,
+ * anchors that aren't at the start or end of an alternative, ...) or 
+ * that isn't implemented here (UTF-8, unicode properties, inline options)
+ * is reported as unsupported, so that callers can return "unknown".
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "preg_automaton.h"
+
+#define ANCHOR_NONE   0         /* alternative not anchored at the end */
+#define ANCHOR_DOLLAR 1         /* $ - end of subject or before final \n */
+#define ANCHOR_END    2         /* \z - very end of subject */
+
+#define PRODUCT_SUBSUMES 0
+#define PRODUCT_OVERLAPS 1
+
+/*
+ * A set of bytes.  Used for the transitions of the NFA.
+ */
+typedef struct {
+    unsigned char bits[ 32 ] ;
+} preg_byteset ;
+
+#define BYTESET_HAS(s,c) ((s)->bits[ (c) >> 3 ] & (1 << ((c) & 7)))
+#define BYTESET_ADD(s,c) ((s)->bits[ (c) >> 3 ] |= (1 << ((c) & 7)))
+
+struct preg_nfa_state {
+    int set ;                   /* byte set for the transition, -1 if none */
+    int out ;                   /* target of the byte transition */
+    int eps[ 2 ] ;              /* epsilon transitions, -1 if none */
+    char accept ;               /* is this an accepting state? */
+};
+
+struct preg_automaton_s {
+    struct preg_nfa_state *states ;
+    int nstates ;
+    int maxstates ;
+    preg_byteset *sets ;
+    int nsets ;
+    int maxsets ;
+    int start ;
+    int accept_all ;            /* accepting state that accepts any suffix */
+};
+
+/*
+ * A piece of the NFA under construction.  end never has transitions yet.
+ */
+struct preg_frag {
+    int start ;
+    int end ;
+};
+
+struct preg_parser {
+    preg_automaton *a ;
+    const char *p ;             /* current position in the pattern */
+    const char *end ;           /* end of the pattern */
+    int options ;               /* pcre_compile options */
+    const char *unsupported ;   /* why parsing stopped - NULL if it didn't */
+};
+
+/*
+ * A lazily built DFA for one NFA.
+ */
+struct preg_dfa {
+    preg_automaton *nfa ;
+    int nwords ;                /* words in a set of NFA states */
+    unsigned int *sets ;        /* the NFA states of each DFA state */
+    char *accept ;              /* is the DFA state accepting? */
+    char *dead ;                /* is the DFA state empty? */
+    int *trans ;                /* nclasses transitions per state, -1 = todo */
+    int nclasses ;
+    const int *rep ;            /* a byte that represents each class */
+    int n ;                     /* number of DFA states */
+    int *hash ;                 /* open addressing table of DFA states */
+    unsigned int *work ;        /* scratch set */
+    int *stack ;                /* scratch stack for closures */
+};
+
+#define DFA_HASH_SIZE ( 2 * PREG_AUTOMATON_MAX_DFA_STATES )
+#define PAIR_HASH_SIZE ( 2 * PREG_AUTOMATON_MAX_PAIRS )
+
+static struct preg_frag parseAlternation( struct preg_parser *pc ) ;
+
+
+/*
+ * NFA construction:
+ */
+
+static int nfaNewState( struct preg_parser *pc ) 
+{
+    preg_automaton *a = pc->a ;
+    struct preg_nfa_state *states ;
+    int n ;
+
+    if( a->nstates >= a->maxstates )
+    {
+        n = a->maxstates * 2 ;
+        if( a->nstates >= PREG_AUTOMATON_MAX_NFA_STATES || 
+            !(states = realloc( a->states , n * sizeof(*states))) )
+        {
+            if( !pc->unsupported ) 
+                pc->unsupported = "pattern is too big" ;
+            return 0 ;
+        }
+        a->states = states ;
+        a->maxstates = n ;
+    }
+
+    n = a->nstates++ ;
+    a->states[n].set = -1 ;
+    a->states[n].out = -1 ;
+    a->states[n].eps[0] = -1 ;
+    a->states[n].eps[1] = -1 ;
+    a->states[n].accept = 0 ;
+    return n ;
+}
+
+static int nfaNewSet( struct preg_parser *pc , const preg_byteset *set ) 
+{
+    preg_automaton *a = pc->a ;
+    preg_byteset *sets ;
+    int i ;
+
+    // Patterns tend to reuse the same sets (ie. letters in caseless mode)
+    for( i = 0 ; i < a->nsets ; i++ )
+    {
+        if( !memcmp( &a->sets[i] , set , sizeof(*set) ) )
+            return i ;
+    }
+
+    if( a->nsets >= a->maxsets )
+    {
+        i = a->maxsets * 2 ;
+        if( !(sets = realloc( a->sets , i * sizeof(*sets))) )
+        {
+            if( !pc->unsupported ) 
+                pc->unsupported = "out of memory" ;
+            return 0 ;
+        }
+        a->sets = sets ;
+        a->maxsets = i ;
+    }
+
+    a->sets[ a->nsets ] = *set ;
+    return a->nsets++ ;
+}
+
+/*
+ * add an epsilon transition from -> to
+ */
+static void nfaLink( struct preg_parser *pc , int from , int to )
+{
+    struct preg_nfa_state *st ;
+    int n ;
+
+    st = &pc->a->states[ from ] ;
+    if( st->eps[0] < 0 )
+        st->eps[0] = to ;
+    else if( st->eps[1] < 0 )
+        st->eps[1] = to ;
+    else
+    {
+        // both are used.  Chain another state in.
+        n = nfaNewState( pc ) ;
+        st = &pc->a->states[ from ] ; // states may have moved
+        pc->a->states[n].eps[0] = st->eps[1] ;
+        pc->a->states[n].eps[1] = to ;
+        st->eps[1] = n ;
+    }
+}
+
+static struct preg_frag fragEmpty( struct preg_parser *pc )
+{
+    struct preg_frag f ;
+
+    f.start = f.end = nfaNewState( pc ) ;
+    return f ;
+}
+
+static struct preg_frag fragSet( struct preg_parser *pc , 
+                                 const preg_byteset *set )
+{
+    struct preg_frag f ;
+    int s ;
+
+    f.start = nfaNewState( pc ) ;
+    f.end = nfaNewState( pc ) ;
+    s = nfaNewSet( pc , set ) ;
+    pc->a->states[ f.start ].set = s ;
+    pc->a->states[ f.start ].out = f.end ;
+    return f ;
+}
+
+static struct preg_frag fragConcat( struct preg_parser *pc , 
+                                    struct preg_frag f1 , struct preg_frag f2 )
+{
+    struct preg_frag f ;
+
+    nfaLink( pc , f1.end , f2.start ) ;
+    f.start = f1.start ;
+    f.end = f2.end ;
+    return f ;
+}
+
+static struct preg_frag fragAlt( struct preg_parser *pc , 
+                                 struct preg_frag f1 , struct preg_frag f2 )
+{
+    struct preg_frag f ;
+
+    f.start = nfaNewState( pc ) ;
+    f.end = nfaNewState( pc ) ;
+    nfaLink( pc , f.start , f1.start ) ;
+    nfaLink( pc , f.start , f2.start ) ;
+    nfaLink( pc , f1.end , f.end ) ;
+    nfaLink( pc , f2.end , f.end ) ;
+    return f ;
+}
+
+static struct preg_frag fragStar( struct preg_parser *pc , struct preg_frag f1 )
+{
+    struct preg_frag f ;
+
+    f.start = nfaNewState( pc ) ;
+    f.end = nfaNewState( pc ) ;
+    nfaLink( pc , f.start , f1.start ) ;
+    nfaLink( pc , f.start , f.end ) ;
+    nfaLink( pc , f1.end , f1.start ) ;
+    nfaLink( pc , f1.end , f.end ) ;
+    return f ;
+}
+
+static struct preg_frag fragPlus( struct preg_parser *pc , struct preg_frag f1 )
+{
+    struct preg_frag f ;
+
+    f.start = f1.start ;
+    f.end = nfaNewState( pc ) ;
+    nfaLink( pc , f1.end , f1.start ) ;
+    nfaLink( pc , f1.end , f.end ) ;
+    return f ;
+}
+
+static struct preg_frag fragOpt( struct preg_parser *pc , struct preg_frag f1 )
+{
+    struct preg_frag f ;
+
+    f.start = nfaNewState( pc ) ;
+    f.end = nfaNewState( pc ) ;
+    nfaLink( pc , f.start , f1.start ) ;
+    nfaLink( pc , f.start , f.end ) ;
+    nfaLink( pc , f1.end , f.end ) ;
+    return f ;
+}
+
+
+/*
+ * Byte sets:
+ */
+
+static void bytesetRange( preg_byteset *set , int lo , int hi )
+{
+    for( ; lo <= hi ; lo++ ) 
+        BYTESET_ADD( set , lo ) ;
+}
+
+static void bytesetNegate( preg_byteset *set )
+{
+    int i ;
+
+    for( i = 0 ; i < 32 ; i++ )
+        set->bits[i] = ~set->bits[i] ;
+}
+
+static void bytesetMerge( preg_byteset *set , const preg_byteset *other )
+{
+    int i ;
+
+    for( i = 0 ; i < 32 ; i++ )
+        set->bits[i] |= other->bits[i] ;
+}
+
+/*
+ * make the set caseless.  Without locale tables pcre only folds ascii.
+ */
+static void bytesetFold( preg_byteset *set )
+{
+    int c ;
+
+    for( c = 'a' ; c <= 'z' ; c++ )
+    {
+        if( BYTESET_HAS( set , c ) || BYTESET_HAS( set , c - 32 ) )
+        {
+            BYTESET_ADD( set , c ) ;
+            BYTESET_ADD( set , c - 32 ) ;
+        }
+    }
+}
+
+static void bytesetDot( preg_byteset *set , int options )
+{
+    memset( set , 0xff , sizeof(*set) ) ;
+    if( !(options & PCRE_DOTALL) )
+        set->bits[ '\n' >> 3 ] &= ~(1 << ('\n' & 7)) ;
+}
+
+/*
+ * Named sets.  Used for the \d style escapes and [:posix:] classes.
+ */
+static int bytesetNamed( preg_byteset *set , const char *name , int l )
+{
+    memset( set , 0 , sizeof(*set) ) ;
+
+#define NAMED(n) ( l == sizeof(n) - 1 && !strncmp( name , n , l ) )
+    if( NAMED( "digit" ) )
+        bytesetRange( set , '0' , '9' ) ;
+    else if( NAMED( "alpha" ) )
+    {
+        bytesetRange( set , 'a' , 'z' ) ;
+        bytesetRange( set , 'A' , 'Z' ) ;
+    }
+    else if( NAMED( "alnum" ) )
+    {
+        bytesetNamed( set , "alpha" , 5 ) ;
+        bytesetRange( set , '0' , '9' ) ;
+    }
+    else if( NAMED( "word" ) )
+    {
+        bytesetNamed( set , "alnum" , 5 ) ;
+        BYTESET_ADD( set , '_' ) ;
+    }
+    else if( NAMED( "upper" ) )
+        bytesetRange( set , 'A' , 'Z' ) ;
+    else if( NAMED( "lower" ) )
+        bytesetRange( set , 'a' , 'z' ) ;
+    else if( NAMED( "xdigit" ) )
+    {
+        bytesetRange( set , '0' , '9' ) ;
+        bytesetRange( set , 'a' , 'f' ) ;
+        bytesetRange( set , 'A' , 'F' ) ;
+    }
+    else if( NAMED( "space" ) )
+    {
+        bytesetRange( set , '\t' , '\r' ) ;
+        BYTESET_ADD( set , ' ' ) ;
+    }
+    else if( NAMED( "blank" ) )
+    {
+        BYTESET_ADD( set , '\t' ) ;
+        BYTESET_ADD( set , ' ' ) ;
+    }
+    else if( NAMED( "horizontal" ) )
+    {
+        BYTESET_ADD( set , '\t' ) ;
+        BYTESET_ADD( set , ' ' ) ;
+        BYTESET_ADD( set , 0xa0 ) ;
+    }
+    else if( NAMED( "vertical" ) )
+    {
+        bytesetRange( set , '\n' , '\r' ) ;
+        BYTESET_ADD( set , 0x85 ) ;
+    }
+    else if( NAMED( "cntrl" ) )
+    {
+        bytesetRange( set , 0 , 31 ) ;
+        BYTESET_ADD( set , 127 ) ;
+    }
+    else if( NAMED( "print" ) )
+        bytesetRange( set , 32 , 126 ) ;
+    else if( NAMED( "graph" ) )
+        bytesetRange( set , 33 , 126 ) ;
+    else if( NAMED( "punct" ) )
+    {
+        bytesetRange( set , 33 , 47 ) ;
+        bytesetRange( set , 58 , 64 ) ;
+        bytesetRange( set , 91 , 96 ) ;
+        bytesetRange( set , 123 , 126 ) ;
+    }
+    else if( NAMED( "ascii" ) )
+        bytesetRange( set , 0 , 127 ) ;
+    else
+        return 0 ;
+#undef NAMED
+
+    return 1 ;
+}
+
+
+/*
+ * Parsing:
+ */
+
+/*
+ * skip white space and comments in extended (x) mode
+ */
+static void parseSkipExtended( struct preg_parser *pc )
+{
+    if( !(pc->options & PCRE_EXTENDED) )
+        return ;
+
+    while( pc->p < pc->end )
+    {
+        if( isspace( (unsigned char)*pc->p ) )
+            pc->p++ ;
+        else if( *pc->p == '#' )
+        {
+            while( pc->p < pc->end && *pc->p != '\n' )
+                pc->p++ ;
+        }
+        else
+            break ;
+    }
+}
+
+static int hexValue( int c )
+{
+    if( c >= '0' && c <= '9' ) return c - '0' ;
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10 ;
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10 ;
+    return -1 ;
+}
+
+/*
+ * Parse a backslash escape.  pc->p points at the backslash.
+ *
+ * returns 1 - if it is a single byte, which is put in *ch
+ * returns 2 - if it is a set of bytes, which is put in set
+ * returns 0 - if it is not supported
+ */
+static int parseEscape( struct preg_parser *pc , preg_byteset *set , 
+                        int inclass , int *ch )
+{
+    const char *name = NULL ;
+    int c ;
+    int i , v ;
+
+    if( pc->p + 1 >= pc->end )
+    {
+        pc->unsupported = "trailing backslash" ;
+        return 0 ;
+    }
+
+    c = (unsigned char)pc->p[1] ;
+    pc->p += 2 ;
+
+    switch( c )
+    {
+    case 'd': case 'D': name = "digit" ; break ;
+    case 'w': case 'W': name = "word" ; break ;
+    case 's': case 'S': name = "space" ; break ;
+    case 'h': case 'H': name = "horizontal" ; break ;
+    case 'v': case 'V': name = "vertical" ; break ;
+    case 'N': 
+        if( inclass )
+            break ;
+        bytesetDot( set , pc->options & ~PCRE_DOTALL ) ;
+        return 2 ;
+
+    case 'n': *ch = '\n' ; return 1 ;
+    case 'r': *ch = '\r' ; return 1 ;
+    case 't': *ch = '\t' ; return 1 ;
+    case 'f': *ch = '\f' ; return 1 ;
+    case 'e': *ch = 0x1b ; return 1 ;
+    case 'a': *ch = 0x07 ; return 1 ;
+    case 'b': 
+        if( inclass ) 
+        {
+            *ch = '\b' ; 
+            return 1 ;
+        }
+        break ;
+
+    case 'c':
+        if( pc->p >= pc->end )
+            break ;
+        *ch = toupper( (unsigned char)*pc->p++ ) ^ 0x40 ;
+        return 1 ;
+
+    case 'x':
+        v = 0 ;
+        if( pc->p < pc->end && *pc->p == '{' )
+        {
+            for( pc->p++ ; pc->p < pc->end && *pc->p != '}' ; pc->p++ )
+            {
+                if( (i = hexValue( *pc->p )) < 0 || (v = v * 16 + i) > 255 )
+                {
+                    pc->unsupported = "\\x{} beyond 255" ;
+                    return 0 ;
+                }
+            }
+            pc->p++ ;
+        }
+        else
+        {
+            for( i = 0 ; i < 2 && pc->p < pc->end && 
+                     hexValue( *pc->p ) >= 0 ; i++ )
+                v = v * 16 + hexValue( *pc->p++ ) ;
+        }
+        *ch = v ;
+        return 1 ;
+
+    case '0':
+        v = 0 ;
+        for( i = 0 ; i < 2 && pc->p < pc->end && 
+                 *pc->p >= '0' && *pc->p <= '7' ; i++ )
+            v = v * 8 + (*pc->p++ - '0') ;
+        *ch = v ;
+        return 1 ;
+
+    default:
+        if( !isalnum( c ) )
+        {
+            *ch = c ;
+            return 1 ;
+        }
+        break ;
+    }
+
+    if( !name )
+    {
+        // backreferences, \b, \p, \Q, \G, ... 
+        pc->unsupported = "unsupported escape sequence" ;
+        return 0 ;
+    }
+
+    bytesetNamed( set , name , strlen( name ) ) ;
+    if( isupper( c ) )
+        bytesetNegate( set ) ;
+    return 2 ;
+}
+
+/*
+ * Parse a [...] class.  pc->p points at the [
+ */
+static int parseClass( struct preg_parser *pc , preg_byteset *set )
+{
+    preg_byteset tmp ;
+    const char *colon ;
+    int first = 1 ;
+    int hi , lo ;
+    int neg = 0 ;
+    int r ;
+
+    memset( set , 0 , sizeof(*set) ) ;
+
+    pc->p++ ;
+    if( pc->p < pc->end && *pc->p == '^' )
+    {
+        neg = 1 ;
+        pc->p++ ;
+    }
+
+    while( 1 )
+    {
+        if( pc->p >= pc->end )
+        {
+            pc->unsupported = "missing ]" ;
+            return 0 ;
+        }
+
+        if( *pc->p == ']' && !first )
+        {
+            pc->p++ ;
+            break ;
+        }
+        first = 0 ;
+
+        // [:posix:] names
+        if( *pc->p == '[' && pc->p + 1 < pc->end && pc->p[1] == ':' )
+        {
+            pc->p += 2 ;
+            r = 0 ;
+            if( pc->p < pc->end && *pc->p == '^' )
+            {
+                r = 1 ;
+                pc->p++ ;
+            }
+            colon = pc->p ;
+            while( colon + 1 < pc->end && !(colon[0] == ':' && colon[1] == ']'))
+                colon++ ;
+            if( colon + 1 >= pc->end || 
+                !bytesetNamed( &tmp , pc->p , colon - pc->p ) )
+            {
+                pc->unsupported = "unsupported posix class" ;
+                return 0 ;
+            }
+            if( r )
+                bytesetNegate( &tmp ) ;
+            bytesetMerge( set , &tmp ) ;
+            pc->p = colon + 2 ;
+            continue ;
+        }
+
+        if( *pc->p == '\\' )
+        {
+            memset( &tmp , 0 , sizeof(tmp) ) ;
+            r = parseEscape( pc , &tmp , 1 , &lo ) ;
+            if( !r )
+                return 0 ;
+            if( r == 2 )
+            {
+                bytesetMerge( set , &tmp ) ;
+                continue ;
+            }
+        }
+        else
+        {
+            lo = (unsigned char)*pc->p++ ;
+        }
+
+        // a range?
+        if( pc->p + 1 < pc->end && *pc->p == '-' && pc->p[1] != ']' )
+        {
+            pc->p++ ;
+            if( *pc->p == '\\' )
+            {
+                if( parseEscape( pc , &tmp , 1 , &hi ) != 1 )
+                {
+                    pc->unsupported = "unsupported class range" ;
+                    return 0 ;
+                }
+            }
+            else if( *pc->p == '[' )
+            {
+                pc->unsupported = "unsupported class range" ;
+                return 0 ;
+            }
+            else
+            {
+                hi = (unsigned char)*pc->p++ ;
+            }
+
+            if( hi < lo )
+            {
+                pc->unsupported = "bad class range" ;
+                return 0 ;
+            }
+            bytesetRange( set , lo , hi ) ;
+        }
+        else
+        {
+            BYTESET_ADD( set , lo ) ;
+        }
+    }
+
+    if( pc->options & PCRE_CASELESS )
+        bytesetFold( set ) ;
+    if( neg )
+        bytesetNegate( set ) ;
+
+    return 1 ;
+}
+
+/*
+ * Parse a single item that can be quantified
+ */
+static struct preg_frag parseAtom( struct preg_parser *pc )
+{
+    struct preg_frag f ;
+    preg_byteset set ;
+    const char *p ;
+    int c ;
+    int r ;
+
+    memset( &set , 0 , sizeof(set) ) ;
+    c = (unsigned char)*pc->p ;
+
+    switch( c )
+    {
+    case '(':
+        p = ++pc->p ;
+        if( p < pc->end && *p == '*' )
+        {
+            pc->unsupported = "backtracking control verb" ;
+            return fragEmpty( pc ) ;
+        }
+        if( p < pc->end && *p == '?' )
+        {
+            p++ ;
+            if( p < pc->end && *p == ':' )
+                p++ ;
+            else if( p < pc->end && *p == '#' )
+            {
+                // a comment
+                while( p < pc->end && *p != ')' )
+                    p++ ;
+                pc->p = p + 1 ;
+                return fragEmpty( pc ) ;
+            }
+            else if( p + 1 < pc->end && 
+                     ((*p == '<' && p[1] != '=' && p[1] != '!') ||
+                      (*p == 'P' && p[1] == '<') || *p == '\'') )
+            {
+                // named group - the name doesn't matter here
+                c = ( *p == '\'' ) ? '\'' : '>' ;
+                p += ( *p == 'P' ) ? 2 : 1 ;    // past ' or < or P<
+                while( p < pc->end && *p != c )
+                    p++ ;
+                p++ ;
+            }
+            else
+            {
+                // lookarounds, atomic groups, inline options, recursion,...
+                pc->unsupported = "unsupported group" ;
+                return fragEmpty( pc ) ;
+            }
+        }
+        pc->p = p ;
+        f = parseAlternation( pc ) ;
+        if( pc->p >= pc->end || *pc->p != ')' )
+        {
+            if( !pc->unsupported )
+                pc->unsupported = "missing )" ;
+            return f ;
+        }
+        pc->p++ ;
+        return f ;
+
+    case '[':
+        if( !parseClass( pc , &set ) )
+            return fragEmpty( pc ) ;
+        return fragSet( pc , &set ) ;
+
+    case '.':
+        pc->p++ ;
+        bytesetDot( &set , pc->options ) ;
+        return fragSet( pc , &set ) ;
+
+    case '\\':
+        r = parseEscape( pc , &set , 0 , &c ) ;
+        if( !r )
+            return fragEmpty( pc ) ;
+        if( r == 2 )
+            return fragSet( pc , &set ) ;
+        break ;
+
+    case '*': case '+': case '?':
+        pc->unsupported = "nothing to repeat" ;
+        return fragEmpty( pc ) ;
+
+    default:
+        pc->p++ ;
+        break ;
+    }
+
+    // a single (literal) byte
+    BYTESET_ADD( &set , c ) ;
+    if( pc->options & PCRE_CASELESS )
+        bytesetFold( &set ) ;
+    return fragSet( pc , &set ) ;
+}
+
+/*
+ * Parse a {n}, {n,} or {n,m} quantifier.  If it isn't one, it is a 
+ * literal { and 0 is returned.
+ */
+static int parseBraces( struct preg_parser *pc , int *min , int *max )
+{
+    const char *p = pc->p + 1 ;
+    int n = 0 , m ;
+
+    if( p >= pc->end || !isdigit( (unsigned char)*p ) )
+        return 0 ;
+    while( p < pc->end && isdigit( (unsigned char)*p ) )
+        n = n * 10 + ( *p++ - '0' ) ;
+
+    if( p < pc->end && *p == '}' )
+        m = n ;
+    else if( p < pc->end && *p == ',' )
+    {
+        p++ ;
+        if( p < pc->end && *p == '}' )
+            m = -1 ;
+        else
+        {
+            if( p >= pc->end || !isdigit( (unsigned char)*p ) )
+                return 0 ;
+            for( m = 0 ; p < pc->end && isdigit( (unsigned char)*p ) ; p++ )
+                m = m * 10 + ( *p - '0' ) ;
+            if( p >= pc->end || *p != '}' )
+                return 0 ;
+        }
+    }
+    else
+        return 0 ;
+
+    *min = n ;
+    *max = m ;
+    pc->p = p + 1 ;
+    return 1 ;
+}
+
+/*
+ * Parse an atom and an optional quantifier.  Counted repeats are built 
+ * by parsing the atom again for each copy that is needed.
+ */
+static struct preg_frag parseQuantified( struct preg_parser *pc )
+{
+    struct preg_frag f , g ;
+    const char *atom ;          /* start of the atom */
+    const char *after ;         /* just after the quantifier */
+    int i ;
+    int min , max ;
+
+    atom = pc->p ;
+    f = parseAtom( pc ) ;
+    if( pc->unsupported )
+        return f ;
+
+    parseSkipExtended( pc ) ;
+    if( pc->p >= pc->end )
+        return f ;
+
+    switch( *pc->p )
+    {
+    case '*': min = 0 ; max = -1 ; pc->p++ ; break ;
+    case '+': min = 1 ; max = -1 ; pc->p++ ; break ;
+    case '?': min = 0 ; max = 1 ; pc->p++ ; break ;
+    case '{':
+        if( parseBraces( pc , &min , &max ) ) 
+            break ;
+        // fall through - it's a literal {
+    default:
+        return f ;
+    }
+
+    if( pc->p < pc->end && *pc->p == '+' )
+    {
+        pc->unsupported = "possessive quantifier" ;
+        return f ;
+    }
+    if( pc->p < pc->end && *pc->p == '?' )
+        pc->p++ ;           // lazy or greedy matches the same subjects
+
+    if( min > PREG_AUTOMATON_MAX_NFA_STATES || 
+        max > PREG_AUTOMATON_MAX_NFA_STATES )
+    {
+        pc->unsupported = "pattern is too big" ;
+        return f ;
+    }
+
+    after = pc->p ;
+
+    // f is the first copy.  Re-parse the atom for each of the others.
+#define NEXT_COPY() ( i++ ? ( pc->p = atom , parseAtom( pc ) ) : f )
+    i = 0 ;
+    g = fragEmpty( pc ) ;
+    while( min > ( max < 0 ? 1 : 0 ) && !pc->unsupported )
+    {
+        g = fragConcat( pc , g , NEXT_COPY() ) ;
+        min-- ;
+        if( max > 0 ) 
+            max-- ;
+    }
+    if( max < 0 )
+    {
+        if( min )
+            g = fragConcat( pc , g , fragPlus( pc , NEXT_COPY() ) ) ;
+        else
+            g = fragConcat( pc , g , fragStar( pc , NEXT_COPY() ) ) ;
+    }
+    else
+    {
+        for( ; max > 0 && !pc->unsupported ; max-- )
+            g = fragConcat( pc , g , fragOpt( pc , NEXT_COPY() ) ) ;
+    }
+#undef NEXT_COPY
+
+    pc->p = after ;
+    return g ;
+}
+
+/*
+ * Parse a sequence of quantified atoms up to a | or ).  Anchors are only 
+ * understood at the start and end of the top level alternatives.
+ */
+static struct preg_frag parseSequence( struct preg_parser *pc , int toplevel,
+                                       int *anchor_start , int *anchor_end )
+{
+    struct preg_frag f ;
+    int natoms = 0 ;
+    int c , type ;
+
+    f = fragEmpty( pc ) ;
+
+    while( !pc->unsupported )
+    {
+        parseSkipExtended( pc ) ;
+        if( pc->p >= pc->end || *pc->p == '|' || *pc->p == ')' )
+            break ;
+
+        c = (unsigned char)*pc->p ;
+        if( c == '\\' && pc->p + 1 < pc->end )
+            c = (unsigned char)pc->p[1] | 0x100 ;
+
+        if( c == '^' || c == ('A' | 0x100) )
+        {
+            if( !toplevel || natoms || 
+                (c == '^' && (pc->options & PCRE_MULTILINE)) )
+            {
+                pc->unsupported = "unsupported anchor" ;
+                break ;
+            }
+            *anchor_start = 1 ;
+            pc->p += ( c == '^' ) ? 1 : 2 ;
+            continue ;
+        }
+
+        if( c == '$' || c == ('z' | 0x100) || c == ('Z' | 0x100) )
+        {
+            if( c == '$' )
+                type = ( pc->options & PCRE_DOLLAR_ENDONLY ) ? 
+                    ANCHOR_END : ANCHOR_DOLLAR ;
+            else
+                type = ( c == ('z' | 0x100) ) ? ANCHOR_END : ANCHOR_DOLLAR ;
+            pc->p += ( c == '$' ) ? 1 : 2 ;
+            parseSkipExtended( pc ) ;
+            if( !toplevel || (c == '$' && (pc->options & PCRE_MULTILINE)) ||
+                (pc->p < pc->end && *pc->p != '|') )
+            {
+                pc->unsupported = "unsupported anchor" ;
+                break ;
+            }
+            *anchor_end = type ;
+            break ;
+        }
+
+        f = fragConcat( pc , f , parseQuantified( pc ) ) ;
+        natoms++ ;
+    }
+
+    return f ;
+}
+
+static struct preg_frag parseAlternation( struct preg_parser *pc )
+{
+    struct preg_frag f ;
+
+    f = parseSequence( pc , 0 , NULL , NULL ) ;
+    while( !pc->unsupported && pc->p < pc->end && *pc->p == '|' )
+    {
+        pc->p++ ;
+        f = fragAlt( pc , f , parseSequence( pc , 0 , NULL , NULL ) ) ;
+    }
+    return f ;
+}
+
+
+/*
+ * Lazy DFAs:
+ */
+
+static int dfaInit( struct preg_dfa *d , preg_automaton *nfa , 
+                    int nclasses , const int *rep )
+{
+    memset( d , 0 , sizeof(*d) ) ;
+    d->nfa = nfa ;
+    d->nwords = ( nfa->nstates + 31 ) / 32 ;
+    d->nclasses = nclasses ;
+    d->rep = rep ;
+
+    d->sets = malloc( sizeof(unsigned int) * d->nwords * 
+                      PREG_AUTOMATON_MAX_DFA_STATES ) ;
+    d->accept = malloc( PREG_AUTOMATON_MAX_DFA_STATES ) ;
+    d->dead = malloc( PREG_AUTOMATON_MAX_DFA_STATES ) ;
+    d->trans = malloc( sizeof(int) * nclasses * PREG_AUTOMATON_MAX_DFA_STATES);
+    d->hash = malloc( sizeof(int) * DFA_HASH_SIZE ) ;
+    d->work = malloc( sizeof(unsigned int) * d->nwords ) ;
+    d->stack = malloc( sizeof(int) * nfa->nstates ) ;
+
+    if( !d->sets || !d->accept || !d->dead || !d->trans || !d->hash || 
+        !d->work || !d->stack )
+        return 0 ;
+
+    memset( d->hash , -1 , sizeof(int) * DFA_HASH_SIZE ) ;
+    return 1 ;
+}
+
+static void dfaFree( struct preg_dfa *d )
+{
+    free( d->sets ) ;
+    free( d->accept ) ;
+    free( d->dead ) ;
+    free( d->trans ) ;
+    free( d->hash ) ;
+    free( d->work ) ;
+    free( d->stack ) ;
+}
+
+#define SET_HAS(w,i) ((w)[ (i) >> 5 ] & (1u << ((i) & 31)))
+#define SET_ADD(w,i) ((w)[ (i) >> 5 ] |= (1u << ((i) & 31)))
+
+/*
+ * add everything reachable by epsilon transitions to d->work
+ */
+static void dfaClosure( struct preg_dfa *d )
+{
+    struct preg_nfa_state *st ;
+    int i , j , s ;
+    int top = 0 ;
+
+    for( i = 0 ; i < d->nfa->nstates ; i++ )
+    {
+        if( SET_HAS( d->work , i ) )
+            d->stack[ top++ ] = i ;
+    }
+
+    while( top )
+    {
+        st = &d->nfa->states[ d->stack[ --top ] ] ;
+        for( j = 0 ; j < 2 ; j++ )
+        {
+            s = st->eps[j] ;
+            if( s >= 0 && !SET_HAS( d->work , s ) )
+            {
+                SET_ADD( d->work , s ) ;
+                d->stack[ top++ ] = s ;
+            }
+        }
+    }
+}
+
+/*
+ * find or add the DFA state for the NFA states in d->work
+ *
+ * returns the state number or -1 if there are too many states
+ */
+static int dfaIntern( struct preg_dfa *d )
+{
+    unsigned int h = 2166136261u ;
+    unsigned int *set ;
+    int i , n ;
+
+    // Once an unanchored match is found nothing else matters, so all of
+    // those states are the same.  This keeps the DFAs of searches small.
+    if( SET_HAS( d->work , d->nfa->accept_all ) )
+    {
+        memset( d->work , 0 , sizeof(unsigned int) * d->nwords ) ;
+        SET_ADD( d->work , d->nfa->accept_all ) ;
+    }
+
+    for( i = 0 ; i < d->nwords ; i++ )
+        h = ( h ^ d->work[i] ) * 16777619u ;
+
+    for( i = h % DFA_HASH_SIZE ; d->hash[i] >= 0 ; i = (i + 1) % DFA_HASH_SIZE )
+    {
+        if( !memcmp( d->sets + d->hash[i] * d->nwords , d->work , 
+                     sizeof(unsigned int) * d->nwords ) )
+            return d->hash[i] ;
+    }
+
+    if( d->n >= PREG_AUTOMATON_MAX_DFA_STATES )
+        return -1 ;
+
+    n = d->n++ ;
+    d->hash[i] = n ;
+    set = d->sets + n * d->nwords ;
+    memcpy( set , d->work , sizeof(unsigned int) * d->nwords ) ;
+    memset( d->trans + n * d->nclasses , -1 , sizeof(int) * d->nclasses ) ;
+
+    d->accept[n] = 0 ;
+    d->dead[n] = 1 ;
+    for( i = 0 ; i < d->nfa->nstates ; i++ )
+    {
+        if( SET_HAS( set , i ) )
+        {
+            d->dead[n] = 0 ;
+            if( d->nfa->states[i].accept )
+                d->accept[n] = 1 ;
+        }
+    }
+
+    return n ;
+}
+
+static int dfaStart( struct preg_dfa *d )
+{
+    memset( d->work , 0 , sizeof(unsigned int) * d->nwords ) ;
+    SET_ADD( d->work , d->nfa->start ) ;
+    dfaClosure( d ) ;
+    return dfaIntern( d ) ;
+}
+
+static int dfaNext( struct preg_dfa *d , int state , int cls )
+{
+    struct preg_nfa_state *st ;
+    unsigned int *set ;
+    int c , i ;
+    int *t ;
+
+    t = d->trans + state * d->nclasses + cls ;
+    if( *t >= 0 )
+        return *t ;
+
+    c = d->rep[ cls ] ;
+    set = d->sets + state * d->nwords ;
+    memset( d->work , 0 , sizeof(unsigned int) * d->nwords ) ;
+    for( i = 0 ; i < d->nfa->nstates ; i++ )
+    {
+        if( !SET_HAS( set , i ) )
+            continue ;
+        st = &d->nfa->states[i] ;
+        if( st->set >= 0 && BYTESET_HAS( &d->nfa->sets[ st->set ] , c ) )
+            SET_ADD( d->work , st->out ) ;
+    }
+    dfaClosure( d ) ;
+
+    // d->trans may not be touched by dfaIntern for this state
+    *t = dfaIntern( d ) ;
+    return *t ;
+}
+
+/*
+ * Split the bytes into classes that no set of either automaton can 
+ * tell apart.  Returns the number of classes.
+ */
+static int byteClasses( preg_automaton *a1 , preg_automaton *a2 , 
+                        int *cls , int *rep )
+{
+    preg_automaton *a ;
+    int map[ 2 ][ 256 ] ;
+    int b , i , k , m ;
+    int n = 1 ;
+
+    memset( cls , 0 , sizeof(int) * 256 ) ;
+    for( k = 0 ; k < 2 ; k++ )
+    {
+        a = k ? a2 : a1 ;
+        for( i = 0 ; i < a->nsets ; i++ )
+        {
+            memset( map , -1 , sizeof(map) ) ;
+            n = 0 ;
+            for( b = 0 ; b < 256 ; b++ )
+            {
+                m = BYTESET_HAS( &a->sets[i] , b ) ? 1 : 0 ;
+                if( map[m][ cls[b] ] < 0 )
+                    map[m][ cls[b] ] = n++ ;
+                cls[b] = map[m][ cls[b] ] ;
+            }
+        }
+    }
+
+    for( b = 255 ; b >= 0 ; b-- )
+        rep[ cls[b] ] = b ;
+
+    return n ;
+}
+
+/*
+ * Explore the product of the DFAs of a1 and a2.
+ *
+ * PRODUCT_SUBSUMES - returns 0 if a2 accepts something a1 doesn't, else 1
+ * PRODUCT_OVERLAPS - returns 1 if a1 and a2 accept something, else 0
+ * returns -1 if the limits are reached or memory runs out
+ */
+static int automatonProduct( preg_automaton *a1 , preg_automaton *a2 , 
+                             int mode )
+{
+    struct preg_dfa d1 , d2 ;
+    int cls[ 256 ] , rep[ 256 ] ;
+    int *hash = NULL ;
+    int *queue = NULL ;
+    int c , h ;
+    int head = 0 , tail = 0 ;
+    int key ;
+    int nclasses ;
+    int result ;
+    int s1 , s2 , n1 , n2 ;
+
+    nclasses = byteClasses( a1 , a2 , cls , rep ) ;
+
+    result = -1 ;
+    if( !dfaInit( &d1 , a1 , nclasses , rep ) || 
+        !dfaInit( &d2 , a2 , nclasses , rep ) ||
+        !(hash = malloc( sizeof(int) * PAIR_HASH_SIZE )) ||
+        !(queue = malloc( sizeof(int) * PREG_AUTOMATON_MAX_PAIRS )) )
+        goto done ;
+
+    memset( hash , -1 , sizeof(int) * PAIR_HASH_SIZE ) ;
+
+    // result if no counter example is found
+    result = ( mode == PRODUCT_SUBSUMES ) ? 1 : 0 ;
+
+    s1 = dfaStart( &d1 ) ;
+    s2 = dfaStart( &d2 ) ;
+    if( s1 < 0 || s2 < 0 )
+    {
+        result = -1 ;
+        goto done ;
+    }
+    key = ( s1 << 16 ) | s2 ;
+    hash[ ((unsigned int)key * 2654435761u) % PAIR_HASH_SIZE ] = key ;
+    queue[ tail++ ] = key ;
+
+    while( head < tail )
+    {
+        key = queue[ head++ ] ;
+        s1 = key >> 16 ;
+        s2 = key & 0xffff ;
+
+        if( mode == PRODUCT_SUBSUMES ) 
+        {
+            if( d2.accept[s2] && !d1.accept[s1] )
+            {
+                result = 0 ;
+                break ;
+            }
+            // nothing more a2 can accept from here
+            if( d2.dead[s2] )
+                continue ;
+        }
+        else 
+        {
+            if( d1.accept[s1] && d2.accept[s2] )
+            {
+                result = 1 ;
+                break ;
+            }
+            if( d1.dead[s1] || d2.dead[s2] )
+                continue ;
+        }
+
+        for( c = 0 ; c < nclasses ; c++ )
+        {
+            n1 = dfaNext( &d1 , s1 , c ) ;
+            n2 = dfaNext( &d2 , s2 , c ) ;
+            if( n1 < 0 || n2 < 0 )
+            {
+                result = -1 ;
+                goto done ;
+            }
+
+            key = ( n1 << 16 ) | n2 ;
+            for( h = ((unsigned int)key * 2654435761u) % PAIR_HASH_SIZE ; 
+                 hash[h] >= 0 && hash[h] != key ; h = (h + 1) % PAIR_HASH_SIZE )
+                ;
+            if( hash[h] == key )
+                continue ;
+
+            if( tail >= PREG_AUTOMATON_MAX_PAIRS )
+            {
+                result = -1 ;
+                goto done ;
+            }
+            hash[h] = key ;
+            queue[ tail++ ] = key ;
+        }
+    }
+
+done:
+    free( hash ) ;
+    free( queue ) ;
+    dfaFree( &d1 ) ;
+    dfaFree( &d2 ) ;
+
+    return result ;
+}
+
+
+/*
+ * Public functions:
+ */
+
+/**
+ * @fn preg_automaton *pregAutomatonCreate( const char *pattern , 
+ *                                          int coptions , 
+ *                                          char *msg , int msglen )
+ *
+ * @brief build the automaton for a pattern
+ *
+ * @param pattern - null terminated pattern without delimiters or modifiers
+ * (as returned by parseRegex)
+ * @param coptions - the pcre_compile options from the modifiers
+ * @param msg - put the reason here if the pattern is not supported
+ * @param msglen - size of msg
+ *
+ * @return the automaton - on success.  Free it with pregAutomatonFree.
+ * @return NULL - if the pattern uses features that aren't regular or
+ * aren't supported, or memory runs out.
+ *
+ * @details The pattern should have been compiled successfully by pcre
+ * already.  The syntax checks here are not complete.
+ */
+preg_automaton *pregAutomatonCreate( const char *pattern , int coptions , 
+                                     char *msg , int msglen )
+{
+    struct preg_parser pc ;
+    struct preg_frag f ;
+    preg_automaton *a ;
+    preg_byteset set ;
+    int anchor_start , anchor_end ;
+    int fany , fdollar , fend ;
+    int s ;
+
+    if( msglen )
+        *msg = '\0' ;
+
+    if( coptions & PCRE_UTF8 )
+    {
+        strncpy( msg , "UTF-8 patterns are not supported" , msglen ) ;
+        return NULL ;
+    }
+
+    a = calloc( 1 , sizeof(*a) ) ;
+    if( !a )
+    {
+        strncpy( msg , "out of memory" , msglen ) ;
+        return NULL ;
+    }
+    a->maxstates = 64 ;
+    a->maxsets = 16 ;
+    a->states = malloc( a->maxstates * sizeof(*a->states) ) ;
+    a->sets = malloc( a->maxsets * sizeof(*a->sets) ) ;
+    if( !a->states || !a->sets )
+    {
+        strncpy( msg , "out of memory" , msglen ) ;
+        pregAutomatonFree( a ) ;
+        return NULL ;
+    }
+
+    memset( &pc , 0 , sizeof(pc) ) ;
+    pc.a = a ;
+    pc.p = pattern ;
+    pc.end = pattern + strlen( pattern ) ;
+    pc.options = coptions ;
+
+    // The accepting states.  After an unanchored match, anything can follow.
+    memset( &set , 0xff , sizeof(set) ) ;
+    fany = nfaNewState( &pc ) ;
+    a->states[ fany ].set = nfaNewSet( &pc , &set ) ;
+    a->states[ fany ].out = fany ;
+    a->states[ fany ].accept = 1 ;
+    a->accept_all = fany ;
+
+    fend = nfaNewState( &pc ) ;
+    a->states[ fend ].accept = 1 ;
+
+    memset( &set , 0 , sizeof(set) ) ;
+    BYTESET_ADD( &set , '\n' ) ;
+    fdollar = nfaNewState( &pc ) ;
+    a->states[ fdollar ].set = nfaNewSet( &pc , &set ) ;
+    a->states[ fdollar ].out = fend ;
+    a->states[ fdollar ].accept = 1 ;
+
+    a->start = nfaNewState( &pc ) ;
+
+    while( !pc.unsupported )
+    {
+        anchor_start = ( coptions & PCRE_ANCHORED ) ? 1 : 0 ;
+        anchor_end = ANCHOR_NONE ;
+        f = parseSequence( &pc , 1 , &anchor_start , &anchor_end ) ;
+
+        s = f.start ;
+        if( !anchor_start )
+        {
+            // an unanchored match can start anywhere
+            memset( &set , 0xff , sizeof(set) ) ;
+            s = nfaNewState( &pc ) ;
+            a->states[ s ].set = nfaNewSet( &pc , &set ) ;
+            a->states[ s ].out = s ;
+            nfaLink( &pc , s , f.start ) ;
+        }
+        nfaLink( &pc , a->start , s ) ;
+        nfaLink( &pc , f.end , anchor_end == ANCHOR_NONE ? fany : 
+                 anchor_end == ANCHOR_DOLLAR ? fdollar : fend ) ;
+
+        if( pc.p >= pc.end )
+            break ;
+        if( *pc.p != '|' )
+        {
+            if( !pc.unsupported )
+                pc.unsupported = "unmatched )" ;
+            break ;
+        }
+        pc.p++ ;
+    }
+
+    if( pc.unsupported )
+    {
+        strncpy( msg , pc.unsupported , msglen ) ;
+        pregAutomatonFree( a ) ;
+        return NULL ;
+    }
+
+    return a ;
+}
+
+/**
+ * @fn void pregAutomatonFree( preg_automaton *a )
+ *
+ * @brief free an automaton created by pregAutomatonCreate
+ */
+void pregAutomatonFree( preg_automaton *a )
+{
+    if( a )
+    {
+        free( a->states ) ;
+        free( a->sets ) ;
+        free( a ) ;
+    }
+}
+
+/**
+ * @fn int pregAutomatonSubsumes( preg_automaton *a1 , preg_automaton *a2 )
+ *
+ * @brief does a1 match every subject that a2 matches?
+ *
+ * @return 1 - yes
+ * @return 0 - no
+ * @return -1 - unknown, because the automata are too big
+ */
+int pregAutomatonSubsumes( preg_automaton *a1 , preg_automaton *a2 )
+{
+    return automatonProduct( a1 , a2 , PRODUCT_SUBSUMES ) ;
+}
+
+/**
+ * @fn int pregAutomatonOverlaps( preg_automaton *a1 , preg_automaton *a2 )
+ *
+ * @brief is there a subject that both a1 and a2 match?
+ *
+ * @return 1 - yes
+ * @return 0 - no
+ * @return -1 - unknown, because the automata are too big
+ */
+int pregAutomatonOverlaps( preg_automaton *a1 , preg_automaton *a2 )
+{
+    return automatonProduct( a1 , a2 , PRODUCT_OVERLAPS ) ;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREG_AUTOMATON_H
+#define PREG_AUTOMATON_H
+
+/** @file preg_automaton.h
+ *  
+ * @brief headers for the finite automaton used to compare patterns
+ */
+
+// Include the libpcre headers (for the PCRE_ option flags)
+#include <pcre.h>
+
+// Limits that keep the comparisons cheap.  Patterns or products that are
+// bigger than this are reported as unknown.
+#define PREG_AUTOMATON_MAX_NFA_STATES 4096
+#define PREG_AUTOMATON_MAX_DFA_STATES 2048
+#define PREG_AUTOMATON_MAX_PAIRS      65536
+
+typedef struct preg_automaton_s preg_automaton ;
+
+preg_automaton *pregAutomatonCreate( const char *pattern , int coptions , 
+                                     char *msg , int msglen );
+void pregAutomatonFree( preg_automaton *a );
+int pregAutomatonSubsumes( preg_automaton *a1 , preg_automaton *a2 );
+int pregAutomatonOverlaps( preg_automaton *a1 , preg_automaton *a2 );
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_background.c
+ *  
+ * @brief Compiles the constant patterns of a statement in background 
+ *        threads, so the _init functions don't wait for them.
+ *
+ * @details A statement with many constant patterns used to compile them 
+ * one after the other in the _init functions, so it couldn't start until
+ * all of them were compiled.  When the LIB_MYSQLUDF_PREG_COMPILE_THREADS 
+ * environment variable is set, pregInitWith gives the compile to a small 
+ * pool of that many threads and returns.  The patterns are then compiled 
+ * in parallel while the statement starts, and the main function of each 
+ * udf waits for its pattern (see pregConstantRe) on its first row only.
+ * Start up then takes about as long as the slowest compile instead of 
+ * the sum of them.
+ *
+ * Since the compile finishes after _init has returned, a bad pattern is 
+ * reported as an error on the first row instead of failing the _init.
+ *
+ * The threads are started when the first pattern is submitted, and are 
+ * stopped when the library is unloaded.  By then, every udf has waited 
+ * for its pattern in its _deinit, so the queue is empty.
+ */
+
+#include "ghmysql.h"
+#include "preg.h"
+#include "preg_background.h"
+
+/* For pthreads */
+#include <pthread.h>
+
+/*
+ * A pattern to compile.  The udf arguments are copied, since the compile
+ * can run after _init has returned.
+ */
+struct preg_background_job_s {
+    pregCompileFn compile ;
+    UDF_ARGS args ;             /* copy of the _init arguments */
+    struct preg_re_s *re ;      /* the result */
+    char msg[ PREG_BACKGROUND_MSG_SIZE ] ; /* error from compile */
+    int done ;                  /* has the compile finished? */
+    struct preg_background_job_s *next ; /* in the queue */
+};
+
+static pthread_once_t preg_background_once = PTHREAD_ONCE_INIT ;
+static pthread_t preg_background_threads[ PREG_BACKGROUND_MAX_THREADS ] ;
+static int preg_background_nthreads = 0 ;
+
+/*
+ * preg_background_lock protects everything below it, and the done and 
+ * re members of the jobs.
+ */
+static pthread_mutex_t preg_background_lock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t preg_background_work = PTHREAD_COND_INITIALIZER ;
+static pthread_cond_t preg_background_done = PTHREAD_COND_INITIALIZER ;
+static struct preg_background_job_s *preg_background_head = NULL ;
+static struct preg_background_job_s *preg_background_tail = NULL ;
+static int preg_background_stop = 0 ;
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static void pregBackgroundFree( struct preg_background_job_s *job )
+ *
+ * @brief free a job and its copy of the arguments
+ */
+static void pregBackgroundFree( struct preg_background_job_s *job )
+{
+    unsigned int i ;
+
+    if( job->args.args )
+    {
+        for( i = 0 ; i < job->args.arg_count ; i++ )
+            free( job->args.args[i] ) ;
+    }
+    free( job->args.args ) ;
+    free( job->args.arg_type ) ;
+    free( job->args.lengths ) ;
+    free( job->args.maybe_null ) ;
+    free( job ) ;
+}
+
+/**
+ * @fn static struct preg_background_job_s *pregBackgroundCopy( 
+ *                                          UDF_ARGS *args , int argnum )
+ *
+ * @brief make a job with a copy of the pattern argument
+ *
+ * @return - the job
+ * @return - NULL - if out of memory
+ *
+ * @details The compile functions only read the pattern, args[argnum], so
+ * only its value is copied.  The other args are NULL in the copy.  By the
+ * time this is called, pregInitWith has set the first 2 arg_types to 
+ * STRING_RESULT, but a constant that isn't a string is still in its 
+ * own type at _init, so copying the other args by arg_type could read 
+ * past them.
+ */
+static struct preg_background_job_s *pregBackgroundCopy( UDF_ARGS *args ,
+                                                         int argnum )
+{
+    struct preg_background_job_s *job ;
+    unsigned int n = args->arg_count ;
+    unsigned int i ;
+    unsigned long l ;           /* bytes in the pattern */
+
+    job = calloc( 1 , sizeof( struct preg_background_job_s ) ) ;
+    if( !job )
+        return NULL ;
+
+    job->args.arg_count = n ;
+    job->args.arg_type = calloc( n + 1 , sizeof( enum Item_result ) ) ;
+    job->args.args = calloc( n + 1 , sizeof( char * ) ) ;
+    job->args.lengths = calloc( n + 1 , sizeof( unsigned long ) ) ;
+    job->args.maybe_null = calloc( n + 1 , sizeof( char ) ) ;
+    if( !job->args.arg_type || !job->args.args || !job->args.lengths || 
+        !job->args.maybe_null )
+    {
+        pregBackgroundFree( job ) ;
+        return NULL ;
+    }
+
+    for( i = 0 ; i < n ; i++ )
+    {
+        job->args.arg_type[i] = args->arg_type[i] ;
+        job->args.maybe_null[i] = args->maybe_null[i] ;
+    }
+
+    i = (unsigned int)argnum ;
+    if( i >= n || !args->args[i] )
+        return job ;
+
+    l = args->lengths[i] ;
+    job->args.lengths[i] = l ;
+    job->args.args[i] = malloc( l + 1 ) ;
+    if( !job->args.args[i] )
+    {
+        pregBackgroundFree( job ) ;
+        return NULL ;
+    }
+    memcpy( job->args.args[i] , args->args[i] , l ) ;
+    job->args.args[i][l] = '\0' ;
+
+    return job ;
+}
+
+/**
+ * @fn static void *pregBackgroundWorker( void *unused )
+ *
+ * @brief a background thread.  Compiles the queued patterns in order.
+ */
+static void *pregBackgroundWorker( void *unused )
+{
+    struct preg_background_job_s *job ;
+    struct preg_re_s *re ;
+
+    pthread_mutex_lock( &preg_background_lock ) ;
+    while( !preg_background_stop )
+    {
+        job = preg_background_head ;
+        if( !job )
+        {
+            pthread_cond_wait( &preg_background_work , &preg_background_lock );
+            continue ;
+        }
+
+        preg_background_head = job->next ;
+        if( !preg_background_head )
+            preg_background_tail = NULL ;
+        pthread_mutex_unlock( &preg_background_lock ) ;
+
+        re = job->compile( &job->args , job->msg , sizeof( job->msg ) ) ;
+
+        pthread_mutex_lock( &preg_background_lock ) ;
+        job->re = re ;
+        job->done = 1 ;
+        pthread_cond_broadcast( &preg_background_done ) ;
+    }
+    pthread_mutex_unlock( &preg_background_lock ) ;
+
+    return NULL ;
+}
+
+/**
+ * @fn static void pregBackgroundStart( void )
+ *
+ * @brief read the number of threads from the environment and start them
+ */
+static void pregBackgroundStart( void )
+{
+    char *s ;
+    int n ;
+
+    s = getenv( PREG_BACKGROUND_THREADS_ENV ) ;
+    if( !s )
+        return ;
+
+    n = atoi( s ) ;
+    if( n > PREG_BACKGROUND_MAX_THREADS )
+        n = PREG_BACKGROUND_MAX_THREADS ;
+
+    for( ; preg_background_nthreads < n ; preg_background_nthreads++ )
+    {
+        if( pthread_create( &preg_background_threads[ preg_background_nthreads ],
+                            NULL , pregBackgroundWorker , NULL ) )
+            break ;
+    }
+}
+
+/**
+ * @fn static void pregBackgroundUnload( void )
+ *
+ * @brief stop the threads when the library is unloaded
+ */
+static void pregBackgroundUnload( void ) __attribute__((destructor)) ;
+static void pregBackgroundUnload( void )
+{
+    int i ;
+
+    if( !preg_background_nthreads )
+        return ;
+
+    pthread_mutex_lock( &preg_background_lock ) ;
+    preg_background_stop = 1 ;
+    pthread_cond_broadcast( &preg_background_work ) ;
+    pthread_mutex_unlock( &preg_background_lock ) ;
+
+    for( i = 0 ; i < preg_background_nthreads ; i++ )
+        pthread_join( preg_background_threads[i] , NULL ) ;
+    preg_background_nthreads = 0 ;
+}
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn struct preg_background_job_s *pregBackgroundCompile( UDF_ARGS *args ,
+ *                                      int argnum , pregCompileFn compile )
+ *
+ * @brief
+ *     queue a constant pattern to be compiled by a background thread
+ *
+ * @param args - the arguments given to _init
+ * @param argnum - the argument that has the pattern (see pregInitWith)
+ * @param compile - compiles the pattern in args (see pregInitWith)
+ *
+ * @return - the job.  pregBackgroundWait must be called for it.
+ * @return - NULL - if there are no background threads (or no memory).  
+ * The caller should compile the pattern itself.
+ */
+struct preg_background_job_s *pregBackgroundCompile( UDF_ARGS *args , 
+                                                     int argnum , 
+                                                     pregCompileFn compile )
+{
+    struct preg_background_job_s *job ;
+
+    pthread_once( &preg_background_once , pregBackgroundStart ) ;
+    if( !preg_background_nthreads )
+        return NULL ;
+
+    job = pregBackgroundCopy( args , argnum ) ;
+    if( !job )
+        return NULL ;
+    job->compile = compile ;
+
+    pthread_mutex_lock( &preg_background_lock ) ;
+    if( preg_background_tail )
+        preg_background_tail->next = job ;
+    else
+        preg_background_head = job ;
+    preg_background_tail = job ;
+    pthread_cond_signal( &preg_background_work ) ;
+    pthread_mutex_unlock( &preg_background_lock ) ;
+
+    return job ;
+}
+
+/**
+ * @fn struct preg_re_s *pregBackgroundWait( 
+ *                          struct preg_background_job_s *job , 
+ *                          char *msg , int msglen )
+ *
+ * @brief
+ *     wait for a background compile to finish
+ *
+ * @param job - from pregBackgroundCompile.  It is freed.
+ * @param msg - gets the error message if the compile failed
+ * @param msglen - size of msg
+ *
+ * @return - the compiled pattern, as returned by the compile function
+ * @return - NULL - if the compile failed
+ */
+struct preg_re_s *pregBackgroundWait( struct preg_background_job_s *job , 
+                                      char *msg , int msglen )
+{
+    struct preg_re_s *re ;
+
+    pthread_mutex_lock( &preg_background_lock ) ;
+    while( !job->done )
+        pthread_cond_wait( &preg_background_done , &preg_background_lock ) ;
+    pthread_mutex_unlock( &preg_background_lock ) ;
+
+    re = job->re ;
+    if( !re )
+        strncpy( msg , job->msg , msglen ) ;
+
+    pregBackgroundFree( job ) ;
+    return re ;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREG_BACKGROUND_H
+#define PREG_BACKGROUND_H
+
+/** @file preg_background.h
+ *  
+ * @brief headers for compiling constant patterns in background threads
+ */
+
+// Environment variable with the number of background compile threads
+#define PREG_BACKGROUND_THREADS_ENV "LIB_MYSQLUDF_PREG_COMPILE_THREADS"
+#define PREG_BACKGROUND_MAX_THREADS 16
+#define PREG_BACKGROUND_MSG_SIZE 128    // same as initPtrInfo
+
+struct preg_background_job_s ;
+
+struct preg_background_job_s *pregBackgroundCompile( UDF_ARGS *args , 
+                                                     int argnum , 
+                                                     pregCompileFn compile );
+struct preg_re_s *pregBackgroundWait( struct preg_background_job_s *job , 
+                                      char *msg , int msglen ) ;
+
+#endif
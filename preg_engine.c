@@ -0,0 +1,582 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_engine.c
+ *  
+ * @brief The matching engines, and the choice of engine for a pattern.
+ *
+ * @details The udfs used to call pcre_compile and pcre_exec directly, so
+ * a faster way to match some kind of pattern would have meant changing 
+ * all of them.  Now compileRegex asks each engine in preg_engines, 
+ * cheapest first, if it can run the pattern, and the first that can 
+ * compiles it.  pcre is last and can run anything.  The udfs only see a 
+ * struct preg_re_s, and match through pregExec (or pregExecNext), which 
+ * call the engine that compiled the pattern.  To add an engine, write 
+ * its functions and put it in preg_engines.
+ *
+ * An engine has to give the same results as pcre for the patterns it
+ * says it can run.  The ovector is filled in the same way, and the
+ * return codes are pcre's.
+ *
+ * Each engine also has a modifier that forces it, so that engines can
+ * be tested and timed against each other on the same pattern: 
+ * /needle/L always uses the literal engine (and is an error if the 
+ * pattern isn't a literal), and /needle/P always uses pcre.
+ *
+ * The engines are:
+ *    - literal (L) - patterns that are a plain string, such as /timeout/ 
+ * or /error:/i.  They are matched with memchr and memcmp, without pcre's
+ * setup for each call.
+ *    - pcre (P) - everything else
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_engine.h"
+
+/*
+ * Private Functions:
+ */
+
+/*
+ * The pcre engine
+ */
+
+static int pregPcreCapable( const char *pattern , int options )
+{
+    return 1 ;
+}
+
+static void *pregPcreCompile( const char *pattern , int options , 
+                              const char **error , int *erroffset )
+{
+    return pcre_compile( pattern , options , error , erroffset , NULL ) ;
+}
+
+static int pregPcreExec( const void *code , const pcre_extra *extra , 
+                         const char *subject , int length , int start_offset ,
+                         int options , int *ovector , int ovecsize )
+{
+    return pcre_exec( (const pcre *)code , extra , subject , length , 
+                      start_offset , options , ovector , ovecsize ) ;
+}
+
+static int pregPcreCaptureCount( const void *code )
+{
+    int count ;
+
+    if( pcre_fullinfo( (const pcre *)code , NULL , PCRE_INFO_CAPTURECOUNT , 
+                       &count ) < 0 )
+        return -1 ;
+
+    return count ;
+}
+
+static int pregPcreGroupNumber( const void *code , const char *name )
+{
+    return pcre_get_stringnumber( (const pcre *)code , name ) ;
+}
+
+static void pregPcreFree( void *code )
+{
+    pcre_free( code ) ;
+}
+
+/*
+ * The literal engine
+ */
+
+/*
+ * A compiled literal.
+ */
+struct preg_literal_s {
+    int len ;                   /* bytes in s */
+    int caseless ;              /* the i modifier was given */
+    int anchored ;              /* the A modifier was given */
+    int cases ;                 /* 2 if the first byte is a caseless letter */
+    char first[2] ;             /* the first byte, in each case */
+    char s[1] ;                 /* the literal, without escapes */
+};
+
+// options that don't change what a literal matches
+#define PREG_LITERAL_OPTIONS ( PCRE_CASELESS | PCRE_MULTILINE | PCRE_DOTALL \
+                               | PCRE_ANCHORED | PCRE_DOLLAR_ENDONLY \
+                               | PCRE_UNGREEDY | PCRE_EXTRA )
+
+/**
+ * @fn static int pregLiteralScan( const char *pattern , char *s )
+ *
+ * @brief check that a pattern is a literal, and remove its escapes
+ *
+ * @param s - gets the literal if not NULL.  Needs strlen(pattern) bytes.
+ *
+ * @return - the length of the literal
+ * @return -1 - if the pattern isn't a literal
+ *
+ * @details A literal has no meta characters.  Punctuation can be escaped
+ * with a backslash (/1\+1/).  Escapes of letters and digits are classes,
+ * assertions or codes (\d, \b, \x41), so they aren't literals.
+ */
+static int pregLiteralScan( const char *pattern , char *s )
+{
+    const unsigned char *p ;
+    int len = 0 ;
+
+    for( p = (const unsigned char *)pattern ; *p ; p++ )
+    {
+        if( strchr( "^$.[|()?*+{" , *p ) )
+            return -1 ;
+        if( *p == '\\' )
+        {
+            p++ ;
+            if( *p < 0x20 || *p > 0x7e || 
+                (*p >= '0' && *p <= '9') || 
+                ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z') )
+                return -1 ;
+        }
+        if( s )
+            s[ len ] = *p ;
+        len++ ;
+    }
+
+    return len ? len : -1 ;
+}
+
+static int pregLiteralCapable( const char *pattern , int options )
+{
+    if( options & ~PREG_LITERAL_OPTIONS )
+        return 0 ;
+
+    return pregLiteralScan( pattern , NULL ) > 0 ;
+}
+
+static void *pregLiteralCompile( const char *pattern , int options , 
+                                 const char **error , int *erroffset )
+{
+    struct preg_literal_s *lit ;
+    int i ;
+
+    lit = malloc( sizeof( struct preg_literal_s ) + strlen( pattern ) ) ;
+    if( !lit )
+    {
+        *error = "Out of memory" ;
+        *erroffset = 0 ;
+        return NULL ;
+    }
+
+    lit->len = pregLiteralScan( pattern , lit->s ) ;
+    lit->caseless = (options & PCRE_CASELESS) != 0 ;
+    lit->anchored = (options & PCRE_ANCHORED) != 0 ;
+    if( lit->caseless )
+    {
+        // pcre's default tables only fold ascii letters
+        for( i = 0 ; i < lit->len ; i++ )
+        {
+            if( lit->s[i] >= 'A' && lit->s[i] <= 'Z' )
+                lit->s[i] |= 0x20 ;
+        }
+    }
+    lit->first[0] = lit->first[1] = lit->s[0] ;
+    lit->cases = 1 ;
+    if( lit->caseless && lit->s[0] >= 'a' && lit->s[0] <= 'z' )
+    {
+        lit->first[1] = lit->s[0] & ~0x20 ;
+        lit->cases = 2 ;
+    }
+
+    return lit ;
+}
+
+/**
+ * @fn static const char *pregLiteralFind( const char *p , const char *end , 
+ *                                        char c )
+ *
+ * @brief memchr that returns end instead of NULL
+ */
+static const char *pregLiteralFind( const char *p , const char *end , char c )
+{
+    const char *found ;
+
+    found = memchr( p , c , end - p ) ;
+    return found ? found : end ;
+}
+
+/**
+ * @fn static int pregLiteralAt( const struct preg_literal_s *lit , 
+ *                               const char *p )
+ *
+ * @brief does the literal start at p?
+ */
+static int pregLiteralAt( const struct preg_literal_s *lit , const char *p )
+{
+    int i ;
+    char c ;
+
+    if( !lit->caseless )
+        return !memcmp( p , lit->s , lit->len ) ;
+
+    for( i = 0 ; i < lit->len ; i++ )
+    {
+        c = p[i] ;
+        if( c >= 'A' && c <= 'Z' )
+            c |= 0x20 ;
+        if( c != lit->s[i] )
+            return 0 ;
+    }
+
+    return 1 ;
+}
+
+static int pregLiteralExec( const void *code , const pcre_extra *extra , 
+                            const char *subject , int length , 
+                            int start_offset , int options , 
+                            int *ovector , int ovecsize )
+{
+    const struct preg_literal_s *lit = code ;
+    const char *p ;             /* where the literal might start */
+    const char *last ;          /* last place it can start */
+    const char *next[2] = { NULL , NULL } ; /* next first byte, each case */
+    int i ;
+
+    if( start_offset < 0 || start_offset > length )
+        return PCRE_ERROR_NOMATCH ;
+
+    p = subject + start_offset ;
+    last = subject + length - lit->len ;
+    if( lit->anchored || (options & PCRE_ANCHORED) )
+    {
+        if( last > p )
+            last = p ;
+    }
+
+    for( ; p <= last ; p++ )
+    {
+        // let memchr find the candidates.  A caseless letter is looked 
+        // for in both cases, and the nearer one is tried first.
+        for( i = 0 ; i < lit->cases ; i++ )
+        {
+            if( !next[i] || next[i] < p )
+                next[i] = pregLiteralFind( p , last + 1 , lit->first[i] ) ;
+        }
+        p = next[0] ;
+        if( lit->cases == 2 && next[1] < p )
+            p = next[1] ;
+        if( p > last )
+            break ;
+
+        if( pregLiteralAt( lit , p ) )
+        {
+            // like pcre, 0 means the ovector was too small
+            if( ovecsize < 2 )
+                return 0 ;
+            ovector[0] = p - subject ;
+            ovector[1] = ovector[0] + lit->len ;
+            return ovecsize < 3 ? 0 : 1 ;
+        }
+    }
+
+    return PCRE_ERROR_NOMATCH ;
+}
+
+static int pregLiteralNext( const void *code , const pcre_extra *extra , 
+                            const char *subject , int length , int *offset , 
+                            int *ovector , int ovecsize )
+{
+    int rc ;
+
+    // literals aren't empty, so there are no empty matches to step over
+    rc = pregLiteralExec( code , extra , subject , length , *offset , 0 , 
+                          ovector , ovecsize ) ;
+    if( rc >= 0 && ovecsize >= 2 )
+        *offset = ovector[1] ;
+
+    return rc ;
+}
+
+static int pregLiteralCaptureCount( const void *code )
+{
+    return 0 ;
+}
+
+static int pregLiteralGroupNumber( const void *code , const char *name )
+{
+    return PCRE_ERROR_NOSUBSTRING ;
+}
+
+static void pregLiteralFree( void *code )
+{
+    free( code ) ;
+}
+
+/*
+ * Public Data:
+ */
+
+const struct preg_engine_s preg_engine_pcre = {
+    "pcre" , 'P' , 
+    pregPcreCapable , pregPcreCompile , pregPcreExec , NULL , 
+    pregPcreCaptureCount , pregPcreGroupNumber , pregPcreFree
+};
+
+const struct preg_engine_s preg_engine_literal = {
+    "literal" , 'L' , 
+    pregLiteralCapable , pregLiteralCompile , pregLiteralExec , 
+    pregLiteralNext , pregLiteralCaptureCount , pregLiteralGroupNumber , 
+    pregLiteralFree
+};
+
+/*
+ * The engines in the order they are tried, cheapest first.  pcre must be
+ * last, since it can run anything.
+ */
+static const struct preg_engine_s *preg_engines[] = {
+    &preg_engine_literal ,
+    &preg_engine_pcre ,
+    NULL
+};
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn const struct preg_engine_s *pregEngineByModifier( int c )
+ *
+ * @brief find the engine forced by a modifier
+ *
+ * @return - the engine
+ * @return - NULL - if c isn't an engine's modifier
+ */
+const struct preg_engine_s *pregEngineByModifier( int c )
+{
+    int i ;
+
+    for( i = 0 ; preg_engines[i] ; i++ )
+    {
+        if( preg_engines[i]->modifier == c )
+            return preg_engines[i] ;
+    }
+
+    return NULL ;
+}
+
+/**
+ * @fn const struct preg_engine_s *pregEngineChoose( const char *pattern , 
+ *                                                  int options )
+ *
+ * @brief find the cheapest engine that can run a pattern
+ *
+ * @return - the engine.  pcre if no other can run it.
+ */
+const struct preg_engine_s *pregEngineChoose( const char *pattern , 
+                                              int options )
+{
+    int i ;
+
+    for( i = 0 ; preg_engines[i + 1] ; i++ )
+    {
+        if( preg_engines[i]->capable( pattern , options ) )
+            break ;
+    }
+
+    return preg_engines[i] ;
+}
+
+/**
+ * @fn struct preg_re_s *pregEngineCompile( const char *pattern , 
+ *                                          int options , 
+ *                                          const struct preg_engine_s *engine,
+ *                                          const char **error , 
+ *                                          int *erroffset )
+ *
+ * @brief compile a pattern with the cheapest engine that can run it
+ *
+ * @param pattern - the pattern, without delimiters or modifiers
+ * @param options - pcre_compile options
+ * @param engine - the engine to use, or NULL to choose one
+ * @param error - set to the error message on failure
+ * @param erroffset - set to where in the pattern the error is
+ *
+ * @return - the compiled pattern.  Free it with pregEngineFree.
+ * @return - NULL - on error
+ */
+struct preg_re_s *pregEngineCompile( const char *pattern , int options , 
+                                     const struct preg_engine_s *engine ,
+                                     const char **error , int *erroffset )
+{
+    struct preg_re_s *re ;
+
+    if( engine && !engine->capable( pattern , options ) )
+    {
+        *error = engine == &preg_engine_literal ? 
+            "the L modifier needs a literal pattern" : 
+            "the pattern is not supported by the forced engine" ;
+        *erroffset = 0 ;
+        return NULL ;
+    }
+
+    if( !engine )
+        engine = pregEngineChoose( pattern , options ) ;
+
+    re = malloc( sizeof( struct preg_re_s ) ) ;
+    if( !re )
+    {
+        *error = "Out of memory" ;
+        *erroffset = 0 ;
+        return NULL ;
+    }
+
+    re->engine = engine ;
+    re->options = options ;
+    re->code = engine->compile( pattern , options , error , erroffset ) ;
+    if( !re->code )
+    {
+        free( re ) ;
+        return NULL ;
+    }
+
+    return re ;
+}
+
+/**
+ * @fn int pregEngineExec( const struct preg_re_s *re , 
+ *                         const pcre_extra *extra , const char *subject , 
+ *                         int length , int start_offset , int options , 
+ *                         int *ovector , int ovecsize )
+ *
+ * @brief match a compiled pattern.  This is pcre_exec for any engine.
+ */
+int pregEngineExec( const struct preg_re_s *re , const pcre_extra *extra , 
+                    const char *subject , int length , int start_offset , 
+                    int options , int *ovector , int ovecsize )
+{
+    return re->engine->exec( re->code , extra , subject , length , 
+                             start_offset , options , ovector , ovecsize ) ;
+}
+
+/**
+ * @fn int pregEngineNext( const struct preg_re_s *re , 
+ *                         const pcre_extra *extra , const char *subject , 
+ *                         int length , int *offset , 
+ *                         int *ovector , int ovecsize )
+ *
+ * @brief find the next non-empty match at or after *offset
+ *
+ * @param offset - where to start.  It is moved past the match.
+ *
+ * @return - as pcre_exec.  PCRE_ERROR_NOMATCH when there are no more.
+ *
+ * @details This is the loop that walks all of the matches in a subject.
+ * Empty matches are stepped over, by a whole character for a UTF-8 
+ * pattern, since pcre_exec rejects an offset inside one.  Engines that can find the next match
+ * faster than calling exec again supply their own.
+ */
+int pregEngineNext( const struct preg_re_s *re , const pcre_extra *extra , 
+                    const char *subject , int length , int *offset , 
+                    int *ovector , int ovecsize )
+{
+    int rc ;
+
+    if( re->engine->next )
+        return re->engine->next( re->code , extra , subject , length , 
+                                 offset , ovector , ovecsize ) ;
+
+    while( *offset <= length )
+    {
+        rc = pregEngineExec( re , extra , subject , length , *offset , 0 , 
+                             ovector , ovecsize ) ;
+        if( rc < 0 )
+            return rc ;
+
+        if( ovector[1] != ovector[0] )
+        {
+            *offset = ovector[1] ;
+            return rc ;
+        }
+        *offset = ovector[1] + 1 ;
+        if( re->options & PCRE_UTF8 )
+            while( *offset < length && ( subject[*offset] & 0xc0 ) == 0x80 )
+                (*offset)++ ;
+    }
+
+    return PCRE_ERROR_NOMATCH ;
+}
+
+/**
+ * @fn int pregEngineCaptureCount( const struct preg_re_s *re )
+ *
+ * @brief get the number of capture groups in a compiled pattern
+ *
+ * @return - the number of groups
+ * @return -1 - on error
+ */
+int pregEngineCaptureCount( const struct preg_re_s *re )
+{
+    return re->engine->capture_count( re->code ) ;
+}
+
+/**
+ * @fn int pregEngineGroupNumber( const struct preg_re_s *re , 
+ *                                const char *name )
+ *
+ * @brief get the number of a named group.  This is pcre_get_stringnumber
+ * for any engine.
+ */
+int pregEngineGroupNumber( const struct preg_re_s *re , const char *name )
+{
+    return re->engine->group_number( re->code , name ) ;
+}
+
+/**
+ * @fn pcre *pregEnginePcre( const struct preg_re_s *re )
+ *
+ * @brief get the pcre code of a pattern compiled by the pcre engine
+ *
+ * @return - the pcre code
+ * @return - NULL - if another engine compiled the pattern
+ *
+ * @details For callers that need what only pcre knows about a pattern, 
+ * such as its name table.
+ */
+pcre *pregEnginePcre( const struct preg_re_s *re )
+{
+    return re->engine == &preg_engine_pcre ? (pcre *)re->code : NULL ;
+}
+
+/**
+ * @fn void pregEngineFree( struct preg_re_s *re )
+ *
+ * @brief free a compiled pattern
+ */
+void pregEngineFree( struct preg_re_s *re )
+{
+    if( re )
+    {
+        re->engine->free( re->code ) ;
+        free( re ) ;
+    }
+}
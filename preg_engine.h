@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREG_ENGINE_H
+#define PREG_ENGINE_H
+
+/** @file preg_engine.h
+ *  
+ * @brief headers for the matching engines
+ */
+
+#include <pcre.h>
+
+/*
+ * A matching engine.  The functions are called like their pcre 
+ * counterparts, with code being what compile returned.
+ */
+struct preg_engine_s {
+    const char *name ;
+    char modifier ;             /* forces this engine (see parseRegex) */
+    int (*capable)( const char *pattern , int options ) ;
+    void *(*compile)( const char *pattern , int options , 
+                      const char **error , int *erroffset ) ;
+    int (*exec)( const void *code , const pcre_extra *extra , 
+                 const char *subject , int length , int start_offset , 
+                 int options , int *ovector , int ovecsize ) ;
+    int (*next)( const void *code , const pcre_extra *extra , 
+                 const char *subject , int length , int *offset , 
+                 int *ovector , int ovecsize ) ; /* NULL to use exec */
+    int (*capture_count)( const void *code ) ;
+    int (*group_number)( const void *code , const char *name ) ;
+    void (*free)( void *code ) ;
+};
+
+/*
+ * A compiled pattern.
+ */
+struct preg_re_s {
+    const struct preg_engine_s *engine ;
+    void *code ;
+    int options ;               /* the pcre_compile options */
+};
+
+extern const struct preg_engine_s preg_engine_pcre ;
+extern const struct preg_engine_s preg_engine_literal ;
+
+const struct preg_engine_s *pregEngineByModifier( int c ) ;
+const struct preg_engine_s *pregEngineChoose( const char *pattern , 
+                                              int options ) ;
+struct preg_re_s *pregEngineCompile( const char *pattern , int options , 
+                                     const struct preg_engine_s *engine ,
+                                     const char **error , int *erroffset ) ;
+int pregEngineExec( const struct preg_re_s *re , const pcre_extra *extra , 
+                    const char *subject , int length , int start_offset , 
+                    int options , int *ovector , int ovecsize ) ;
+int pregEngineNext( const struct preg_re_s *re , const pcre_extra *extra , 
+                    const char *subject , int length , int *offset , 
+                    int *ovector , int ovecsize ) ;
+int pregEngineCaptureCount( const struct preg_re_s *re ) ;
+int pregEngineGroupNumber( const struct preg_re_s *re , const char *name ) ;
+pcre *pregEnginePcre( const struct preg_re_s *re ) ;
+void pregEngineFree( struct preg_re_s *re ) ;
+
+#endif
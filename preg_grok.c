@@ -0,0 +1,713 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_grok.c
+ *  
+ * @brief Expands grok style references (%{NAME} and %{NAME:field}) into 
+ *        pcre syntax, and keeps a cache of compiled grok patterns.
+ *
+ * @details Grok expansion is enabled by the G modifier and is run by 
+ * parseRegex, so it works for every preg function (and PREG_EXPLAIN shows
+ * the expanded pattern).  The references are replaced as follows:
+ *
+ * @li %{NAME} becomes (?:definition of NAME)
+ *
+ * @li %{NAME:field} becomes (?<field>definition of NAME), so the match is
+ * available as the named capture group 'field'.
+ *
+ * @li %{NAME:field:type} is accepted for compatibility with other grok 
+ * implementations.  The type is ignored.
+ *
+ * Definitions can refer to other definitions.  The built-in library 
+ * below has the common grok base patterns.  More definitions can be added
+ * with pregGrokDefine (PREG_GROK_DEFINE).  The built-in ones can't be 
+ * replaced, since the definitions are shared by every connection.  User 
+ * definitions last until the library is unloaded.
+ *
+ * Since grok expressions tend to expand into very long patterns, the 
+ * compiled patterns used by PREG_GROK are kept in a small cache shared by
+ * all threads.  Compiled patterns are only read when matching, so they can
+ * be used by several threads at once.  Entries are reference counted, and
+ * entries compiled before a definition changed are dropped once they are 
+ * no longer used.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+
+/* For pthreads */
+#include <pthread.h>
+
+#include "preg_grok.h"
+#include "from_php.h"
+
+#define GROK_MAX_LENGTH 262144   // longest expanded pattern
+#define GROK_MAX_FIELD 32        // longest group name allowed by pcre
+
+/*
+ * The built-in definitions.  None of these have capture groups of their
+ * own, so only the fields named in the expression are captured.
+ */
+static const struct {
+    const char *name ;
+    const char *pattern ;
+} preg_grok_builtin[] = {
+    { "USERNAME" , "[a-zA-Z0-9._-]+" } ,
+    { "USER" , "%{USERNAME}" } ,
+    { "EMAILLOCALPART" , "[a-zA-Z0-9!#$%&'*+/=?^_`{|}~-]+(?:\\.[a-zA-Z0-9!#$%&'*+/=?^_`{|}~-]+)*" } ,
+    { "EMAILADDRESS" , "%{EMAILLOCALPART}@%{HOSTNAME}" } ,
+    { "INT" , "(?:[+-]?(?:[0-9]+))" } ,
+    { "BASE10NUM" , "(?<![0-9.+-])(?>[+-]?(?:(?:[0-9]+(?:\\.[0-9]+)?)|(?:\\.[0-9]+)))" } ,
+    { "NUMBER" , "(?:%{BASE10NUM})" } ,
+    { "BASE16NUM" , "(?<![0-9A-Fa-f])(?:[+-]?(?:0x)?(?:[0-9A-Fa-f]+))" } ,
+    { "POSINT" , "\\b(?:[1-9][0-9]*)\\b" } ,
+    { "NONNEGINT" , "\\b(?:[0-9]+)\\b" } ,
+    { "WORD" , "\\b\\w+\\b" } ,
+    { "NOTSPACE" , "\\S+" } ,
+    { "SPACE" , "\\s*" } ,
+    { "DATA" , ".*?" } ,
+    { "GREEDYDATA" , ".*" } ,
+    { "QUOTEDSTRING" , "(?>(?<!\\\\)(?>\"(?>\\\\.|[^\\\\\"]+)+\"|\"\"|(?>'(?>\\\\.|[^\\\\']+)+')|''|(?>`(?>\\\\.|[^\\\\`]+)+`)|``))" } ,
+    { "UUID" , "[A-Fa-f0-9]{8}-(?:[A-Fa-f0-9]{4}-){3}[A-Fa-f0-9]{12}" } ,
+    { "MAC" , "(?:[A-Fa-f0-9]{2}(?::[A-Fa-f0-9]{2}){5}|[A-Fa-f0-9]{2}(?:-[A-Fa-f0-9]{2}){5}|[A-Fa-f0-9]{4}(?:\\.[A-Fa-f0-9]{4}){2})" } ,
+    { "IPV4" , "(?<![0-9])(?:(?:25[0-5]|2[0-4][0-9]|[0-1]?[0-9]{1,2})[.](?:25[0-5]|2[0-4][0-9]|[0-1]?[0-9]{1,2})[.](?:25[0-5]|2[0-4][0-9]|[0-1]?[0-9]{1,2})[.](?:25[0-5]|2[0-4][0-9]|[0-1]?[0-9]{1,2}))(?![0-9])" } ,
+    { "IPV6" , "(?:(?:[0-9A-Fa-f]{1,4}:){7}[0-9A-Fa-f]{1,4}|(?:[0-9A-Fa-f]{1,4}:){6}%{IPV4}|::(?:[fF]{4}:)?%{IPV4}|[0-9A-Fa-f]{1,4}:(?::[0-9A-Fa-f]{1,4}){1,6}|(?:[0-9A-Fa-f]{1,4}:){1,2}(?::[0-9A-Fa-f]{1,4}){1,5}|(?:[0-9A-Fa-f]{1,4}:){1,3}(?::[0-9A-Fa-f]{1,4}){1,4}|(?:[0-9A-Fa-f]{1,4}:){1,4}(?::[0-9A-Fa-f]{1,4}){1,3}|(?:[0-9A-Fa-f]{1,4}:){1,5}(?::[0-9A-Fa-f]{1,4}){1,2}|(?:[0-9A-Fa-f]{1,4}:){1,6}:[0-9A-Fa-f]{1,4}|:(?:(?::[0-9A-Fa-f]{1,4}){1,7}|:)|(?:[0-9A-Fa-f]{1,4}:){1,7}:)" } ,
+    { "IP" , "(?:%{IPV6}|%{IPV4})" } ,
+    { "HOSTNAME" , "\\b(?:[0-9A-Za-z][0-9A-Za-z-]{0,62})(?:\\.(?:[0-9A-Za-z][0-9A-Za-z-]{0,62}))*(?:\\.?|\\b)" } ,
+    { "IPORHOST" , "(?:%{IP}|%{HOSTNAME})" } ,
+    { "HOSTPORT" , "%{IPORHOST}:%{POSINT}" } ,
+    { "UNIXPATH" , "(?:/[\\w_%!$@:.,+~-]*)+" } ,
+    { "WINPATH" , "(?>[A-Za-z]+:|\\\\)(?:\\\\[^\\\\?*]*)+" } ,
+    { "PATH" , "(?:%{UNIXPATH}|%{WINPATH})" } ,
+    { "URIPROTO" , "[A-Za-z][A-Za-z0-9+.-]+" } ,
+    { "URIHOST" , "%{IPORHOST}(?::%{POSINT})?" } ,
+    { "URIPATH" , "(?:/[A-Za-z0-9$.+!*'(){},~:;=@#%&_\\-]*)+" } ,
+    { "URIPARAM" , "\\?[A-Za-z0-9$.+!*'|(){},~@#%&/=:;_?\\-\\[\\]<>]*" } ,
+    { "URIPATHPARAM" , "%{URIPATH}(?:%{URIPARAM})?" } ,
+    { "URI" , "%{URIPROTO}://(?:%{USER}(?::[^@]*)?@)?(?:%{URIHOST})?(?:%{URIPATHPARAM})?" } ,
+    { "MONTH" , "\\b(?:Jan(?:uary)?|Feb(?:ruary)?|Mar(?:ch)?|Apr(?:il)?|May|Jun(?:e)?|Jul(?:y)?|Aug(?:ust)?|Sep(?:tember)?|Oct(?:ober)?|Nov(?:ember)?|Dec(?:ember)?)\\b" } ,
+    { "MONTHNUM" , "(?:0?[1-9]|1[0-2])" } ,
+    { "MONTHDAY" , "(?:(?:0[1-9])|(?:[12][0-9])|(?:3[01])|[1-9])" } ,
+    { "DAY" , "(?:Mon(?:day)?|Tue(?:sday)?|Wed(?:nesday)?|Thu(?:rsday)?|Fri(?:day)?|Sat(?:urday)?|Sun(?:day)?)" } ,
+    { "YEAR" , "(?>\\d\\d){1,2}" } ,
+    { "HOUR" , "(?:2[0123]|[01]?[0-9])" } ,
+    { "MINUTE" , "(?:[0-5][0-9])" } ,
+    { "SECOND" , "(?:(?:[0-5]?[0-9]|60)(?:[:.,][0-9]+)?)" } ,
+    { "TIME" , "(?<![0-9])%{HOUR}:%{MINUTE}(?::%{SECOND})(?![0-9])" } ,
+    { "DATE_US" , "%{MONTHNUM}[/-]%{MONTHDAY}[/-]%{YEAR}" } ,
+    { "DATE_EU" , "%{MONTHDAY}[./-]%{MONTHNUM}[./-]%{YEAR}" } ,
+    { "ISO8601_TIMEZONE" , "(?:Z|[+-]%{HOUR}(?::?%{MINUTE}))" } ,
+    { "TIMESTAMP_ISO8601" , "%{YEAR}-%{MONTHNUM}-%{MONTHDAY}[T ]%{HOUR}:?%{MINUTE}(?::?%{SECOND})?%{ISO8601_TIMEZONE}?" } ,
+    { "HTTPDATE" , "%{MONTHDAY}/%{MONTH}/%{YEAR}:%{TIME} %{INT}" } ,
+    { "SYSLOGTIMESTAMP" , "%{MONTH} +%{MONTHDAY} %{TIME}" } ,
+    { "PROG" , "[\\x21-\\x5a\\x5c\\x5e-\\x7e]+" } ,
+    { "LOGLEVEL" , "(?:[Aa]lert|ALERT|[Tt]race|TRACE|[Dd]ebug|DEBUG|[Nn]otice|NOTICE|[Ii]nfo|INFO|[Ww]arn(?:ing)?|WARN(?:ING)?|[Ee]rr(?:or)?|ERR(?:OR)?|[Cc]rit(?:ical)?|CRIT(?:ICAL)?|[Ff]atal|FATAL|[Ss]evere|SEVERE|EMERG(?:ENCY)?|[Ee]merg(?:ency)?)" } ,
+    { "COMMONAPACHELOG" , "%{IPORHOST:clientip} %{USER:ident} %{USER:auth} \\[%{HTTPDATE:timestamp}\\] \"(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest})\" %{NUMBER:response} (?:%{NUMBER:bytes}|-)" } ,
+    { "COMBINEDAPACHELOG" , "%{COMMONAPACHELOG} %{QUOTEDSTRING:referrer} %{QUOTEDSTRING:agent}" } ,
+    { NULL , NULL }
+};
+
+/*
+ * A user definition.  These are kept in a list, newest first.
+ */
+struct preg_grok_def_s {
+    char *name ;
+    char *pattern ;
+    struct preg_grok_def_s *next ;
+};
+
+/*
+ * A compiled grok pattern in the cache.  The key is the pattern argument
+ * as it was passed in.
+ */
+struct preg_grok_cache_s {
+    char *key ;
+    int key_len ;
+    struct preg_re_s *re ;      /* NULL if the entry is unused */
+    int refs ;                  /* callers using re now */
+    unsigned long generation ;  /* preg_grok_generation when compiled */
+    unsigned long used ;        /* preg_grok_clock when last used */
+};
+
+/*
+ * A growing output buffer for the expansion.
+ */
+struct grok_buf_s {
+    char *s ;
+    int len ;
+    int size ;
+};
+
+/*
+ * preg_grok_lock protects everything below it.
+ */
+static pthread_mutex_t preg_grok_lock = PTHREAD_MUTEX_INITIALIZER ;
+static struct preg_grok_def_s *preg_grok_defs = NULL ;
+static int preg_grok_ndefs = 0 ;
+static unsigned long preg_grok_generation = 0 ; /* bumped by each define */
+static struct preg_grok_cache_s preg_grok_cache[ PREG_GROK_CACHE_SIZE ] ;
+static unsigned long preg_grok_clock = 0 ;
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static int grokAppend( struct grok_buf_s *b , const char *s , int l )
+ *
+ * @brief append l bytes of s to b
+ *
+ * @return 0 - on success
+ * @return -1 - if out of memory or the result would be too long
+ */
+static int grokAppend( struct grok_buf_s *b , const char *s , int l )
+{
+    char *news ;
+    int size ;
+
+    if( b->len + l + 1 > b->size )
+    {
+        if( b->len + l + 1 > GROK_MAX_LENGTH )
+            return -1 ;
+
+        size = b->size ? b->size : 256 ;
+        while( size < b->len + l + 1 )
+            size *= 2 ;
+        news = realloc( b->s , size ) ;
+        if( !news )
+            return -1 ;
+        b->s = news ;
+        b->size = size ;
+    }
+
+    memcpy( b->s + b->len , s , l ) ;
+    b->len += l ;
+    return 0 ;
+}
+
+/**
+ * @fn static int grokIsName( const char *s , int l , int is_field )
+ *
+ * @brief check that s is a valid definition name or field name
+ *
+ * @details Definition names are made of letters, digits and underscores.
+ * Field names become pcre group names, so they can't start with a digit
+ * and must be 32 characters or less.
+ */
+static int grokIsName( const char *s , int l , int is_field )
+{
+    int i ;
+
+    if( l <= 0 || l > (is_field ? GROK_MAX_FIELD : PREG_GROK_MAX_NAME) )
+        return 0 ;
+    if( is_field && isdigit( (unsigned char)*s ) )
+        return 0 ;
+
+    for( i = 0 ; i < l ; i++ )
+    {
+        if( !isalnum( (unsigned char)s[i] ) && s[i] != '_' )
+            return 0 ;
+    }
+    return 1 ;
+}
+
+/**
+ * @fn static const char *grokBuiltin( const char *name , int l )
+ *
+ * @brief find the built-in definition of a name
+ *
+ * @return the definition - if found
+ * @return NULL - if not found
+ */
+static const char *grokBuiltin( const char *name , int l )
+{
+    int i ;
+
+    for( i = 0 ; preg_grok_builtin[i].name ; i++ )
+    {
+        if( !strncmp( preg_grok_builtin[i].name , name , l ) && 
+            !preg_grok_builtin[i].name[l] )
+            return preg_grok_builtin[i].pattern ;
+    }
+
+    return NULL ;
+}
+
+/**
+ * @fn static const char *grokLookup( const char *name , int l )
+ *
+ * @brief find the definition of a name.  preg_grok_lock must be held.
+ *
+ * @return the definition - if found
+ * @return NULL - if not found
+ */
+static const char *grokLookup( const char *name , int l )
+{
+    struct preg_grok_def_s *d ;
+
+    for( d = preg_grok_defs ; d ; d = d->next )
+    {
+        if( !strncmp( d->name , name , l ) && !d->name[l] )
+            return d->pattern ;
+    }
+
+    return grokBuiltin( name , l ) ;
+}
+
+/**
+ * @fn static int grokExpand( struct grok_buf_s *b , const char *p , int l ,
+ *                            int extended , int depth , 
+ *                            char *msg , int msglen )
+ *
+ * @brief append p to b with the grok references replaced by their 
+ * definitions.  preg_grok_lock must be held.
+ *
+ * @param b - output buffer
+ * @param p - the pattern to expand
+ * @param l - length of p
+ * @param extended - set if the x modifier is on.  Definitions are 
+ * written for x mode off, so it is turned off inside them.
+ * @param depth - nesting level of the definition being expanded
+ * @param msg - put error messages here
+ * @param msglen - length of msg buffer
+ *
+ * @return 0 - on success
+ * @return -1 - on error
+ *
+ * @details Backslash escapes are copied as they are, so \\%{ is not a 
+ * reference.
+ */
+static int grokExpand( struct grok_buf_s *b , const char *p , int l , 
+                       int extended , int depth , char *msg , int msglen )
+{
+    const char *end = p + l ;
+    const char *ref ;           /* start of the reference after %{ */
+    const char *close ;         /* the } ending the reference */
+    const char *field ;         /* field name, if any */
+    const char *def ;           /* definition of the name */
+    int name_len ;
+    int field_len = 0 ;
+    const char *run = p ;       /* start of text not yet copied */
+
+    while( p < end )
+    {
+        if( *p == '\\' && p + 1 < end )
+        {
+            p += 2 ;
+            continue ;
+        }
+        if( *p != '%' || p + 1 >= end || p[1] != '{' )
+        {
+            p++ ;
+            continue ;
+        }
+
+        if( grokAppend( b , run , p - run ) )
+            goto toolong ;
+
+        ref = p + 2 ;
+        close = memchr( ref , '}' , end - ref ) ;
+        if( !close )
+        {
+            strncpy( msg , "No ending } in grok reference" , msglen ) ;
+            return -1 ;
+        }
+
+        field = memchr( ref , ':' , close - ref ) ;
+        name_len = (field ? field : close) - ref ;
+        if( field )
+        {
+            field++ ;
+            field_len = close - field ;
+            if( memchr( field , ':' , field_len ) )  // :type is ignored
+                field_len = (char *)memchr( field , ':' , field_len ) - field ;
+        }
+
+        if( !grokIsName( ref , name_len , 0 ) || 
+            (field && !grokIsName( field , field_len , 1 )) )
+        {
+            snprintf( msg , msglen , "Bad grok reference %%{%.*s}" , 
+                      (int)(close - ref) > 40 ? 40 : (int)(close - ref) , ref);
+            return -1 ;
+        }
+
+        def = grokLookup( ref , name_len ) ;
+        if( !def )
+        {
+            snprintf( msg , msglen , "Unknown grok pattern %.*s" , 
+                      name_len , ref ) ;
+            return -1 ;
+        }
+        if( depth >= PREG_GROK_MAX_DEPTH )
+        {
+            snprintf( msg , msglen , "Grok pattern %.*s nested too deeply" ,
+                      name_len , ref ) ;
+            return -1 ;
+        }
+
+        if( field )
+        {
+            if( grokAppend( b , "(?<" , 3 ) || 
+                grokAppend( b , field , field_len ) || 
+                grokAppend( b , ">" , 1 ) )
+                goto toolong ;
+        }
+        else if( grokAppend( b , "(?:" , 3 ) )
+            goto toolong ;
+
+        if( extended && grokAppend( b , "(?-x)" , 5 ) )
+            goto toolong ;
+
+        if( grokExpand( b , def , strlen( def ) , 0 , depth + 1 , 
+                        msg , msglen ) )
+            return -1 ;
+
+        if( grokAppend( b , ")" , 1 ) )
+            goto toolong ;
+
+        p = run = close + 1 ;
+    }
+
+    if( grokAppend( b , run , p - run ) )
+        goto toolong ;
+
+    return 0 ;
+
+toolong:
+    strncpy( msg , "Expanded grok pattern too long" , msglen ) ;
+    return -1 ;
+}
+
+/**
+ * @fn static void grokCacheDrop( struct preg_grok_cache_s *e )
+ *
+ * @brief free the pattern in a cache entry and mark it unused.  
+ * preg_grok_lock must be held.
+ */
+static void grokCacheDrop( struct preg_grok_cache_s *e )
+{
+    pregEngineFree( e->re ) ;
+    free( e->key ) ;
+    memset( e , 0 , sizeof( *e ) ) ;
+}
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn char *pregGrokExpand( const char *pattern , int coptions , 
+ *                           char *msg , int msglen )
+ *
+ * @brief replace the grok references in a pattern by their definitions
+ *
+ * @param pattern - the pattern, without delimiters or modifiers
+ * (as returned by parseRegex)
+ * @param coptions - the pcre compile options for the pattern
+ * @param msg - put error messages here
+ * @param msglen - length of msg buffer
+ *
+ * @return - malloc'd expanded pattern - on success
+ * @return - NULL - on error
+ */
+char *pregGrokExpand( const char *pattern , int coptions , 
+                      char *msg , int msglen )
+{
+    struct grok_buf_s b = { NULL , 0 , 0 } ;
+    int rc ;
+
+    pthread_mutex_lock( &preg_grok_lock ) ;
+    rc = grokExpand( &b , pattern , strlen( pattern ) , 
+                     (coptions & PCRE_EXTENDED) != 0 , 0 , msg , msglen ) ;
+    pthread_mutex_unlock( &preg_grok_lock ) ;
+
+    if( rc || grokAppend( &b , "" , 1 ) )
+    {
+        if( !rc )
+            strncpy( msg , "Out of memory" , msglen ) ;
+        free( b.s ) ;
+        return NULL ;
+    }
+
+    return b.s ;
+}
+
+/**
+ * @fn int pregGrokDefine( const char *name , int name_len , 
+ *                         const char *pattern , int pattern_len , 
+ *                         char *msg , int msglen )
+ *
+ * @brief add or replace a user definition.  Built-in names are refused.
+ *
+ * @param name - name of the definition (letters, digits and underscores)
+ * @param name_len - length of name
+ * @param pattern - the definition.  A pattern without delimiters or 
+ * modifiers, which can refer to other definitions.
+ * @param pattern_len - length of pattern
+ * @param msg - put error messages here
+ * @param msglen - length of msg buffer
+ *
+ * @return 0 - on success
+ * @return -1 - on error
+ *
+ * @details The definition is expanded and compiled first, so that 
+ * broken definitions and references to unknown names are reported here 
+ * instead of in every pattern that uses them.  The expanded definition is
+ * what is kept, so a definition that refers to its own name builds on the
+ * one it replaces (a new name can't refer to itself), and later changes 
+ * to the definitions it uses don't change it.  Cached patterns compiled 
+ * with the old definitions are dropped.
+ */
+int pregGrokDefine( const char *name , int name_len , 
+                    const char *pattern , int pattern_len , 
+                    char *msg , int msglen )
+{
+    struct preg_grok_def_s *d ;
+    char *p ;                   /* copy of pattern */
+    char *expanded ;            /* pattern with references expanded - kept */
+    pcre *re ;
+    const char *error ;
+    int erroffset ;
+    int i ;
+
+    if( !grokIsName( name , name_len , 0 ) )
+    {
+        strncpy( msg , "Grok names can only have letters, digits and _" , 
+                 msglen ) ;
+        return -1 ;
+    }
+
+    // definitions are shared by every connection, so one session can't 
+    // change what %{INT} means for the others
+    if( grokBuiltin( name , name_len ) )
+    {
+        snprintf( msg , msglen , "%.*s is a built-in grok definition" , 
+                  name_len , name ) ;
+        return -1 ;
+    }
+
+    p = malloc( pattern_len + 1 ) ;
+    if( !p )
+    {
+        strncpy( msg , "Out of memory" , msglen ) ;
+        return -1 ;
+    }
+    memcpy( p , pattern , pattern_len ) ;
+    p[ pattern_len ] = '\0' ;
+
+    expanded = pregGrokExpand( p , 0 , msg , msglen ) ;
+    free( p ) ;
+    if( !expanded )
+        return -1 ;
+    re = pcre_compile( expanded , 0 , &error , &erroffset , NULL ) ;
+    if( !re )
+    {
+        snprintf( msg , msglen , "Compilation failed: %s" , error ) ;
+        free( expanded ) ;
+        return -1 ;
+    }
+    pcre_free( re ) ;
+
+    pthread_mutex_lock( &preg_grok_lock ) ;
+
+    for( d = preg_grok_defs ; d ; d = d->next )
+    {
+        if( !strncmp( d->name , name , name_len ) && !d->name[name_len] )
+            break ;
+    }
+
+    if( !d )
+    {
+        if( preg_grok_ndefs >= PREG_GROK_MAX_DEFINITIONS )
+        {
+            pthread_mutex_unlock( &preg_grok_lock ) ;
+            free( expanded ) ;
+            strncpy( msg , "Too many grok definitions" , msglen ) ;
+            return -1 ;
+        }
+        if( !(d = calloc( 1 , sizeof( *d ) )) || 
+            !(d->name = malloc( name_len + 1 )) )
+        {
+            pthread_mutex_unlock( &preg_grok_lock ) ;
+            if( d ) 
+                free( d ) ;
+            free( expanded ) ;
+            strncpy( msg , "Out of memory" , msglen ) ;
+            return -1 ;
+        }
+        memcpy( d->name , name , name_len ) ;
+        d->name[ name_len ] = '\0' ;
+        d->next = preg_grok_defs ;
+        preg_grok_defs = d ;
+        preg_grok_ndefs++ ;
+    }
+
+    free( d->pattern ) ;
+    d->pattern = expanded ;
+
+    // Patterns compiled with the old definitions are now stale.  Drop the
+    // ones that aren't in use.  The others are dropped when released.
+    preg_grok_generation++ ;
+    for( i = 0 ; i < PREG_GROK_CACHE_SIZE ; i++ )
+    {
+        if( preg_grok_cache[i].re && !preg_grok_cache[i].refs )
+            grokCacheDrop( &preg_grok_cache[i] ) ;
+    }
+
+    pthread_mutex_unlock( &preg_grok_lock ) ;
+
+    return 0 ;
+}
+
+/**
+ * @fn struct preg_re_s *pregGrokCacheGet( const char *regex , 
+ *                                         int regex_len , 
+ *                                         char *msg , int msglen )
+ *
+ * @brief get a compiled pattern from the cache, compiling it if necessary
+ *
+ * @param regex - the pattern with delimiters and modifiers (it should 
+ * have the G modifier)
+ * @param regex_len - length of regex
+ * @param msg - put error messages here
+ * @param msglen - length of msg buffer
+ *
+ * @return - the compiled pattern - on success
+ * @return - NULL - on error
+ *
+ * @note The returned pattern must be given back with pregGrokCacheRelease
+ * instead of being freed.
+ */
+struct preg_re_s *pregGrokCacheGet( const char *regex , int regex_len , 
+                                    char *msg , int msglen )
+{
+    struct preg_grok_cache_s *e ;
+    struct preg_grok_cache_s *victim = NULL ;
+    unsigned long generation ;
+    char *key ;
+    struct preg_re_s *re ;
+    int i ;
+
+    pthread_mutex_lock( &preg_grok_lock ) ;
+    for( i = 0 ; i < PREG_GROK_CACHE_SIZE ; i++ )
+    {
+        e = &preg_grok_cache[i] ;
+        if( e->re && e->generation == preg_grok_generation && 
+            e->key_len == regex_len && !memcmp( e->key , regex , regex_len ))
+        {
+            e->refs++ ;
+            e->used = ++preg_grok_clock ;
+            re = e->re ;
+            pthread_mutex_unlock( &preg_grok_lock ) ;
+            return re ;
+        }
+    }
+    generation = preg_grok_generation ;
+    pthread_mutex_unlock( &preg_grok_lock ) ;
+
+    // Compile without the lock.  parseRegex takes it for the expansion.
+    key = malloc( regex_len + 1 ) ;
+    if( !key )
+    {
+        strncpy( msg , "Out of memory" , msglen ) ;
+        return NULL ;
+    }
+    memcpy( key , regex , regex_len ) ;
+    key[ regex_len ] = '\0' ;
+
+    re = compileRegex( key , regex_len , msg , msglen ) ;
+    if( !re )
+    {
+        free( key ) ;
+        return NULL ;
+    }
+
+    // Use an empty entry, or else the least recently used one that isn't 
+    // in use.  If they are all in use, the pattern isn't cached.
+    pthread_mutex_lock( &preg_grok_lock ) ;
+    for( i = 0 ; i < PREG_GROK_CACHE_SIZE ; i++ )
+    {
+        e = &preg_grok_cache[i] ;
+        if( !e->re )
+        {
+            victim = e ;
+            break ;
+        }
+        if( !e->refs && (!victim || e->used < victim->used) )
+            victim = e ;
+    }
+
+    if( victim )
+    {
+        if( victim->re )
+            grokCacheDrop( victim ) ;
+        victim->key = key ;
+        victim->key_len = regex_len ;
+        victim->re = re ;
+        victim->refs = 1 ;
+        victim->generation = generation ;
+        victim->used = ++preg_grok_clock ;
+    }
+    else
+        free( key ) ;
+    pthread_mutex_unlock( &preg_grok_lock ) ;
+
+    return re ;
+}
+
+/**
+ * @fn void pregGrokCacheRelease( struct preg_re_s *re )
+ *
+ * @brief give back a pattern returned by pregGrokCacheGet
+ *
+ * @param re - the pattern
+ *
+ * @details Patterns that weren't cached, and stale ones that are no longer 
+ * in use, are freed.
+ */
+void pregGrokCacheRelease( struct preg_re_s *re )
+{
+    struct preg_grok_cache_s *e ;
+    int i ;
+
+    pthread_mutex_lock( &preg_grok_lock ) ;
+    for( i = 0 ; i < PREG_GROK_CACHE_SIZE ; i++ )
+    {
+        e = &preg_grok_cache[i] ;
+        if( e->re == re )
+        {
+            if( !--e->refs && e->generation != preg_grok_generation )
+                grokCacheDrop( e ) ;
+            pthread_mutex_unlock( &preg_grok_lock ) ;
+            return ;
+        }
+    }
+    pthread_mutex_unlock( &preg_grok_lock ) ;
+
+    pregEngineFree( re ) ;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREG_GROK_H
+#define PREG_GROK_H
+
+/** @file preg_grok.h
+ *  
+ * @brief headers for grok expansion and the compiled grok pattern cache
+ */
+
+// Include the libpcre headers
+#include <pcre.h>
+#include "preg_engine.h"
+
+#define PREG_GROK_MAX_DEPTH 16          // deepest nesting of definitions
+#define PREG_GROK_MAX_NAME 64           // longest definition name
+#define PREG_GROK_MAX_DEFINITIONS 1024  // most user definitions
+#define PREG_GROK_CACHE_SIZE 64         // compiled grok patterns kept
+
+char *pregGrokExpand( const char *pattern , int coptions , 
+                      char *msg , int msglen ) ;
+int pregGrokDefine( const char *name , int name_len , 
+                    const char *pattern , int pattern_len , 
+                    char *msg , int msglen ) ;
+
+struct preg_re_s *pregGrokCacheGet( const char *regex , int regex_len , 
+                                    char *msg , int msglen ) ;
+void pregGrokCacheRelease( struct preg_re_s *re ) ;
+
+#endif
@@ -0,0 +1,995 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_optimize.c
+ *  
+ * @brief A rewriting pass that makes some common pattern shapes cheaper for
+ *        pcre to match without changing what they match or capture.
+ *
+ * @details The pass is enabled by the O modifier and is run by 
+ * compileRegex just before pcre_compile.  The rewrites are:
+ *
+ * @li alternations of literals that share a prefix are factored into a 
+ * trie (/foobar|foobaz|fooqux/ becomes /foo(?>ba[rz]|qux)/).  This is 
+ * only done when no literal is a prefix of another, since then at most
+ * one alternative can match at any position and the order of the 
+ * alternatives (and backtracking into them) doesn't matter.
+ *
+ * @li a greedy quantifier on a single character item is made possessive
+ * when the item that follows can't start with a character the quantified
+ * item matches (/\\d+-/ becomes /\\d++-/), or when nothing follows it in a 
+ * top level alternative.  Giving characters back could never help.
+ *
+ * @li a lazy .*? followed by a literal that ends a top level alternative 
+ * becomes a possessive negated class (/<.*?>/ becomes /<[^>\\n]*+>/).  
+ * Both stop at the first occurence of the literal.
+ *
+ * Patterns that the rewrites can't reason about (extended mode, ungreedy
+ * mode, inline options, \\Q...\\E, backtracking verbs) are left alone.  
+ * pcre_compile already anchors patterns that start with .* on its own, so
+ * no anchors are added here.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "preg_optimize.h"
+
+#define QUANT_GREEDY     0
+#define QUANT_LAZY       1
+#define QUANT_POSSESSIVE 2
+
+#define OPT_MAX_ALTERNATIVES 256  // longer alternations aren't factored
+
+/*
+ * A set of characters.  Used to tell whether quantified items are 
+ * followed by something they could match.
+ */
+typedef struct {
+    unsigned char bits[ 32 ] ;
+} opt_charset ;
+
+#define CHARSET_HAS(s,c) ((s)->bits[ (c) >> 3 ] & (1 << ((c) & 7)))
+#define CHARSET_ADD(s,c) ((s)->bits[ (c) >> 3 ] |= (1 << ((c) & 7)))
+
+struct preg_optimizer {
+    int options ;               /* pcre_compile options */
+    char *out ;                 /* the rewritten pattern */
+    int len ;                   /* length of out */
+    int size ;                  /* allocated size of out */
+    int failed ;                /* set if memory ran out */
+};
+
+
+/*
+ * Output:
+ */
+
+static void optAppend( struct preg_optimizer *opt , const char *s , int l )
+{
+    char *p ;
+    int n ;
+
+    if( opt->failed )
+        return ;
+
+    if( opt->len + l + 1 > opt->size )
+    {
+        n = ( opt->len + l + 1 ) * 2 ;
+        if( !(p = realloc( opt->out , n )) )
+        {
+            opt->failed = 1 ;
+            return ;
+        }
+        opt->out = p ;
+        opt->size = n ;
+    }
+
+    memcpy( opt->out + opt->len , s , l ) ;
+    opt->len += l ;
+    opt->out[ opt->len ] = '\0' ;
+}
+
+static void optPuts( struct preg_optimizer *opt , const char *s )
+{
+    optAppend( opt , s , strlen( s ) ) ;
+}
+
+/*
+ * write byte c so that it is a literal both inside and outside a class
+ */
+static void optPutLiteral( struct preg_optimizer *opt , int c )
+{
+    char buf[ 8 ] ;
+
+    if( isalnum( c ) || c == ' ' || c == '_' )
+        sprintf( buf , "%c" , c ) ;
+    else if( c > 0x20 && c < 0x7f )
+        sprintf( buf , "\\%c" , c ) ;
+    else
+        sprintf( buf , "\\x%02x" , c ) ;
+    optPuts( opt , buf ) ;
+}
+
+
+/*
+ * Scanning.  These return the end of the item that starts at p.
+ */
+
+static const char *scanPast( const char *p , const char *end , int c )
+{
+    while( p < end && *p != c )
+        p++ ;
+    return ( p < end ) ? p + 1 : end ;
+}
+
+static const char *scanEscape( const char *p , const char *end )
+{
+    if( p + 1 >= end )
+        return end ;
+
+    p++ ;
+    switch( *p++ )
+    {
+    case 'x':
+        if( p < end && *p == '{' )
+            return scanPast( p , end , '}' ) ;
+        if( p < end && isxdigit( (unsigned char)*p ) ) p++ ;
+        if( p < end && isxdigit( (unsigned char)*p ) ) p++ ;
+        return p ;
+
+    case '0':
+        if( p < end && *p >= '0' && *p <= '7' ) p++ ;
+        if( p < end && *p >= '0' && *p <= '7' ) p++ ;
+        return p ;
+
+    case '1': case '2': case '3': case '4': case '5': 
+    case '6': case '7': case '8': case '9':
+        while( p < end && isdigit( (unsigned char)*p ) ) 
+            p++ ;
+        return p ;
+
+    case 'c':
+        return ( p < end ) ? p + 1 : end ;
+
+    case 'p': case 'P':
+        if( p < end && *p == '{' )
+            return scanPast( p , end , '}' ) ;
+        return ( p < end ) ? p + 1 : end ;
+
+    case 'g': case 'k':
+        if( p < end && *p == '{' )
+            return scanPast( p , end , '}' ) ;
+        if( p < end && *p == '<' )
+            return scanPast( p , end , '>' ) ;
+        if( p < end && *p == '\'' )
+            return scanPast( p + 1 , end , '\'' ) ;
+        if( p < end && (*p == '-' || *p == '+') ) 
+            p++ ;
+        while( p < end && isdigit( (unsigned char)*p ) ) 
+            p++ ;
+        return p ;
+    }
+
+    return p ;
+}
+
+static const char *scanClass( const char *p , const char *end )
+{
+    const char *q ;
+
+    p++ ;
+    if( p < end && *p == '^' ) 
+        p++ ;
+    if( p < end && *p == ']' )
+        p++ ;
+
+    while( p < end )
+    {
+        if( *p == '\\' )
+            p = scanEscape( p , end ) ;
+        else if( *p == ']' )
+            return p + 1 ;
+        else if( *p == '[' && p + 1 < end && strchr( ":.=" , p[1] ) )
+        {
+            // [:posix:] - skip it if it is closed
+            for( q = p + 2 ; q + 1 < end ; q++ )
+            {
+                if( q[0] == p[1] && q[1] == ']' )
+                    break ;
+            }
+            p = ( q + 1 < end ) ? q + 2 : p + 1 ;
+        }
+        else
+            p++ ;
+    }
+    return end ;
+}
+
+static const char *scanAtom( const char *p , const char *end ) ;
+
+static const char *scanGroup( const char *p , const char *end )
+{
+    if( p + 2 < end && p[1] == '?' && p[2] == '#' )
+        return scanPast( p , end , ')' ) ;
+
+    p++ ;
+    while( p < end )
+    {
+        if( *p == ')' )
+            return p + 1 ;
+        p = scanAtom( p , end ) ;
+    }
+    return end ;
+}
+
+static const char *scanAtom( const char *p , const char *end )
+{
+    switch( *p )
+    {
+    case '\\': return scanEscape( p , end ) ;
+    case '[': return scanClass( p , end ) ;
+    case '(': return scanGroup( p , end ) ;
+    }
+    return p + 1 ;
+}
+
+/*
+ * scan the quantifier at p, if there is one.  Returns p if there isn't.
+ */
+static const char *scanQuantifier( const char *p , const char *end , 
+                                   int *min , int *mode )
+{
+    const char *q ;
+
+    *min = 1 ;
+    *mode = QUANT_GREEDY ;
+    if( p >= end )
+        return p ;
+
+    switch( *p )
+    {
+    case '*': *min = 0 ; q = p + 1 ; break ;
+    case '+': *min = 1 ; q = p + 1 ; break ;
+    case '?': *min = 0 ; q = p + 1 ; break ;
+    case '{':
+        q = p + 1 ;
+        if( q >= end || !isdigit( (unsigned char)*q ) )
+            return p ;
+        *min = atoi( q ) ;
+        while( q < end && isdigit( (unsigned char)*q ) )
+            q++ ;
+        if( q < end && *q == ',' )
+        {
+            q++ ;
+            while( q < end && isdigit( (unsigned char)*q ) )
+                q++ ;
+        }
+        if( q >= end || *q != '}' )
+        {
+            *min = 1 ;
+            return p ;
+        }
+        q++ ;
+        break ;
+    default:
+        return p ;
+    }
+
+    if( q < end && *q == '+' )
+    {
+        *mode = QUANT_POSSESSIVE ;
+        q++ ;
+    }
+    else if( q < end && *q == '?' )
+    {
+        *mode = QUANT_LAZY ;
+        q++ ;
+    }
+    return q ;
+}
+
+
+/*
+ * Character sets of single character items:
+ */
+
+static void charsetRange( opt_charset *set , int lo , int hi )
+{
+    for( ; lo <= hi ; lo++ )
+        CHARSET_ADD( set , lo ) ;
+}
+
+static void charsetNegate( opt_charset *set )
+{
+    int i ;
+
+    for( i = 0 ; i < 32 ; i++ )
+        set->bits[i] = ~set->bits[i] ;
+}
+
+static void charsetFold( opt_charset *set )
+{
+    int c ;
+
+    for( c = 'a' ; c <= 'z' ; c++ )
+    {
+        if( CHARSET_HAS( set , c ) || CHARSET_HAS( set , c - 32 ) )
+        {
+            CHARSET_ADD( set , c ) ;
+            CHARSET_ADD( set , c - 32 ) ;
+        }
+    }
+}
+
+static int charsetDisjoint( const opt_charset *s1 , const opt_charset *s2 )
+{
+    int i ;
+
+    for( i = 0 ; i < 32 ; i++ )
+    {
+        if( s1->bits[i] & s2->bits[i] )
+            return 0 ;
+    }
+    return 1 ;
+}
+
+/*
+ * Decode the escape at p that stands for a single byte.  
+ *
+ * returns the byte or -1 if it isn't one.
+ */
+static int escapeByte( const char *p , const char *e , int options )
+{
+    int c , v ;
+
+    if( e - p < 2 )
+        return -1 ;
+
+    c = (unsigned char)p[1] ;
+    switch( c )
+    {
+    case 'n': return '\n' ;
+    case 'r': return '\r' ;
+    case 't': return '\t' ;
+    case 'f': return '\f' ;
+    case 'e': return 0x1b ;
+    case 'a': return 0x07 ;
+    case 'x': 
+    case '0':
+        v = 0 ;
+        for( p += 2 ; p < e ; p++ )
+        {
+            if( *p == '{' || *p == '}' )
+                continue ;
+            v = v * ( c == 'x' ? 16 : 8 ) + 
+                ( isdigit( (unsigned char)*p ) ? *p - '0' : 
+                  tolower( (unsigned char)*p ) - 'a' + 10 ) ;
+            if( v > 255 )
+                return -1 ;
+        }
+        // > 127 is a character (not a byte) in UTF-8 mode
+        if( v > 127 && (options & PCRE_UTF8) )
+            return -1 ;
+        return v ;
+    }
+
+    if( isalnum( c ) || e - p != 2 || c > 127 )
+        return -1 ;
+    return c ;
+}
+
+/*
+ * Decode a literal byte
+ *
+ * returns the byte or -1 if the item at p isn't a single literal byte.
+ */
+static int literalByte( const char *p , const char *e , int options )
+{
+    int c = (unsigned char)*p ;
+
+    if( c == '\\' )
+        return escapeByte( p , e , options ) ;
+
+    if( e - p != 1 || strchr( "^$.[|()?*+{" , c ) )
+        return -1 ;
+    if( c > 127 && (options & PCRE_UTF8) )
+        return -1 ;
+    return c ;
+}
+
+/*
+ * Put the set for the \d style escape at p in set
+ *
+ * returns 1 if it is one of those, else 0
+ */
+static int escapeSet( const char *p , const char *e , opt_charset *set )
+{
+    int c ;
+
+    if( e - p != 2 )
+        return 0 ;
+
+    memset( set , 0 , sizeof(*set) ) ;
+    c = (unsigned char)p[1] ;
+    switch( tolower( c ) )
+    {
+    case 'd':
+        charsetRange( set , '0' , '9' ) ;
+        break ;
+    case 'w':
+        charsetRange( set , '0' , '9' ) ;
+        charsetRange( set , 'a' , 'z' ) ;
+        charsetRange( set , 'A' , 'Z' ) ;
+        CHARSET_ADD( set , '_' ) ;
+        break ;
+    case 's':
+        charsetRange( set , '\t' , '\r' ) ;
+        CHARSET_ADD( set , ' ' ) ;
+        break ;
+    case 'h':
+        CHARSET_ADD( set , '\t' ) ;
+        CHARSET_ADD( set , ' ' ) ;
+        CHARSET_ADD( set , 0xa0 ) ;
+        break ;
+    case 'v':
+        charsetRange( set , '\n' , '\r' ) ;
+        CHARSET_ADD( set , 0x85 ) ;
+        break ;
+    default:
+        return 0 ;
+    }
+
+    if( isupper( c ) )
+        charsetNegate( set ) ;
+    return 1 ;
+}
+
+/*
+ * Put the set of a simple class ([a-z_], [^\d\s], ...) in set
+ *
+ * returns 1 on success, 0 if the class is too complicated
+ */
+static int classSet( const char *p , const char *e , int options , 
+                     opt_charset *set )
+{
+    opt_charset tmp ;
+    const char *q ;
+    int first = 1 ;
+    int hi , lo ;
+    int neg = 0 ;
+
+    memset( set , 0 , sizeof(*set) ) ;
+    p++ ;
+    if( p < e && *p == '^' )
+    {
+        neg = 1 ;
+        p++ ;
+    }
+
+    while( p < e )
+    {
+        if( *p == ']' && !first )
+            break ;
+        first = 0 ;
+
+        if( *p == '[' )
+            return 0 ;          // posix classes aren't handled
+
+        if( *p == '\\' )
+        {
+            q = scanEscape( p , e ) ;
+            if( escapeSet( p , q , &tmp ) )
+            {
+                for( lo = 0 ; lo < 32 ; lo++ )
+                    set->bits[ lo ] |= tmp.bits[ lo ] ;
+                p = q ;
+                continue ;
+            }
+            // \b is a backspace in a class
+            lo = ( q - p == 2 && p[1] == 'b' ) ? '\b' : 
+                escapeByte( p , q , options ) ;
+        }
+        else
+        {
+            q = p + 1 ;
+            lo = (unsigned char)*p ;
+            if( lo > 127 && (options & PCRE_UTF8) )
+                return 0 ;
+        }
+        if( lo < 0 )
+            return 0 ;
+        p = q ;
+
+        hi = lo ;
+        if( p + 1 < e && *p == '-' && p[1] != ']' )
+        {
+            p++ ;
+            if( *p == '\\' )
+            {
+                q = scanEscape( p , e ) ;
+                hi = escapeByte( p , q , options ) ;
+                p = q ;
+            }
+            else if( *p == '[' )
+                return 0 ;
+            else
+                hi = (unsigned char)*p++ ;
+            if( hi < lo || (hi > 127 && (options & PCRE_UTF8)) )
+                return 0 ;
+        }
+        charsetRange( set , lo , hi ) ;
+    }
+
+    if( options & PCRE_CASELESS )
+        charsetFold( set ) ;
+    if( neg )
+        charsetNegate( set ) ;
+    return 1 ;
+}
+
+/*
+ * Put the set of characters that the single character item at p can
+ * match in set.
+ *
+ * returns 1 on success, 0 if the item isn't a single character item
+ */
+static int atomSet( const char *p , const char *e , int options , 
+                    opt_charset *set )
+{
+    int c ;
+
+    memset( set , 0 , sizeof(*set) ) ;
+
+    if( *p == '[' )
+        return classSet( p , e , options , set ) ;
+
+    if( *p == '.' && e - p == 1 )
+    {
+        memset( set , 0xff , sizeof(*set) ) ;
+        if( !(options & PCRE_DOTALL) )
+            set->bits[ '\n' >> 3 ] &= ~(1 << ('\n' & 7)) ;
+        return 1 ;
+    }
+
+    if( *p == '\\' && escapeSet( p , e , set ) )
+        return 1 ;
+
+    c = literalByte( p , e , options ) ;
+    if( c < 0 )
+        return 0 ;
+    CHARSET_ADD( set , c ) ;
+    if( options & PCRE_CASELESS )
+        charsetFold( set ) ;
+    return 1 ;
+}
+
+
+/*
+ * Alternations of literals:
+ */
+
+static int optSameByte( struct preg_optimizer *opt , int a , int b )
+{
+    if( opt->options & PCRE_CASELESS )
+        return tolower( a ) == tolower( b ) ;
+    return a == b ;
+}
+
+/*
+ * write a trie of the n prefix free literals s[] (lengths in l[])
+ */
+static void optEmitTrie( struct preg_optimizer *opt , 
+                         unsigned char **s , int *l , int n )
+{
+    unsigned char **gs ;        /* literals in the current group */
+    int *gl ;
+    char *done ;
+    int i , j , k ;
+    int lcp ;                   /* common prefix of the group */
+    int ng ;                    /* size of the group */
+    int single ;                /* are all suffixes one byte long? */
+    int first = 1 ;
+
+    gs = malloc( n * sizeof(*gs) ) ;
+    gl = malloc( n * sizeof(*gl) ) ;
+    done = calloc( n , 1 ) ;
+    if( !gs || !gl || !done )
+    {
+        opt->failed = 1 ;
+        goto cleanup ;
+    }
+
+    for( i = 0 ; i < n ; i++ )
+    {
+        if( done[i] )
+            continue ;
+
+        // the group of literals that start with the same byte as s[i]
+        ng = 0 ;
+        lcp = l[i] ;
+        for( j = i ; j < n ; j++ )
+        {
+            if( done[j] || !optSameByte( opt , s[i][0] , s[j][0] ) )
+                continue ;
+            done[j] = 1 ;
+            for( k = 0 ; k < lcp && k < l[j] && 
+                     optSameByte( opt , s[i][k] , s[j][k] ) ; k++ )
+                ;
+            lcp = k ;
+            gs[ ng ] = s[j] ;
+            gl[ ng ] = l[j] ;
+            ng++ ;
+        }
+
+        if( !first )
+            optPuts( opt , "|" ) ;
+        first = 0 ;
+
+        if( ng == 1 )
+        {
+            for( k = 0 ; k < l[i] ; k++ )
+                optPutLiteral( opt , s[i][k] ) ;
+            continue ;
+        }
+
+        for( k = 0 ; k < lcp ; k++ )
+            optPutLiteral( opt , s[i][k] ) ;
+
+        // the literals are prefix free, so no suffix is empty
+        single = 1 ;
+        for( j = 0 ; j < ng ; j++ )
+        {
+            gs[j] += lcp ;
+            gl[j] -= lcp ;
+            if( gl[j] != 1 )
+                single = 0 ;
+        }
+
+        if( single )
+        {
+            optPuts( opt , "[" ) ;
+            for( j = 0 ; j < ng ; j++ )
+                optPutLiteral( opt , gs[j][0] ) ;
+            optPuts( opt , "]" ) ;
+        }
+        else
+        {
+            // only one alternative can match, so backtracking is pointless
+            optPuts( opt , "(?>" ) ;
+            optEmitTrie( opt , gs , gl , ng ) ;
+            optPuts( opt , ")" ) ;
+        }
+    }
+
+cleanup:
+    free( gs ) ;
+    free( gl ) ;
+    free( done ) ;
+}
+
+/*
+ * If the n alternatives (at alt[i] to alt[i+1]-1) are all literals with no
+ * literal a prefix of another, write them as a trie.
+ *
+ * returns 1 if the trie was written, 0 if it can't be done
+ */
+static int optLiteralAlternation( struct preg_optimizer *opt , 
+                                  const char **alt , int n )
+{
+    unsigned char *buf = NULL ; /* the decoded literals */
+    unsigned char *s[ OPT_MAX_ALTERNATIVES ] ;
+    int l[ OPT_MAX_ALTERNATIVES ] ;
+    const char *p , *q ;
+    int c ;
+    int i , j , k ;
+    int ok = 0 ;
+
+    // alt[n] is just after the end of the last alternative
+    if( n < 2 )
+        return 0 ;
+
+    buf = malloc( alt[n] - alt[0] + 1 ) ;
+    if( !buf )
+        return 0 ;
+
+    // decode
+    for( i = 0 , k = 0 ; i < n ; i++ )
+    {
+        s[i] = buf + k ;
+        for( p = alt[i] ; p < alt[i+1] - 1 ; p = q )
+        {
+            q = scanAtom( p , alt[i+1] - 1 ) ;
+            c = literalByte( p , q , opt->options ) ;
+            if( c < 0 )
+                goto done ;
+            buf[ k++ ] = (unsigned char)c ;
+        }
+        l[i] = (int)( buf + k - s[i] ) ;
+        if( !l[i] )
+            goto done ;
+    }
+
+    // prefix free?
+    for( i = 0 ; i < n ; i++ )
+    {
+        for( j = i + 1 ; j < n ; j++ )
+        {
+            for( k = 0 ; k < l[i] && k < l[j] && 
+                     optSameByte( opt , s[i][k] , s[j][k] ) ; k++ )
+                ;
+            if( k == l[i] || k == l[j] )
+                goto done ;
+        }
+    }
+
+    optEmitTrie( opt , s , l , n ) ;
+    ok = 1 ;
+
+done:
+    free( buf ) ;
+    return ok ;
+}
+
+
+/*
+ * Rewriting:
+ */
+
+static void optAlternation( struct preg_optimizer *opt , 
+                            const char *p , const char *end , int toplevel ) ;
+
+/*
+ * write the group at p (which ends at e), rewriting its contents if it
+ * is a kind of group that is understood
+ */
+static void optGroup( struct preg_optimizer *opt , 
+                      const char *p , const char *e )
+{
+    const char *h = p + 1 ;     /* end of the group header */
+
+    if( e[-1] != ')' || e - p < 2 )
+    {
+        optAppend( opt , p , e - p ) ;
+        return ;
+    }
+
+    if( *h == '?' )
+    {
+        if( e - h > 1 && strchr( ":>=!" , h[1] ) )
+            h += 2 ;
+        else if( e - h > 2 && h[1] == '<' && h[2] != '=' && h[2] != '!' )
+            h = scanPast( h , e , '>' ) ;
+        else if( e - h > 2 && h[1] == 'P' && h[2] == '<' )
+            h = scanPast( h , e , '>' ) ;
+        else if( e - h > 1 && h[1] == '\'' )
+            h = scanPast( h + 2 , e , '\'' ) ;
+        else
+        {
+            // comments, lookbehinds, conditions, recursion, ...
+            optAppend( opt , p , e - p ) ;
+            return ;
+        }
+    }
+
+    optAppend( opt , p , h - p ) ;
+    optAlternation( opt , h , e - 1 , 0 ) ;
+    optPuts( opt , ")" ) ;
+}
+
+/*
+ * write a sequence of items (that ends at end)
+ */
+static void optSequence( struct preg_optimizer *opt , 
+                         const char *p , const char *end , int toplevel )
+{
+    opt_charset set , next ;
+    const char *a ;             /* end of the current atom */
+    const char *q ;             /* end of the current quantifier */
+    const char *na , *nq ;      /* same for the next item */
+    int c ;
+    int min , mode ;
+    int nmin , nmode ;
+    int possessive ;
+
+    while( p < end && !opt->failed )
+    {
+        a = scanAtom( p , end ) ;
+        q = scanQuantifier( a , end , &min , &mode ) ;
+
+        na = nq = q ;
+        nmin = 1 ;
+        if( q < end )
+        {
+            na = scanAtom( q , end ) ;
+            nq = scanQuantifier( na , end , &nmin , &nmode ) ;
+        }
+
+        if( *p == '(' )
+        {
+            optGroup( opt , p , a ) ;
+            optAppend( opt , a , q - a ) ;
+            p = q ;
+            continue ;
+        }
+
+        // .*? and a literal at the end of the pattern 
+        if( toplevel && a - p == 1 && *p == '.' && q - a == 2 && *a == '*' &&
+            mode == QUANT_LAZY && nq == end && na == end && 
+            (c = literalByte( q , na , opt->options )) >= 0 )
+        {
+            optPuts( opt , "[^" ) ;
+            optPutLiteral( opt , c ) ;
+            if( !(opt->options & PCRE_DOTALL) && c != '\n' )
+                optPuts( opt , "\\n" ) ;
+            optPuts( opt , "]*+" ) ;
+            optAppend( opt , q , na - q ) ;
+            p = na ;
+            continue ;
+        }
+
+        possessive = 0 ;
+        if( q > a && mode == QUANT_GREEDY && 
+            atomSet( p , a , opt->options , &set ) )
+        {
+            if( q == end )
+                possessive = toplevel ;
+            else if( na - q == 1 && *q == '$' )
+            {
+                memset( &next , 0 , sizeof(next) ) ;
+                if( !(opt->options & PCRE_DOLLAR_ENDONLY) || 
+                    (opt->options & PCRE_MULTILINE) )
+                    CHARSET_ADD( &next , '\n' ) ;
+                possessive = charsetDisjoint( &set , &next ) ;
+            }
+            else if( na - q == 2 && q[0] == '\\' && 
+                     (q[1] == 'z' || q[1] == 'Z') )
+            {
+                memset( &next , 0 , sizeof(next) ) ;
+                if( q[1] == 'Z' )
+                    CHARSET_ADD( &next , '\n' ) ;
+                possessive = charsetDisjoint( &set , &next ) ;
+            }
+            else if( nmin > 0 && atomSet( q , na , opt->options , &next ) )
+                possessive = charsetDisjoint( &set , &next ) ;
+        }
+
+        optAppend( opt , p , q - p ) ;
+        if( possessive )
+            optPuts( opt , "+" ) ;
+        p = q ;
+    }
+}
+
+/*
+ * write the alternatives in p to end
+ */
+static void optAlternation( struct preg_optimizer *opt , 
+                            const char *p , const char *end , int toplevel )
+{
+    const char *alt[ OPT_MAX_ALTERNATIVES + 1 ] ;
+    const char *q ;
+    int i , n ;
+
+    // find the alternatives.  alt[i+1] is just after the | ending alt[i].
+    n = 0 ;
+    alt[ n++ ] = p ;
+    for( q = p ; q < end ; )
+    {
+        if( *q == '|' )
+        {
+            if( n == OPT_MAX_ALTERNATIVES )
+                break ;
+            alt[ n++ ] = ++q ;
+        }
+        else
+            q = scanAtom( q , end ) ;
+    }
+
+    if( q >= end )
+    {
+        alt[ n ] = end + 1 ;
+        if( optLiteralAlternation( opt , alt , n ) )
+            return ;
+    }
+
+    for( i = 0 ; i < n ; i++ )
+    {
+        if( i )
+            optPuts( opt , "|" ) ;
+        optSequence( opt , alt[i] , 
+                     i + 1 < n ? alt[ i+1 ] - 1 : end , toplevel ) ;
+    }
+}
+
+/*
+ * Can the pattern be rewritten?
+ */
+static int optSupported( const char *p , int options )
+{
+    if( options & (PCRE_EXTENDED | PCRE_UNGREEDY) )
+        return 0 ;
+
+    for( ; *p ; p++ )
+    {
+        if( *p == '\\' )
+        {
+            if( p[1] == 'Q' || p[1] == 'E' )
+                return 0 ;
+            if( p[1] )
+                p++ ;
+        }
+        else if( *p == '(' && p[1] == '*' )
+            return 0 ;
+        else if( *p == '(' && p[1] == '?' && p[2] && strchr( "imsxXUJ-^" , p[2] ) )
+            return 0 ;
+    }
+    return 1 ;
+}
+
+
+/**
+ * @fn char *pregOptimizePattern( const char *pattern , int coptions )
+ *
+ * @brief rewrite a pattern into a form that is faster to match
+ *
+ * @param pattern - null terminated pattern without delimiters or modifiers
+ * (as returned by parseRegex)
+ * @param coptions - the pcre_compile options from the modifiers
+ *
+ * @return the rewritten pattern - on success.  It must be free'd by the 
+ * caller.  It is a copy of pattern if nothing could be done.
+ * @return NULL - if memory runs out
+ *
+ * @details The rewritten pattern matches the same subjects at the same
+ * offsets with the same captures as pattern.  pattern should be a valid 
+ * pattern, since invalid ones aren't always noticed.
+ */
+char *pregOptimizePattern( const char *pattern , int coptions )
+{
+    struct preg_optimizer opt ;
+    int l = strlen( pattern ) ;
+
+    memset( &opt , 0 , sizeof(opt) ) ;
+    opt.options = coptions ;
+
+    if( optSupported( pattern , coptions ) )
+        optAlternation( &opt , pattern , pattern + l , 1 ) ;
+    else
+        optAppend( &opt , pattern , l ) ;
+
+    if( !opt.out && !opt.failed )
+        optAppend( &opt , "" , 0 ) ;
+
+    if( opt.failed )
+    {
+        free( opt.out ) ;
+        return NULL ;
+    }
+    return opt.out ;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_pool.c
+ *  
+ * @brief Keeps a pool of return buffers for each thread, so statements 
+ *        don't malloc and free a big buffer for every udf call.
+ *
+ * @details pregInit used to malloc the return buffer (1 MB when there is
+ * no max_length) for every udf in every statement, and pregDeInit freed 
+ * it.  malloc serves blocks that big with mmap, so every short statement
+ * paid for mapping, faulting in and unmapping the buffer.  Now pregInit 
+ * borrows a buffer from the pool of the thread running the statement,
+ * and pregDeInit gives it back, so the buffer stays warm for the next 
+ * statement on that connection.
+ *
+ * Buffers are kept in power of 2 size classes from 4 KB to 1 MB, and a 
+ * request is rounded up to its class.  Bigger buffers are not pooled.  A
+ * pool keeps at most PREG_POOL_DEFAULT_BYTES, or the number of bytes in 
+ * the LIB_MYSQLUDF_PREG_POOL_BYTES environment variable (0 turns pooling
+ * off).  A buffer given back to a full pool, or that has grown to a size
+ * that isn't a class, is freed; that is a trim.
+ *
+ * Each pool is only used by its own thread, so borrowing and giving back
+ * take no locks.  The pools are also kept in a list, so that 
+ * pregPoolGetStats can add up their counters, and so they can all be 
+ * freed when the library is unloaded.  A thread's pool is freed when the
+ * thread exits.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* For pthreads */
+#include <pthread.h>
+
+#include "preg_pool.h"
+
+/*
+ * A buffer in a pool.  The link is kept in the buffer itself.
+ */
+struct preg_pool_buf_s {
+    struct preg_pool_buf_s *next ;
+};
+
+/*
+ * One thread's pool.
+ */
+struct preg_pool_s {
+    struct preg_pool_buf_s *free[ PREG_POOL_CLASSES ] ; /* by size class */
+    unsigned long retained ;    /* bytes in free */
+    unsigned long long hits ;
+    unsigned long long misses ;
+    unsigned long long trims ;
+    struct preg_pool_s *next ;  /* in preg_pool_all */
+    struct preg_pool_s *prev ;
+};
+
+static pthread_once_t preg_pool_once = PTHREAD_ONCE_INIT ;
+static pthread_key_t preg_pool_key ;
+static int preg_pool_have_key = 0 ;
+static unsigned long preg_pool_max = PREG_POOL_DEFAULT_BYTES ;
+
+/*
+ * preg_pool_lock protects the list of pools and the counters of pools 
+ * that are gone.
+ */
+static pthread_mutex_t preg_pool_lock = PTHREAD_MUTEX_INITIALIZER ;
+static struct preg_pool_s *preg_pool_all = NULL ;
+static struct preg_pool_stats_s preg_pool_gone ;
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static void pregPoolFree( struct preg_pool_s *pool )
+ *
+ * @brief free a pool and its buffers.  It must already be off the list.
+ */
+static void pregPoolFree( struct preg_pool_s *pool )
+{
+    struct preg_pool_buf_s *b ;
+    int i ;
+
+    for( i = 0 ; i < PREG_POOL_CLASSES ; i++ )
+    {
+        while( (b = pool->free[i]) )
+        {
+            pool->free[i] = b->next ;
+            free( b ) ;
+        }
+    }
+    free( pool ) ;
+}
+
+/**
+ * @fn static void pregPoolThreadExit( void *p )
+ *
+ * @brief free the pool of a thread that is exiting
+ *
+ * @details The pool's counters are kept in preg_pool_gone, so the totals
+ * don't go backwards.
+ */
+static void pregPoolThreadExit( void *p )
+{
+    struct preg_pool_s *pool = (struct preg_pool_s *)p ;
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    if( pool->prev )
+        pool->prev->next = pool->next ;
+    else
+        preg_pool_all = pool->next ;
+    if( pool->next )
+        pool->next->prev = pool->prev ;
+
+    preg_pool_gone.hits += pool->hits ;
+    preg_pool_gone.misses += pool->misses ;
+    preg_pool_gone.trims += pool->trims ;
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+
+    pregPoolFree( pool ) ;
+}
+
+/**
+ * @fn static void pregPoolSetup( void )
+ *
+ * @brief create the thread key and read the pool size from the environment
+ */
+static void pregPoolSetup( void )
+{
+    char *s ;
+
+    s = getenv( PREG_POOL_BYTES_ENV ) ;
+    if( s )
+        preg_pool_max = strtoul( s , NULL , 10 ) ;
+
+    if( !pthread_key_create( &preg_pool_key , pregPoolThreadExit ) )
+        preg_pool_have_key = 1 ;
+}
+
+/**
+ * @fn static void pregPoolUnload( void )
+ *
+ * @brief free all of the pools when the library is unloaded
+ *
+ * @details The thread key is deleted first, so threads that are still 
+ * running won't call pregPoolThreadExit (which is about to be unloaded)
+ * when they exit.
+ */
+static void pregPoolUnload( void ) __attribute__((destructor)) ;
+static void pregPoolUnload( void )
+{
+    struct preg_pool_s *pool ;
+
+    if( !preg_pool_have_key )
+        return ;
+
+    pthread_key_delete( preg_pool_key ) ;
+    preg_pool_have_key = 0 ;
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    while( (pool = preg_pool_all) )
+    {
+        preg_pool_all = pool->next ;
+        pregPoolFree( pool ) ;
+    }
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+}
+
+/**
+ * @fn static struct preg_pool_s *pregPoolMine( void )
+ *
+ * @brief get the calling thread's pool, making it if needed
+ *
+ * @return - the pool
+ * @return - NULL - if pooling is off or there is no memory
+ */
+static struct preg_pool_s *pregPoolMine( void )
+{
+    struct preg_pool_s *pool ;
+
+    pthread_once( &preg_pool_once , pregPoolSetup ) ;
+    if( !preg_pool_have_key || !preg_pool_max )
+        return NULL ;
+
+    pool = (struct preg_pool_s *)pthread_getspecific( preg_pool_key ) ;
+    if( pool )
+        return pool ;
+
+    pool = (struct preg_pool_s *)calloc( 1 , sizeof( struct preg_pool_s ) ) ;
+    if( !pool )
+        return NULL ;
+    if( pthread_setspecific( preg_pool_key , pool ) )
+    {
+        free( pool ) ;
+        return NULL ;
+    }
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    pool->next = preg_pool_all ;
+    if( preg_pool_all )
+        preg_pool_all->prev = pool ;
+    preg_pool_all = pool ;
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+
+    return pool ;
+}
+
+/**
+ * @fn static int pregPoolClass( unsigned long size )
+ *
+ * @brief get the smallest size class that holds size bytes
+ *
+ * @return - the class
+ * @return - -1 - if size is bigger than the biggest class
+ */
+static int pregPoolClass( unsigned long size )
+{
+    int i ;
+
+    for( i = 0 ; i < PREG_POOL_CLASSES ; i++ )
+    {
+        if( size <= (1UL << (PREG_POOL_MIN_SHIFT + i)) )
+            return i ;
+    }
+    return -1 ;
+}
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn char *pregPoolGet( unsigned long *size )
+ *
+ * @brief
+ *     borrow a buffer from the calling thread's pool
+ *
+ * @param size - the number of bytes needed.  It is set to the size of 
+ * the buffer returned, which can be bigger.
+ *
+ * @return - the buffer.  Give it back with pregPoolPut.
+ * @return - NULL - if there is no memory
+ */
+char *pregPoolGet( unsigned long *size )
+{
+    struct preg_pool_s *pool ;
+    struct preg_pool_buf_s *b ;
+    int c ;                     /* size class */
+
+    c = pregPoolClass( *size ) ;
+    pool = (c < 0) ? NULL : pregPoolMine() ;
+    if( !pool )
+        return malloc( *size ) ;
+
+    *size = 1UL << (PREG_POOL_MIN_SHIFT + c) ;
+    b = pool->free[c] ;
+    if( b )
+    {
+        pool->free[c] = b->next ;
+        pool->retained -= *size ;
+        pool->hits++ ;
+        return (char *)b ;
+    }
+
+    pool->misses++ ;
+    return malloc( *size ) ;
+}
+
+/**
+ * @fn void pregPoolPut( char *buf , unsigned long size )
+ *
+ * @brief
+ *     give a buffer back to the calling thread's pool
+ *
+ * @param buf - a buffer from pregPoolGet.  It may have been realloc'd.
+ * @param size - the size of buf now
+ *
+ * @details The buffer is freed instead if it isn't the size of a class,
+ * or if the pool would be over its limit.
+ */
+void pregPoolPut( char *buf , unsigned long size )
+{
+    struct preg_pool_s *pool ;
+    struct preg_pool_buf_s *b ;
+    int c ;                     /* size class */
+
+    if( !buf )
+        return ;
+
+    pool = pregPoolMine() ;
+    if( !pool )
+    {
+        free( buf ) ;
+        return ;
+    }
+
+    c = pregPoolClass( size ) ;
+    if( c < 0 || size != (1UL << (PREG_POOL_MIN_SHIFT + c)) || 
+        pool->retained + size > preg_pool_max )
+    {
+        pool->trims++ ;
+        free( buf ) ;
+        return ;
+    }
+
+    b = (struct preg_pool_buf_s *)buf ;
+    b->next = pool->free[c] ;
+    pool->free[c] = b ;
+    pool->retained += size ;
+}
+
+/**
+ * @fn void pregPoolGetStats( struct preg_pool_stats_s *st )
+ *
+ * @brief
+ *     add up the counters of all of the pools
+ *
+ * @details The other threads' counters are read without stopping them, 
+ * so the totals are only approximate while statements are running.
+ */
+void pregPoolGetStats( struct preg_pool_stats_s *st )
+{
+    struct preg_pool_s *pool ;
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    *st = preg_pool_gone ;
+    for( pool = preg_pool_all ; pool ; pool = pool->next )
+    {
+        st->hits += pool->hits ;
+        st->misses += pool->misses ;
+        st->trims += pool->trims ;
+        st->retained += pool->retained ;
+        st->threads++ ;
+    }
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREG_POOL_H
+#define PREG_POOL_H
+
+/** @file preg_pool.h
+ *  
+ * @brief headers for the per-thread pool of return buffers
+ */
+
+// Environment variable with the most bytes each thread's pool keeps
+#define PREG_POOL_BYTES_ENV "LIB_MYSQLUDF_PREG_POOL_BYTES"
+#define PREG_POOL_DEFAULT_BYTES (4UL << 20)
+
+#define PREG_POOL_MIN_SHIFT 12          // smallest size class is 4 KB
+#define PREG_POOL_CLASSES 9             // size classes are 4 KB to 1 MB
+
+/*
+ * Pool counters for all threads.
+ */
+struct preg_pool_stats_s {
+    unsigned long long hits ;           /* buffers reused from a pool */
+    unsigned long long misses ;         /* buffers that had to be malloc'd */
+    unsigned long long trims ;          /* returned buffers freed instead */
+    unsigned long long retained ;       /* bytes kept in pools now */
+    unsigned long threads ;             /* threads with a pool */
+};
+
+char *pregPoolGet( unsigned long *size ) ;
+void pregPoolPut( char *buf , unsigned long size ) ;
+void pregPoolGetStats( struct preg_pool_stats_s *st ) ;
+
+#endif
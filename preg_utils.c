@@ -33,6 +33,7 @@
  */
 
 #include <pthread.h>
+#include <string.h>
 
 #include "preg_utils.h"
 #include "ghfcns.h"
@@ -222,3 +223,395 @@ const char *pregExecErrorString(int pcre_errno) {
         return _pregExecErrorString[26];
     }
 }
+
+/**
+ * @fn int pregJsonEscapedLength( const char *s , int l )
+ *
+ * @brief
+ *     returns the length of s once it is escaped for a JSON string
+ *
+ * @param s - the string
+ * @param l - length of s
+ *
+ * @details This is the number of bytes that pregJsonEscape writes 
+ * for s, so the caller can size the buffer first.
+ */
+int pregJsonEscapedLength(const char *s, int l)
+{
+    int n = 0 ;
+    int i ;
+
+    for( i = 0 ; i < l ; i++ )
+    {
+        switch( s[i] )
+        {
+        case '"': case '\\': case '\b': case '\f':
+        case '\n': case '\r': case '\t':
+            n += 2 ;
+            break ;
+        default:
+            n += ((unsigned char)s[i] < 0x20) ? 6 : 1 ;
+        }
+    }
+
+    return n ;
+}
+
+/**
+ * @fn char *pregJsonEscape( char *dst , const char *s , int l )
+ *
+ * @brief
+ *     writes s to dst escaped for a JSON string, without the quotes
+ *
+ * @param dst - where to write.  It must have room for 
+ * pregJsonEscapedLength( s , l ) bytes.
+ * @param s - the string
+ * @param l - length of s
+ *
+ * @return - the position in dst after the last byte written
+ *
+ * @details Quotes, backslashes and control characters are escaped.  
+ * Other bytes are copied as they are, so UTF-8 stays UTF-8.
+ */
+char *pregJsonEscape(char *dst, const char *s, int l)
+{
+    static const char hex[] = "0123456789abcdef" ;
+    int i ;
+
+    for( i = 0 ; i < l ; i++ )
+    {
+        switch( s[i] )
+        {
+        case '"':  *dst++ = '\\' ; *dst++ = '"' ; break ;
+        case '\\': *dst++ = '\\' ; *dst++ = '\\' ; break ;
+        case '\b': *dst++ = '\\' ; *dst++ = 'b' ; break ;
+        case '\f': *dst++ = '\\' ; *dst++ = 'f' ; break ;
+        case '\n': *dst++ = '\\' ; *dst++ = 'n' ; break ;
+        case '\r': *dst++ = '\\' ; *dst++ = 'r' ; break ;
+        case '\t': *dst++ = '\\' ; *dst++ = 't' ; break ;
+        default:
+            if( (unsigned char)s[i] < 0x20 )
+            {
+                memcpy( dst , "\\u00" , 4 ) ;
+                dst[4] = hex[ (unsigned char)s[i] >> 4 ] ;
+                dst[5] = hex[ s[i] & 0xf ] ;
+                dst += 6 ;
+            }
+            else
+                *dst++ = s[i] ;
+        }
+    }
+
+    return dst ;
+}
+
+/**
+ * @fn int pregJsonStringLength( const char *s , int l )
+ *
+ * @brief
+ *     returns the length of s as a quoted JSON string
+ *
+ * @param s - the string
+ * @param l - length of s
+ */
+int pregJsonStringLength(const char *s, int l)
+{
+    return pregJsonEscapedLength( s , l ) + 2 ;
+}
+
+/**
+ * @fn char *pregJsonString( char *dst , const char *s , int l )
+ *
+ * @brief
+ *     writes s to dst as a quoted JSON string
+ *
+ * @param dst - where to write.  It must have room for 
+ * pregJsonStringLength( s , l ) bytes.
+ * @param s - the string
+ * @param l - length of s
+ *
+ * @return - the position in dst after the closing quote
+ */
+char *pregJsonString(char *dst, const char *s, int l)
+{
+    *dst++ = '"' ;
+    dst = pregJsonEscape( dst , s , l ) ;
+    *dst++ = '"' ;
+
+    return dst ;
+}
+
+/**
+ * @fn static const char *pregJsonSkipSpace( const char *p , const char *end )
+ *
+ * @brief returns the first non whitespace character at or after p
+ */
+static const char *pregJsonSkipSpace(const char *p, const char *end)
+{
+    while( p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') )
+        p++ ;
+    return p ;
+}
+
+/**
+ * @fn static const char *pregJsonSkipString( const char *p , 
+ *                                            const char *end , 
+ *                                            int *escaped )
+ *
+ * @brief returns the position of the closing quote of the string that 
+ * starts after the opening quote at p, or NULL if it isn't closed
+ *
+ * @param escaped - set if the string has any backslash escapes
+ */
+static const char *pregJsonSkipString(const char *p, const char *end, 
+                                      int *escaped)
+{
+    while( p < end && *p != '"' )
+    {
+        if( *p == '\\' )
+        {
+            *escaped = 1 ;
+            p++ ;
+        }
+        p++ ;
+    }
+    return (p < end) ? p : NULL ;
+}
+
+/**
+ * @fn int pregJsonArrayOpen( struct preg_json_scan_s *scan , 
+ *                            const char *s , int l )
+ *
+ * @brief
+ *     starts walking the JSON array in s
+ *
+ * @param scan - filled in for pregJsonArrayNext
+ * @param s - the JSON text
+ * @param l - length of s
+ *
+ * @return 0 - on success
+ * @return -1 - if s doesn't start with an array
+ */
+int pregJsonArrayOpen(struct preg_json_scan_s *scan, const char *s, int l)
+{
+    scan->end = s + l ;
+    scan->p = pregJsonSkipSpace( s , scan->end ) ;
+    scan->first = 1 ;
+
+    if( scan->p >= scan->end || *scan->p != '[' )
+        return -1 ;
+
+    scan->p++ ;
+    return 0 ;
+}
+
+/**
+ * @fn int pregJsonArrayNext( struct preg_json_scan_s *scan , 
+ *                            const char **value , int *value_len , 
+ *                            int *escaped )
+ *
+ * @brief
+ *     gets the next element of the array opened by pregJsonArrayOpen
+ *
+ * @param scan - the scanner
+ * @param value - set to the element.  For a string, this is the text 
+ * between the quotes.
+ * @param value_len - set to the length of the element
+ * @param escaped - set if a string element has backslash escapes, which 
+ * pregJsonUnescape can decode
+ *
+ * @return PREG_JSON_STRING - for a string element
+ * @return PREG_JSON_OTHER - for any other element
+ * @return 0 - at the end of the array
+ * @return -1 - if the JSON is malformed
+ *
+ * @details Nothing is copied or allocated: the elements point into the 
+ * JSON text.  Nested arrays and objects are skipped as single elements, 
+ * and only the structure (brackets, braces, commas and strings) is 
+ * checked, so a malformed number or literal is returned as it is.
+ */
+int pregJsonArrayNext(struct preg_json_scan_s *scan, const char **value,
+                      int *value_len, int *escaped)
+{
+    const char *p ;
+    int depth = 0 ;             /* of nested arrays and objects */
+
+    p = pregJsonSkipSpace( scan->p , scan->end ) ;
+    if( p >= scan->end )
+        return -1 ;
+
+    if( *p == ']' && scan->first )
+    {
+        scan->p = p + 1 ;
+        return 0 ;
+    }
+    if( !scan->first )
+    {
+        if( *p == ']' )
+        {
+            scan->p = p + 1 ;
+            return 0 ;
+        }
+        if( *p != ',' )
+            return -1 ;
+        p = pregJsonSkipSpace( p + 1 , scan->end ) ;
+        if( p >= scan->end )
+            return -1 ;
+    }
+    scan->first = 0 ;
+
+    *escaped = 0 ;
+    if( *p == '"' )
+    {
+        *value = p + 1 ;
+        p = pregJsonSkipString( p + 1 , scan->end , escaped ) ;
+        if( !p )
+            return -1 ;
+        *value_len = p - *value ;
+        scan->p = p + 1 ;
+        return PREG_JSON_STRING ;
+    }
+
+    *value = p ;
+    for( ; p < scan->end ; p++ )
+    {
+        if( *p == '"' )
+        {
+            p = pregJsonSkipString( p + 1 , scan->end , escaped ) ;
+            if( !p )
+                return -1 ;
+        }
+        else if( *p == '[' || *p == '{' )
+            depth++ ;
+        else if( *p == ']' || *p == '}' )
+        {
+            if( !depth )
+                break ;
+            depth-- ;
+        }
+        else if( *p == ',' && !depth )
+            break ;
+    }
+    if( p >= scan->end )
+        return -1 ;
+
+    scan->p = p ;
+    while( p > *value && (p[-1] == ' ' || p[-1] == '\t' || 
+                          p[-1] == '\n' || p[-1] == '\r') )
+        p-- ;
+    *value_len = p - *value ;
+    *escaped = 0 ;
+
+    return *value_len ? PREG_JSON_OTHER : -1 ;
+}
+
+/**
+ * @fn static int pregJsonHex4( const char *s , unsigned int *u )
+ *
+ * @brief reads the 4 hex digits of a \\u escape
+ *
+ * @return 0 - on success
+ * @return -1 - if they aren't all hex digits
+ */
+static int pregJsonHex4(const char *s, unsigned int *u)
+{
+    int i ;
+
+    *u = 0 ;
+    for( i = 0 ; i < 4 ; i++ )
+    {
+        *u <<= 4 ;
+        if( s[i] >= '0' && s[i] <= '9' )
+            *u |= s[i] - '0' ;
+        else if( s[i] >= 'a' && s[i] <= 'f' )
+            *u |= s[i] - 'a' + 10 ;
+        else if( s[i] >= 'A' && s[i] <= 'F' )
+            *u |= s[i] - 'A' + 10 ;
+        else
+            return -1 ;
+    }
+    return 0 ;
+}
+
+/**
+ * @fn int pregJsonUnescape( char *dst , const char *s , int l )
+ *
+ * @brief
+ *     decodes the backslash escapes of a JSON string
+ *
+ * @param dst - where to write.  It must have room for l bytes, since 
+ * decoding never makes a string longer.
+ * @param s - the text between the quotes of the string
+ * @param l - length of s
+ *
+ * @return - the number of bytes written
+ *
+ * @details \\u escapes (including surrogate pairs) are written as UTF-8.
+ * An escape that isn't valid is copied as it is.
+ */
+int pregJsonUnescape(char *dst, const char *s, int l)
+{
+    char *d = dst ;
+    unsigned int u , lo ;       /* code point from \u escapes */
+    int i ;
+
+    for( i = 0 ; i < l ; i++ )
+    {
+        if( s[i] != '\\' || i + 1 >= l )
+        {
+            *d++ = s[i] ;
+            continue ;
+        }
+
+        switch( s[++i] )
+        {
+        case 'b': *d++ = '\b' ; break ;
+        case 'f': *d++ = '\f' ; break ;
+        case 'n': *d++ = '\n' ; break ;
+        case 'r': *d++ = '\r' ; break ;
+        case 't': *d++ = '\t' ; break ;
+        case 'u':
+            if( i + 5 > l || pregJsonHex4( s + i + 1 , &u ) )
+            {
+                *d++ = '\\' ;
+                *d++ = 'u' ;
+                break ;
+            }
+            i += 4 ;
+            if( u >= 0xd800 && u < 0xdc00 && i + 7 <= l && 
+                s[i+1] == '\\' && s[i+2] == 'u' && 
+                !pregJsonHex4( s + i + 3 , &lo ) && 
+                lo >= 0xdc00 && lo < 0xe000 )
+            {
+                u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00) ;
+                i += 6 ;
+            }
+
+            if( u < 0x80 )
+                *d++ = u ;
+            else if( u < 0x800 )
+            {
+                *d++ = 0xc0 | (u >> 6) ;
+                *d++ = 0x80 | (u & 0x3f) ;
+            }
+            else if( u < 0x10000 )
+            {
+                *d++ = 0xe0 | (u >> 12) ;
+                *d++ = 0x80 | ((u >> 6) & 0x3f) ;
+                *d++ = 0x80 | (u & 0x3f) ;
+            }
+            else
+            {
+                *d++ = 0xf0 | (u >> 18) ;
+                *d++ = 0x80 | ((u >> 12) & 0x3f) ;
+                *d++ = 0x80 | ((u >> 6) & 0x3f) ;
+                *d++ = 0x80 | (u & 0x3f) ;
+            }
+            break ;
+        default:                // \" \\ \/
+            *d++ = s[i] ;
+        }
+    }
+
+    return d - dst ;
+}
@@ -32,6 +32,27 @@
 
 void pregSetLimits(pcre_extra *extra);
 const char *pregExecErrorString(int pcre_errno);
+int pregJsonEscapedLength(const char *s, int l);
+char *pregJsonEscape(char *dst, const char *s, int l);
+int pregJsonStringLength(const char *s, int l);
+char *pregJsonString(char *dst, const char *s, int l);
+
+/*
+ * Walks the elements of a JSON array in place.  See pregJsonArrayNext.
+ */
+struct preg_json_scan_s {
+    const char *p ;             /* next character to look at */
+    const char *end ;           /* end of the JSON text */
+    int first ;                 /* no element read yet? */
+};
+
+#define PREG_JSON_STRING 1      /* element is a string */
+#define PREG_JSON_OTHER 2       /* element is a number, object, etc. */
+
+int pregJsonArrayOpen(struct preg_json_scan_s *scan, const char *s, int l);
+int pregJsonArrayNext(struct preg_json_scan_s *scan, const char **value,
+                      int *value_len, int *escaped);
+int pregJsonUnescape(char *dst, const char *s, int l);
 
 
 #endif
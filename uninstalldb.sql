@@ -9,7 +9,21 @@ DROP FUNCTION IF EXISTS preg_offset ;
 # current function
 DROP FUNCTION IF EXISTS lib_mysqludf_preg_info ;
 DROP FUNCTION IF EXISTS preg_capture ;
+DROP FUNCTION IF EXISTS preg_capture_first ;
+DROP FUNCTION IF EXISTS preg_capture_first_index ;
 DROP FUNCTION IF EXISTS preg_check ;
+DROP FUNCTION IF EXISTS preg_explain ;
+DROP FUNCTION IF EXISTS preg_extract_kv ;
+DROP FUNCTION IF EXISTS preg_grok ;
+DROP FUNCTION IF EXISTS preg_grok_define ;
+DROP FUNCTION IF EXISTS preg_json_array_any ;
+DROP FUNCTION IF EXISTS preg_json_array_count ;
+DROP FUNCTION IF EXISTS preg_json_array_first ;
+DROP FUNCTION IF EXISTS preg_minhash ;
+DROP FUNCTION IF EXISTS preg_minhash_similarity ;
+DROP FUNCTION IF EXISTS preg_overlaps ;
 DROP FUNCTION IF EXISTS preg_position ;
 DROP FUNCTION IF EXISTS preg_rlike ;
-DROP FUNCTION IF EXISTS preg_replace ;
\ No newline at end of file
+DROP FUNCTION IF EXISTS preg_replace ;
+DROP FUNCTION IF EXISTS preg_replace_hash ;
+DROP FUNCTION IF EXISTS preg_subsumes ;
\ No newline at end of file